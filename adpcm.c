@@ -1,5 +1,14 @@
 #include "adpcm.h"
+#include "pcm_ingest.h"
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#elif defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
 
 // IMA ADPCM encoder tables
 const int indexTable[16] = {
@@ -16,117 +25,1271 @@ const int stepTable[89] = {
   15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
 };
 
-static uint8_t encode_ima_adpcm_nibble( int sample, int* predictor, int* index )
+// Quantizer tables derived from stepTable and indexTable: the predictor change
+// for each step index and 3-bit magnitude, and the clamped next step index.
+static int32_t diffq_table[89][8];
+static uint8_t next_index_table[89][8];
+static pthread_once_t quantizer_tables_once = PTHREAD_ONCE_INIT;
+
+static void build_quantizer_tables( void )
+{
+  int index, delta, step, next;
+
+  for( index = 0; index < 89; index++ )
+  {
+    step = stepTable[index];
+    for( delta = 0; delta < 8; delta++ )
+    {
+      diffq_table[index][delta] = ( step >> 3 ) + ( ( delta & 4 ) ? step : 0 )
+                                  + ( ( delta & 2 ) ? step >> 1 : 0 ) + ( ( delta & 1 ) ? step >> 2 : 0 );
+
+      next = index + indexTable[delta];
+      if( next < 0 ) next = 0;
+      if( next > 88 ) next = 88;
+      next_index_table[index][delta] = (uint8_t) next;
+    }
+  }
+}
+
+// Encode one sample.  The sign is a mask and each magnitude bit a compare, so
+// the only data-dependent work left is the table lookups.
+static inline uint8_t encode_ima_adpcm_nibble( int sample, int* predictor, int* index )
 {
   int step = stepTable[*index];
   int diff = sample - *predictor;
-  int sign = ( diff < 0 ) ? 8 : 0;
-  int delta = 0;
-  int tempstep = step;
-  int diffq = 0;
+  int sign = -( diff < 0 );
+  int b4, b2, b1, delta, diffq, next;
+
+  diff = ( diff ^ sign ) - sign;
+  b4 = ( diff >= step );
+  diff -= step & -b4;
+  b2 = ( diff >= ( step >> 1 ) );
+  diff -= ( step >> 1 ) & -b2;
+  b1 = ( diff >= ( step >> 2 ) );
+  delta = ( b4 << 2 ) | ( b2 << 1 ) | b1;
+
+  diffq = diffq_table[*index][delta];
+  next = *predictor + ( ( diffq ^ sign ) - sign );
+  next = ( next > 32767 ) ? 32767 : next;
+  *predictor = ( next < -32768 ) ? -32768 : next;
+  *index = next_index_table[*index][delta];
 
-  if( sign )
+  return (uint8_t)( ( sign & 8 ) | delta );
+}
+
+// Read one input sample as signed 16-bit.
+static inline int pcm_sample( const void* pcm, size_t i, int is16bit )
+{
+  if( is16bit )
+    return ((const int16_t*)pcm)[i];
+
+  /* Firmware treats 8-bit PCM as unsigned 0..255. Convert to signed 16-bit range. */
+  return ( ((const uint8_t*)pcm)[i] - 128 ) << 8;
+}
+
+// Decode one nibble: the quantizer tables give the predictor change and
+// next step index, so all that is left is a conditional negate and a clamp.
+static inline int16_t decode_ima_adpcm_nibble( unsigned nibble, int* predictor, int* index )
+{
+  int sign = -(int)( ( nibble >> 3 ) & 1 );
+  int diffq = diffq_table[*index][nibble & 7];
+  int next = *predictor + ( ( diffq ^ sign ) - sign );
+
+  next = ( next > 32767 ) ? 32767 : next;
+  *predictor = ( next < -32768 ) ? -32768 : next;
+  *index = next_index_table[*index][nibble & 7];
+
+  return (int16_t) *predictor;
+}
+
+// Encode pairs of samples into whole bytes, low nibble first.  Every caller
+// below passes constant is16bit and channels, so each input format gets its
+// own loop with no per-sample dispatch.
+static inline __attribute__(( always_inline ))
+void encode_pairs( const void* pcm, size_t pairs, int is16bit, int channels,
+                   int* predictor, int* index, uint8_t* out )
+{
+  int pred[2] = { predictor[0], predictor[1] };
+  int idx[2] = { index[0], index[1] };
+  uint8_t low, high;
+  size_t i;
+
+  for( i = 0; i < pairs; i++ )
   {
-    diff = -diff;
+    low = encode_ima_adpcm_nibble( pcm_sample( pcm, 2 * i, is16bit ), &pred[0], &idx[0] );
+    high = encode_ima_adpcm_nibble( pcm_sample( pcm, 2 * i + 1, is16bit ),
+                                    &pred[channels - 1], &idx[channels - 1] );
+    out[i] = (uint8_t)( low | ( high << 4 ) );
   }
 
-  if( diff >= tempstep )
+  predictor[0] = pred[0];
+  predictor[1] = pred[1];
+  index[0] = idx[0];
+  index[1] = idx[1];
+}
+
+static void encode_pairs_8_mono( const void* pcm, size_t pairs, int* predictor, int* index, uint8_t* out )
+{
+  encode_pairs( pcm, pairs, 0, 1, predictor, index, out );
+}
+
+static void encode_pairs_8_stereo( const void* pcm, size_t pairs, int* predictor, int* index, uint8_t* out )
+{
+  encode_pairs( pcm, pairs, 0, 2, predictor, index, out );
+}
+
+static void encode_pairs_16_mono( const void* pcm, size_t pairs, int* predictor, int* index, uint8_t* out )
+{
+  encode_pairs( pcm, pairs, 1, 1, predictor, index, out );
+}
+
+static void encode_pairs_16_stereo( const void* pcm, size_t pairs, int* predictor, int* index, uint8_t* out )
+{
+  encode_pairs( pcm, pairs, 1, 2, predictor, index, out );
+}
+
+// Start an incremental encode.  Returns 0, or -1 for an unsupported format.
+int ima_adpcm_encoder_init( ima_adpcm_encoder_t* enc, int is16bit, int channels )
+{
+  if( !enc || ( channels != 1 && channels != 2 ) ) return -1;
+
+  pthread_once( &quantizer_tables_once, build_quantizer_tables );
+
+  memset( enc, 0, sizeof( *enc ) );
+  enc->is16bit = is16bit ? 1 : 0;
+  enc->channels = channels;
+  return 0;
+}
+
+// Encode samples with no seek point inside the run; returns the bytes written.
+static size_t encode_run( ima_adpcm_encoder_t* enc, const void* pcm, size_t num_samples, uint8_t* out )
+{
+  const uint8_t* src = pcm;
+  const size_t sample_bytes = enc->is16bit ? 2 : 1;
+  size_t written = 0;
+  size_t pairs;
+  uint8_t nibble;
+
+  if( num_samples == 0 ) return 0;
+
+  /* A sample left over from the last call is the low half of this byte. */
+  if( enc->has_pending )
   {
-    delta = 4;
-    diff -= tempstep;
+    nibble = encode_ima_adpcm_nibble( pcm_sample( src, 0, enc->is16bit ),
+                                      &enc->predictor[enc->channels - 1], &enc->index[enc->channels - 1] );
+    out[written++] = (uint8_t)( enc->pending | ( nibble << 4 ) );
+    enc->has_pending = 0;
+    src += sample_bytes;
+    num_samples--;
   }
-  tempstep >>= 1;
 
-  if( diff >= tempstep )
+  pairs = num_samples / 2;
+  if( enc->is16bit )
   {
-    delta |= 2;
-    diff -= tempstep;
+    if( enc->channels == 2 )
+      encode_pairs_16_stereo( src, pairs, enc->predictor, enc->index, out + written );
+    else
+      encode_pairs_16_mono( src, pairs, enc->predictor, enc->index, out + written );
   }
-  tempstep >>= 1;
+  else
+  {
+    if( enc->channels == 2 )
+      encode_pairs_8_stereo( src, pairs, enc->predictor, enc->index, out + written );
+    else
+      encode_pairs_8_mono( src, pairs, enc->predictor, enc->index, out + written );
+  }
+  written += pairs;
 
-  if( diff >= tempstep )
+  if( ( num_samples & 0x1 ) != 0 )
   {
-    delta |= 1;
+    enc->pending = encode_ima_adpcm_nibble( pcm_sample( src, 2 * pairs, enc->is16bit ),
+                                            &enc->predictor[0], &enc->index[0] );
+    enc->has_pending = 1;
   }
 
-  diffq = step >> 3;
-  if( delta & 4 ) diffq += step;
-  if( delta & 2 ) diffq += step >> 1;
-  if( delta & 1 ) diffq += step >> 2;
+  return written;
+}
 
-  if( sign )
+// Encode the next num_samples samples; returns the number of bytes written to out.
+size_t ima_adpcm_encoder_feed( ima_adpcm_encoder_t* enc, const void* pcm, size_t num_samples,
+                               uint8_t* out )
+{
+  const uint8_t* src = pcm;
+  const size_t sample_bytes = enc->is16bit ? 2 : 1;
+  uint64_t span, entry;
+  size_t written = 0;
+  size_t run;
+
+  if( !enc->seek )
   {
-    *predictor -= diffq;
+    enc->fed += num_samples;
+    return encode_run( enc, pcm, num_samples, out );
   }
-  else
+
+  /* Split the input at seek points and record the state at each one. */
+  span = (uint64_t) enc->seek_interval * (uint64_t) enc->channels;
+  while( num_samples > 0 )
   {
-    *predictor += diffq;
+    if( enc->fed % span == 0 )
+    {
+      entry = enc->fed / span;
+      for( int ch = 0; ch < 2; ch++ )
+      {
+        enc->seek[entry].predictor[ch] = (int16_t) enc->predictor[ch];
+        enc->seek[entry].index[ch] = (uint8_t) enc->index[ch];
+      }
+    }
+
+    run = (size_t)( span - enc->fed % span );
+    if( run > num_samples ) run = num_samples;
+
+    written += encode_run( enc, src, run, out + written );
+    src += run * sample_bytes;
+    num_samples -= run;
+    enc->fed += run;
   }
 
-  if( *predictor > 32767 ) *predictor = 32767;
-  if( *predictor < -32768 ) *predictor = -32768;
+  return written;
+}
+
+// Record the encoder state every interval frames into table.
+void ima_adpcm_encoder_set_seek( ima_adpcm_encoder_t* enc, size_t interval, ima_adpcm_snapshot_t* table )
+{
+  enc->seek_interval = interval;
+  enc->seek = ( interval != 0 ) ? table : NULL;
+}
+
+// Number of seek points for a stream: one at frame 0 and every interval frames after.
+size_t ima_adpcm_seek_count( size_t num_samples, int channels, size_t interval )
+{
+  size_t frames = num_samples / (size_t) channels;
+
+  if( interval == 0 ) return 0;
+  return ( frames + interval - 1 ) / interval;
+}
 
-  *index += indexTable[( sign | delta ) & 0x0F];
-  if( *index < 0 ) *index = 0;
-  if( *index > 88 ) *index = 88;
+// Flush a trailing sample as a byte with an empty high nibble; returns 0 or 1.
+size_t ima_adpcm_encoder_finish( ima_adpcm_encoder_t* enc, uint8_t* out )
+{
+  if( !enc->has_pending ) return 0;
 
-  return (uint8_t)(( sign | delta ) & 0x0F);
+  out[0] = enc->pending;
+  enc->has_pending = 0;
+  return 1;
 }
 
-// IMA ADPCM encoder for 8-bit or 16-bit PCM input
+// IMA ADPCM encoder for 8-bit or 16-bit PCM input, recording seek points
+// every interval frames into table when interval is not 0.
 // Returns malloc'd buffer and sets out_size. Returns NULL on error.
-// Output size is (num_samples + 1) / 2 (since each sample is 4 bits)
-uint8_t* encode_ima_adpcm( const void* pcm, size_t num_samples, int is16bit,
-                           int channels, size_t* out_size )
+uint8_t* encode_ima_adpcm_seek( const void* pcm, size_t num_samples, int is16bit, int channels,
+                                size_t interval, ima_adpcm_snapshot_t* table, size_t* out_size )
 {
+  ima_adpcm_encoder_t enc;
+  size_t o;
+
   if( !pcm || num_samples == 0 || !out_size ) return NULL;
   if( channels != 1 && channels != 2 ) return NULL;
   if( channels == 2 && ( num_samples % 2 ) != 0 ) return NULL;
+  if( interval != 0 && ( !table || ( interval * (size_t) channels ) % 2 != 0 ) ) return NULL;
 
   *out_size = ( num_samples + 1 ) / 2;
   uint8_t* out = malloc( *out_size );
   if( !out ) return NULL;
 
+  ima_adpcm_encoder_init( &enc, is16bit, channels );
+  ima_adpcm_encoder_set_seek( &enc, interval, table );
+  o = ima_adpcm_encoder_feed( &enc, pcm, num_samples, out );
+  ima_adpcm_encoder_finish( &enc, out + o );
+
+  return out;
+}
+
+// IMA ADPCM encoder for 8-bit or 16-bit PCM input
+// Returns malloc'd buffer and sets out_size. Returns NULL on error.
+// Output size is (num_samples + 1) / 2 (since each sample is 4 bits)
+uint8_t* encode_ima_adpcm( const void* pcm, size_t num_samples, int is16bit,
+                           int channels, size_t* out_size )
+{
+  return encode_ima_adpcm_seek( pcm, num_samples, is16bit, channels, 0, NULL, out_size );
+}
+
+
+// Encode a stream over the PCM it comes from, a slice at a time.  Each slice
+// is put in host byte order while it is in cache, encoded (and decoded and
+// measured when err is set) in a small buffer and then copied down to byte
+// done / 2, which is never past the input already read, so neither a second
+// payload-sized buffer nor a separate byte swap pass is needed.
+int encode_ima_adpcm_in_place( void* pcm, size_t num_samples, int is16bit, int bigendian, int channels,
+                               size_t interval, ima_adpcm_snapshot_t* table,
+                               ima_adpcm_error_t* err, size_t* out_size )
+{
+  ima_adpcm_snapshot_t state = { { 0, 0 }, { 0, 0 } };
+  ima_adpcm_encoder_t enc;
+  uint8_t bytes[IMA_ADPCM_VERIFY_SLICE / 2];
+  uint8_t* out = pcm;
+  int16_t* decoded = NULL;
+  size_t done = 0;
+  size_t o = 0;
+
+  if( !pcm || num_samples == 0 || !out_size ) return -1;
+  if( channels != 1 && channels != 2 ) return -1;
+  if( channels == 2 && ( num_samples % 2 ) != 0 ) return -1;
+  if( interval != 0 && ( !table || ( interval * (size_t) channels ) % 2 != 0 ) ) return -1;
+
+  if( err )
+  {
+    decoded = malloc( IMA_ADPCM_VERIFY_SLICE * sizeof( int16_t ) );
+    if( !decoded ) return -1;
+  }
+
+  ima_adpcm_encoder_init( &enc, is16bit, channels );
+  ima_adpcm_encoder_set_seek( &enc, interval, table );
+
+  while( done < num_samples )
+  {
+    size_t n = ( num_samples - done < IMA_ADPCM_VERIFY_SLICE ) ? num_samples - done : IMA_ADPCM_VERIFY_SLICE;
+    uint8_t* src = (uint8_t*) pcm + done * ( is16bit ? 2 : 1 );
+    size_t len;
+
+    if( is16bit )
+    {
+      pcm_ingest( src, src, n * 2, 2, bigendian );
+    }
+    len = ima_adpcm_encoder_feed( &enc, src, n, bytes );
+
+    if( done + n == num_samples )
+    {
+      len += ima_adpcm_encoder_finish( &enc, bytes + len );
+    }
+
+    // Slices are even, so the encoder holds no pending sample between them.
+    if( err )
+    {
+      decode_ima_adpcm_stream( &state, bytes, n, channels, decoded );
+      ima_adpcm_measure( err, src, decoded, n, is16bit );
+    }
+
+    memmove( out + o, bytes, len );
+    o += len;
+    done += n;
+  }
+
+  free( decoded );
+  *out_size = o;
+  return 0;
+}
+
+
+// Step index a block starts from: the smallest step covering the mean
+// sample-to-sample difference over the first few frames of the channel.
+static int estimate_block_index( const void* pcm, size_t first, size_t frames,
+                                 int is16bit, int channels, int channel )
+{
+  size_t count = ( frames - 1 < 8 ) ? frames - 1 : 8;
+  long sum = 0;
+  int prev = pcm_sample( pcm, first * channels + channel, is16bit );
+  int cur;
+  int index = 0;
+  size_t f;
+
+  if( count == 0 ) return 0;
+
+  for( f = 1; f <= count; f++ )
+  {
+    cur = pcm_sample( pcm, ( first + f ) * channels + channel, is16bit );
+    sum += ( cur > prev ) ? cur - prev : prev - cur;
+    prev = cur;
+  }
+
+  sum /= (long)count;
+  while( index < 88 && stepTable[index] < sum )
+  {
+    index++;
+  }
+
+  return index;
+}
+
+// Write the header of one channel of a block and return its start state.
+static void start_block_channel( const void* pcm, size_t first, size_t frames, int is16bit,
+                                 int channels, int channel, uint8_t* out, int* predictor, int* index )
+{
+  uint8_t* header = out + channel * IMA_ADPCM_BLOCK_HEADER;
+
+  *predictor = pcm_sample( pcm, first * channels + channel, is16bit );
+  *index = estimate_block_index( pcm, first, frames, is16bit, channels, channel );
+
+  /* Header: first sample (int16 LE), step index, reserved. */
+  header[0] = (uint8_t)( *predictor & 0xFF );
+  header[1] = (uint8_t)( ( *predictor >> 8 ) & 0xFF );
+  header[2] = (uint8_t) *index;
+  header[3] = 0;
+}
+
+// Encode one block of frames starting at frame first into out.
+static void encode_ima_adpcm_block( const void* pcm, size_t first, size_t frames,
+                                    int is16bit, int channels, uint8_t* out )
+{
   int predictor[2] = { 0, 0 };
   int index[2] = { 0, 0 };
-  int sample;
-  int pcm8;
-  int channel;
+  size_t groups = ( frames + IMA_ADPCM_GROUP_SAMPLES - 2 ) / IMA_ADPCM_GROUP_SAMPLES;
+  uint8_t* data = out + IMA_ADPCM_BLOCK_HEADER * channels;
+  uint8_t* word;
   uint8_t nibble;
-  size_t i, o = 0;
+  size_t g, f, k;
+  int ch;
+
+  for( ch = 0; ch < channels; ch++ )
+  {
+    start_block_channel( pcm, first, frames, is16bit, channels, ch, out, &predictor[ch], &index[ch] );
+  }
+
+  /* Each channel takes 4 bytes (8 samples, low nibble first) in turn. */
+  for( g = 0; g < groups; g++ )
+  {
+    for( ch = 0; ch < channels; ch++ )
+    {
+      word = data + ( g * channels + ch ) * ( IMA_ADPCM_GROUP_SAMPLES / 2 );
+
+      for( k = 0; k < IMA_ADPCM_GROUP_SAMPLES; k++ )
+      {
+        f = 1 + g * IMA_ADPCM_GROUP_SAMPLES + k;
+        nibble = 0;
+        if( f < frames )
+        {
+          nibble = encode_ima_adpcm_nibble( pcm_sample( pcm, ( first + f ) * channels + ch, is16bit ),
+                                            &predictor[ch], &index[ch] );
+        }
+
+        if( ( k & 0x1 ) == 0 )
+        {
+          word[k >> 1] = nibble;
+        }
+        else
+        {
+          word[k >> 1] |= (uint8_t)( nibble << 4 );
+        }
+      }
+    }
+  }
+}
+
+// Size in bytes of a block holding the given number of frames.
+size_t ima_adpcm_block_bytes( size_t frames, int channels )
+{
+  size_t groups;
+
+  if( frames == 0 ) return 0;
+
+  groups = ( frames + IMA_ADPCM_GROUP_SAMPLES - 2 ) / IMA_ADPCM_GROUP_SAMPLES;
+  return (size_t) channels * ( IMA_ADPCM_BLOCK_HEADER + groups * ( IMA_ADPCM_GROUP_SAMPLES / 2 ) );
+}
+
+// A contiguous run of blocks encoded by one thread.
+typedef struct
+{
+  const void* pcm;
+  size_t      first_block;
+  size_t      last_block;
+  size_t      frames;
+  size_t      block_samples;
+  size_t      block_bytes;
+  int         is16bit;
+  int         channels;
+  uint8_t*    out;
+} adpcm_block_run_t;
+
+// Blocks being decoded: the input, its layout, and where the samples go.
+typedef struct
+{
+  const uint8_t* adpcm;
+  size_t      block_samples;
+  size_t      block_bytes;
+  int         channels;
+  int16_t*    out;
+} adpcm_decode_run_t;
+
+/*
+ * Multi-lane encoders.  A stream is one channel of one block; streams do not
+ * depend on each other, so a kernel runs one stream per SIMD lane with the
+ * same arithmetic as encode_ima_adpcm_nibble(), branches replaced by compare
+ * masks.  Kernels take whole blocks starting at first_block, lanes / channels
+ * of them, all full length.  Decoding kernels work the same way with the
+ * arithmetic of decode_ima_adpcm_nibble().
+ */
+typedef void ( *lane_kernel_t )( const adpcm_block_run_t* run, size_t first_block );
+
+typedef void ( *decode_kernel_t )( const adpcm_decode_run_t* run, size_t first_block );
+
+static lane_kernel_t lane_kernel = 0;
+static unsigned lane_count = 1;
+typedef void ( *measure_kernel_t )( ima_adpcm_error_t* err, const void* pcm, const int16_t* decoded,
+                                    size_t num_samples, int is16bit );
+
+static decode_kernel_t decode_kernel = 0;
+static unsigned decode_lane_count = 1;
+static measure_kernel_t measure_kernel = 0;
+static pthread_once_t lane_kernel_once = PTHREAD_ONCE_INIT;
+
+// Write the lane headers and collect each lane's start state and positions.
+static void start_lanes( const adpcm_block_run_t* run, size_t first_block, unsigned lanes,
+                         int32_t* predictor, int32_t* index, size_t* base, uint8_t** data )
+{
+  int pred, idx;
+
+  for( unsigned l = 0; l < lanes; l++ )
+  {
+    size_t block = first_block + l / (unsigned) run->channels;
+    int channel = (int)( l % (unsigned) run->channels );
+    uint8_t* out = run->out + block * run->block_bytes;
+
+    start_block_channel( run->pcm, block * run->block_samples, run->block_samples, run->is16bit,
+                         run->channels, channel, out, &pred, &idx );
+    predictor[l] = pred;
+    index[l] = idx;
+    base[l] = block * run->block_samples * (size_t) run->channels + (size_t) channel;
+    data[l] = out + IMA_ADPCM_BLOCK_HEADER * run->channels + channel * ( IMA_ADPCM_GROUP_SAMPLES / 2 );
+  }
+}
+
+// Gather frame f of every lane as signed 16-bit samples.
+static void load_lanes( const adpcm_block_run_t* run, const size_t* base, size_t f,
+                        unsigned lanes, int32_t* samples )
+{
+  size_t offset = f * (size_t) run->channels;
+
+  if( run->is16bit )
+  {
+    for( unsigned l = 0; l < lanes; l++ )
+      samples[l] = ((const int16_t*)run->pcm)[ base[l] + offset ];
+  }
+  else
+  {
+    for( unsigned l = 0; l < lanes; l++ )
+      samples[l] = ( ((const uint8_t*)run->pcm)[ base[l] + offset ] - 128 ) << 8;
+  }
+}
+
+// Store one finished 8-sample group per lane, low nibble first.
+static void store_lanes( const uint32_t* words, uint8_t** data, size_t group, int channels,
+                         unsigned lanes )
+{
+  size_t offset = group * (size_t) channels * ( IMA_ADPCM_GROUP_SAMPLES / 2 );
+
+  for( unsigned l = 0; l < lanes; l++ )
+  {
+    uint8_t* word = data[l] + offset;
+
+    word[0] = (uint8_t) words[l];
+    word[1] = (uint8_t)( words[l] >> 8 );
+    word[2] = (uint8_t)( words[l] >> 16 );
+    word[3] = (uint8_t)( words[l] >> 24 );
+  }
+}
+
+// Read lane l's header and set up where its nibbles come from and its samples go.
+static void start_decode_lanes( const adpcm_decode_run_t* run, size_t first_block, unsigned lanes,
+                                int32_t* predictor, int32_t* index, const uint8_t** data, int16_t** dst )
+{
+  for( unsigned l = 0; l < lanes; l++ )
+  {
+    size_t block = first_block + l / (unsigned) run->channels;
+    int channel = (int)( l % (unsigned) run->channels );
+    const uint8_t* in = run->adpcm + block * run->block_bytes;
+    const uint8_t* header = in + IMA_ADPCM_BLOCK_HEADER * channel;
+
+    predictor[l] = (int16_t)( header[0] | ( header[1] << 8 ) );
+    index[l] = ( header[2] > 88 ) ? 88 : header[2];
+    data[l] = in + IMA_ADPCM_BLOCK_HEADER * run->channels + channel * ( IMA_ADPCM_GROUP_SAMPLES / 2 );
+    dst[l] = run->out + block * run->block_samples * (size_t) run->channels + (size_t) channel;
+    dst[l][0] = (int16_t) predictor[l];
+  }
+}
+
+// Add the squared source, squared error and peak error of some samples to err.
+static void measure_error_scalar( ima_adpcm_error_t* err, const void* pcm, const int16_t* decoded,
+                                  size_t num_samples, int is16bit )
+{
+  uint64_t signal = 0, noise = 0;
+  uint32_t peak = err->peak;
+
+  for( size_t i = 0; i < num_samples; i++ )
+  {
+    int64_t sample = pcm_sample( pcm, i, is16bit );
+    int64_t diff = sample - decoded[i];
+    uint32_t magnitude = (uint32_t)( ( diff < 0 ) ? -diff : diff );
+
+    signal += (uint64_t)( sample * sample );
+    noise += (uint64_t)( diff * diff );
+    peak = ( magnitude > peak ) ? magnitude : peak;
+  }
+
+  err->samples += num_samples;
+  err->signal += signal;
+  err->noise += noise;
+  err->peak = peak;
+}
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+
+__attribute__(( target( "avx2" ) ))
+static void encode_lanes_avx2( const adpcm_block_run_t* run, size_t first_block )
+{
+  int32_t predictor_s[8], index_s[8], samples[8];
+  uint32_t words[8];
+  size_t base[8];
+  uint8_t* data[8];
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32( 1 );
+  const __m256i max_index = _mm256_set1_epi32( 88 );
+  const __m256i max_sample = _mm256_set1_epi32( 32767 );
+  const __m256i min_sample = _mm256_set1_epi32( -32768 );
+  __m256i predictor, index, word = zero;
 
-  for( i = 0; i < num_samples; i++ ) {
-    channel = ( channels == 2 ) ? (int)( i & 0x1 ) : 0;
+  start_lanes( run, first_block, 8, predictor_s, index_s, base, data );
+  predictor = _mm256_loadu_si256( (const __m256i*) predictor_s );
+  index = _mm256_loadu_si256( (const __m256i*) index_s );
+
+  for( size_t f = 1; f < run->block_samples; f++ )
+  {
+    unsigned k = (unsigned)( ( f - 1 ) % IMA_ADPCM_GROUP_SAMPLES );
+    __m256i sample, step, half, quarter, diff, sign, m4, m2, m1, diffq, nibble;
+
+    load_lanes( run, base, f, 8, samples );
+    sample = _mm256_loadu_si256( (const __m256i*) samples );
+    step = _mm256_i32gather_epi32( stepTable, index, 4 );
+    half = _mm256_srai_epi32( step, 1 );
+    quarter = _mm256_srai_epi32( step, 2 );
+
+    diff = _mm256_sub_epi32( sample, predictor );
+    sign = _mm256_cmpgt_epi32( zero, diff );
+    diff = _mm256_abs_epi32( diff );
+
+    // diff >= t is diff > t - 1
+    m4 = _mm256_cmpgt_epi32( diff, _mm256_sub_epi32( step, one ) );
+    diff = _mm256_sub_epi32( diff, _mm256_and_si256( m4, step ) );
+    m2 = _mm256_cmpgt_epi32( diff, _mm256_sub_epi32( half, one ) );
+    diff = _mm256_sub_epi32( diff, _mm256_and_si256( m2, half ) );
+    m1 = _mm256_cmpgt_epi32( diff, _mm256_sub_epi32( quarter, one ) );
+
+    diffq = _mm256_add_epi32( _mm256_srai_epi32( step, 3 ), _mm256_and_si256( m4, step ) );
+    diffq = _mm256_add_epi32( diffq, _mm256_and_si256( m2, half ) );
+    diffq = _mm256_add_epi32( diffq, _mm256_and_si256( m1, quarter ) );
+    predictor = _mm256_blendv_epi8( _mm256_add_epi32( predictor, diffq ),
+                                    _mm256_sub_epi32( predictor, diffq ), sign );
+    predictor = _mm256_max_epi32( _mm256_min_epi32( predictor, max_sample ), min_sample );
+
+    nibble = _mm256_and_si256( sign, _mm256_set1_epi32( 8 ) );
+    nibble = _mm256_or_si256( nibble, _mm256_and_si256( m4, _mm256_set1_epi32( 4 ) ) );
+    nibble = _mm256_or_si256( nibble, _mm256_and_si256( m2, _mm256_set1_epi32( 2 ) ) );
+    nibble = _mm256_or_si256( nibble, _mm256_and_si256( m1, one ) );
+
+    index = _mm256_add_epi32( index, _mm256_i32gather_epi32( indexTable, nibble, 4 ) );
+    index = _mm256_min_epi32( _mm256_max_epi32( index, zero ), max_index );
+
+    word = _mm256_or_si256( word, _mm256_sll_epi32( nibble, _mm_cvtsi32_si128( (int)( k * 4 ) ) ) );
+    if( k == IMA_ADPCM_GROUP_SAMPLES - 1 )
+    {
+      _mm256_storeu_si256( (__m256i*) words, word );
+      store_lanes( words, data, ( f - 1 ) / IMA_ADPCM_GROUP_SAMPLES, run->channels, 8 );
+      word = zero;
+    }
+  }
+}
+
+__attribute__(( target( "sse4.1" ) ))
+static void encode_lanes_sse41( const adpcm_block_run_t* run, size_t first_block )
+{
+  int32_t predictor_s[4], index_s[4], samples[4], nibbles[4];
+  uint32_t words[4];
+  size_t base[4];
+  uint8_t* data[4];
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi32( 1 );
+  const __m128i max_index = _mm_set1_epi32( 88 );
+  const __m128i max_sample = _mm_set1_epi32( 32767 );
+  const __m128i min_sample = _mm_set1_epi32( -32768 );
+  __m128i predictor, index, word = zero;
+
+  start_lanes( run, first_block, 4, predictor_s, index_s, base, data );
+  predictor = _mm_loadu_si128( (const __m128i*) predictor_s );
+
+  for( size_t f = 1; f < run->block_samples; f++ )
+  {
+    unsigned k = (unsigned)( ( f - 1 ) % IMA_ADPCM_GROUP_SAMPLES );
+    __m128i sample, step, half, quarter, diff, sign, m4, m2, m1, diffq, nibble;
+
+    load_lanes( run, base, f, 4, samples );
+    sample = _mm_loadu_si128( (const __m128i*) samples );
+    step = _mm_setr_epi32( stepTable[ index_s[0] ], stepTable[ index_s[1] ],
+                           stepTable[ index_s[2] ], stepTable[ index_s[3] ] );
+    half = _mm_srai_epi32( step, 1 );
+    quarter = _mm_srai_epi32( step, 2 );
+
+    diff = _mm_sub_epi32( sample, predictor );
+    sign = _mm_cmpgt_epi32( zero, diff );
+    diff = _mm_abs_epi32( diff );
+
+    m4 = _mm_cmpgt_epi32( diff, _mm_sub_epi32( step, one ) );
+    diff = _mm_sub_epi32( diff, _mm_and_si128( m4, step ) );
+    m2 = _mm_cmpgt_epi32( diff, _mm_sub_epi32( half, one ) );
+    diff = _mm_sub_epi32( diff, _mm_and_si128( m2, half ) );
+    m1 = _mm_cmpgt_epi32( diff, _mm_sub_epi32( quarter, one ) );
+
+    diffq = _mm_add_epi32( _mm_srai_epi32( step, 3 ), _mm_and_si128( m4, step ) );
+    diffq = _mm_add_epi32( diffq, _mm_and_si128( m2, half ) );
+    diffq = _mm_add_epi32( diffq, _mm_and_si128( m1, quarter ) );
+    predictor = _mm_blendv_epi8( _mm_add_epi32( predictor, diffq ), _mm_sub_epi32( predictor, diffq ), sign );
+    predictor = _mm_max_epi32( _mm_min_epi32( predictor, max_sample ), min_sample );
+
+    nibble = _mm_and_si128( sign, _mm_set1_epi32( 8 ) );
+    nibble = _mm_or_si128( nibble, _mm_and_si128( m4, _mm_set1_epi32( 4 ) ) );
+    nibble = _mm_or_si128( nibble, _mm_and_si128( m2, _mm_set1_epi32( 2 ) ) );
+    nibble = _mm_or_si128( nibble, _mm_and_si128( m1, one ) );
+
+    // No gather before AVX2: the index table is read per lane.
+    _mm_storeu_si128( (__m128i*) nibbles, nibble );
+    index = _mm_loadu_si128( (const __m128i*) index_s );
+    index = _mm_add_epi32( index, _mm_setr_epi32( indexTable[ nibbles[0] ], indexTable[ nibbles[1] ],
+                                                  indexTable[ nibbles[2] ], indexTable[ nibbles[3] ] ) );
+    index = _mm_min_epi32( _mm_max_epi32( index, zero ), max_index );
+    _mm_storeu_si128( (__m128i*) index_s, index );
+
+    word = _mm_or_si128( word, _mm_sll_epi32( nibble, _mm_cvtsi32_si128( (int)( k * 4 ) ) ) );
+    if( k == IMA_ADPCM_GROUP_SAMPLES - 1 )
+    {
+      _mm_storeu_si128( (__m128i*) words, word );
+      store_lanes( words, data, ( f - 1 ) / IMA_ADPCM_GROUP_SAMPLES, run->channels, 4 );
+      word = zero;
+    }
+  }
+}
+
+__attribute__(( target( "avx2" ) ))
+static void decode_lanes_avx2( const adpcm_decode_run_t* run, size_t first_block )
+{
+  int32_t predictor_s[8], index_s[8], words_s[8], samples[8];
+  const uint8_t* data[8];
+  int16_t* dst[8];
+  const size_t stride = (size_t) run->channels * ( IMA_ADPCM_GROUP_SAMPLES / 2 );
+  const size_t groups = ( run->block_samples - 1 ) / IMA_ADPCM_GROUP_SAMPLES;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i seven = _mm256_set1_epi32( 7 );
+  const __m256i fifteen = _mm256_set1_epi32( 15 );
+  const __m256i max_index = _mm256_set1_epi32( 88 );
+  const __m256i max_sample = _mm256_set1_epi32( 32767 );
+  const __m256i min_sample = _mm256_set1_epi32( -32768 );
+  __m256i predictor, index, words;
+
+  start_decode_lanes( run, first_block, 8, predictor_s, index_s, data, dst );
+  predictor = _mm256_loadu_si256( (const __m256i*) predictor_s );
+  index = _mm256_loadu_si256( (const __m256i*) index_s );
+
+  for( size_t g = 0; g < groups; g++ )
+  {
+    for( unsigned l = 0; l < 8; l++ )
+    {
+      const uint8_t* word = data[l] + g * stride;
+      words_s[l] = (int32_t)( word[0] | ( word[1] << 8 ) | ( word[2] << 16 ) | ( (uint32_t) word[3] << 24 ) );
+    }
+    words = _mm256_loadu_si256( (const __m256i*) words_s );
+
+    for( unsigned k = 0; k < IMA_ADPCM_GROUP_SAMPLES; k++ )
+    {
+      size_t f = 1 + g * IMA_ADPCM_GROUP_SAMPLES + k;
+      __m256i nibble = _mm256_and_si256( words, fifteen );
+      __m256i sign = _mm256_cmpgt_epi32( nibble, seven );
+      __m256i slot = _mm256_add_epi32( _mm256_slli_epi32( index, 3 ), _mm256_and_si256( nibble, seven ) );
+      __m256i diffq = _mm256_i32gather_epi32( &diffq_table[0][0], slot, 4 );
+
+      predictor = _mm256_blendv_epi8( _mm256_add_epi32( predictor, diffq ),
+                                      _mm256_sub_epi32( predictor, diffq ), sign );
+      predictor = _mm256_max_epi32( _mm256_min_epi32( predictor, max_sample ), min_sample );
+      index = _mm256_add_epi32( index, _mm256_i32gather_epi32( indexTable, nibble, 4 ) );
+      index = _mm256_min_epi32( _mm256_max_epi32( index, zero ), max_index );
+      words = _mm256_srli_epi32( words, 4 );
+
+      _mm256_storeu_si256( (__m256i*) samples, predictor );
+      for( unsigned l = 0; l < 8; l++ )
+      {
+        dst[l][ f * (size_t) run->channels ] = (int16_t) samples[l];
+      }
+    }
+  }
+}
+
+// Squares of 32-bit lanes summed into four 64-bit lanes.
+__attribute__(( target( "avx2" ) ))
+static inline __m256i add_squares_avx2( __m256i sum, __m256i v )
+{
+  sum = _mm256_add_epi64( sum, _mm256_mul_epi32( v, v ) );
+  v = _mm256_srli_epi64( v, 32 );
+  return _mm256_add_epi64( sum, _mm256_mul_epi32( v, v ) );
+}
+
+// measure_error_scalar() eight samples at a time, the sums kept exact in 64-bit lanes.
+__attribute__(( target( "avx2" ) ))
+static void measure_error_avx2( ima_adpcm_error_t* err, const void* pcm, const int16_t* decoded,
+                                size_t num_samples, int is16bit )
+{
+  __m256i signal = _mm256_setzero_si256();
+  __m256i noise = _mm256_setzero_si256();
+  __m256i peak = _mm256_set1_epi32( (int32_t) err->peak );
+  uint64_t sums[4];
+  uint32_t peaks[8];
+  size_t i = 0;
+
+  for( ; i + 8 <= num_samples; i += 8 )
+  {
+    __m256i sample, diff;
 
     if( is16bit )
-      sample = ((const int16_t*)pcm)[i];
+    {
+      sample = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)( (const int16_t*) pcm + i ) ) );
+    }
     else
     {
-      /* Firmware treats 8-bit PCM as unsigned 0..255. Convert to signed 16-bit range. */
-      pcm8 = ((const uint8_t*)pcm)[i];
-      sample = ( pcm8 - 128 ) << 8;
+      sample = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)( (const uint8_t*) pcm + i ) ) );
+      sample = _mm256_slli_epi32( _mm256_sub_epi32( sample, _mm256_set1_epi32( 128 ) ), 8 );
     }
+    diff = _mm256_sub_epi32( sample, _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)( decoded + i ) ) ) );
 
-    if( sample > 32767 ) sample = 32767;
-    if( sample < -32768 ) sample = -32768;
-    nibble = encode_ima_adpcm_nibble( sample, &predictor[channel], &index[channel] );
+    signal = add_squares_avx2( signal, sample );
+    noise = add_squares_avx2( noise, diff );
+    peak = _mm256_max_epu32( peak, _mm256_abs_epi32( diff ) );
+  }
+
+  _mm256_storeu_si256( (__m256i*) peaks, peak );
+  for( unsigned l = 0; l < 8; l++ )
+  {
+    err->peak = ( peaks[l] > err->peak ) ? peaks[l] : err->peak;
+  }
+  _mm256_storeu_si256( (__m256i*) sums, signal );
+  err->signal += sums[0] + sums[1] + sums[2] + sums[3];
+  _mm256_storeu_si256( (__m256i*) sums, noise );
+  err->noise += sums[0] + sums[1] + sums[2] + sums[3];
+  err->samples += i;
 
-    /* ADPCM nibbles are packed low then high, following input sample order. */
-    if( ( i & 0x1 ) == 0 )
+  if( i < num_samples )
+  {
+    measure_error_scalar( err, is16bit ? (const void*)( (const int16_t*) pcm + i ) : (const void*)( (const uint8_t*) pcm + i ),
+                          decoded + i, num_samples - i, is16bit );
+  }
+}
+
+#elif defined( __aarch64__ )
+
+static void encode_lanes_neon( const adpcm_block_run_t* run, size_t first_block )
+{
+  int32_t predictor_s[4], index_s[4], samples[4];
+  uint32_t words[4], nibbles[4];
+  size_t base[4];
+  uint8_t* data[4];
+  const int32x4_t zero = vdupq_n_s32( 0 );
+  const int32x4_t max_index = vdupq_n_s32( 88 );
+  const int32x4_t max_sample = vdupq_n_s32( 32767 );
+  const int32x4_t min_sample = vdupq_n_s32( -32768 );
+  int32x4_t predictor, index;
+  uint32x4_t word = vdupq_n_u32( 0 );
+
+  start_lanes( run, first_block, 4, predictor_s, index_s, base, data );
+  predictor = vld1q_s32( predictor_s );
+
+  for( size_t f = 1; f < run->block_samples; f++ )
+  {
+    unsigned k = (unsigned)( ( f - 1 ) % IMA_ADPCM_GROUP_SAMPLES );
+    int32x4_t sample, step, half, quarter, diff, diffq;
+    uint32x4_t sign, m4, m2, m1, nibble;
+
+    load_lanes( run, base, f, 4, samples );
+    sample = vld1q_s32( samples );
+    step = vsetq_lane_s32( stepTable[ index_s[0] ], zero, 0 );
+    step = vsetq_lane_s32( stepTable[ index_s[1] ], step, 1 );
+    step = vsetq_lane_s32( stepTable[ index_s[2] ], step, 2 );
+    step = vsetq_lane_s32( stepTable[ index_s[3] ], step, 3 );
+    half = vshrq_n_s32( step, 1 );
+    quarter = vshrq_n_s32( step, 2 );
+
+    diff = vsubq_s32( sample, predictor );
+    sign = vcltq_s32( diff, zero );
+    diff = vabsq_s32( diff );
+
+    m4 = vcgeq_s32( diff, step );
+    diff = vsubq_s32( diff, vandq_s32( vreinterpretq_s32_u32( m4 ), step ) );
+    m2 = vcgeq_s32( diff, half );
+    diff = vsubq_s32( diff, vandq_s32( vreinterpretq_s32_u32( m2 ), half ) );
+    m1 = vcgeq_s32( diff, quarter );
+
+    diffq = vaddq_s32( vshrq_n_s32( step, 3 ), vandq_s32( vreinterpretq_s32_u32( m4 ), step ) );
+    diffq = vaddq_s32( diffq, vandq_s32( vreinterpretq_s32_u32( m2 ), half ) );
+    diffq = vaddq_s32( diffq, vandq_s32( vreinterpretq_s32_u32( m1 ), quarter ) );
+    predictor = vbslq_s32( sign, vsubq_s32( predictor, diffq ), vaddq_s32( predictor, diffq ) );
+    predictor = vmaxq_s32( vminq_s32( predictor, max_sample ), min_sample );
+
+    nibble = vandq_u32( sign, vdupq_n_u32( 8 ) );
+    nibble = vorrq_u32( nibble, vandq_u32( m4, vdupq_n_u32( 4 ) ) );
+    nibble = vorrq_u32( nibble, vandq_u32( m2, vdupq_n_u32( 2 ) ) );
+    nibble = vorrq_u32( nibble, vandq_u32( m1, vdupq_n_u32( 1 ) ) );
+
+    vst1q_u32( nibbles, nibble );
+    index = vld1q_s32( index_s );
+    index = vsetq_lane_s32( vgetq_lane_s32( index, 0 ) + indexTable[ nibbles[0] ], index, 0 );
+    index = vsetq_lane_s32( vgetq_lane_s32( index, 1 ) + indexTable[ nibbles[1] ], index, 1 );
+    index = vsetq_lane_s32( vgetq_lane_s32( index, 2 ) + indexTable[ nibbles[2] ], index, 2 );
+    index = vsetq_lane_s32( vgetq_lane_s32( index, 3 ) + indexTable[ nibbles[3] ], index, 3 );
+    index = vminq_s32( vmaxq_s32( index, zero ), max_index );
+    vst1q_s32( index_s, index );
+
+    word = vorrq_u32( word, vshlq_u32( nibble, vdupq_n_s32( (int32_t)( k * 4 ) ) ) );
+    if( k == IMA_ADPCM_GROUP_SAMPLES - 1 )
     {
-      out[o] = nibble;
+      vst1q_u32( words, word );
+      store_lanes( words, data, ( f - 1 ) / IMA_ADPCM_GROUP_SAMPLES, run->channels, 4 );
+      word = vdupq_n_u32( 0 );
     }
-    else
+  }
+}
+
+#endif
+
+// Pick the widest lane kernel the running CPU supports.
+static void select_lane_kernel( void )
+{
+  lane_kernel = 0;
+  lane_count = 1;
+  decode_kernel = 0;
+  decode_lane_count = 1;
+  measure_kernel = measure_error_scalar;
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) )
+  {
+    lane_kernel = encode_lanes_avx2;
+    lane_count = 8;
+    // Decoding needs gathers for its table lookups, so it has no SSE4.1 kernel.
+    decode_kernel = decode_lanes_avx2;
+    decode_lane_count = 8;
+    measure_kernel = measure_error_avx2;
+  }
+  else if( __builtin_cpu_supports( "sse4.1" ) )
+  {
+    lane_kernel = encode_lanes_sse41;
+    lane_count = 4;
+  }
+#elif defined( __aarch64__ )
+  lane_kernel = encode_lanes_neon;
+  lane_count = 4;
+#endif
+}
+
+// Number of SIMD lanes block encoding uses; enable 0 falls back to the scalar reference
+// for block encoding and decoding.
+unsigned ima_adpcm_simd_lanes( int enable )
+{
+  pthread_once( &lane_kernel_once, select_lane_kernel );
+  if( enable )
+  {
+    select_lane_kernel();
+  }
+  else
+  {
+    lane_kernel = 0;
+    lane_count = 1;
+    decode_kernel = 0;
+    decode_lane_count = 1;
+    measure_kernel = measure_error_scalar;
+  }
+
+  return lane_count;
+}
+
+static void* encode_block_run( void* arg )
+{
+  adpcm_block_run_t* run = arg;
+  size_t b = run->first_block;
+  size_t full_blocks = run->frames / run->block_samples;
+  size_t first, frames;
+
+  // Whole blocks go through the lane kernel, lanes / channels at a time.
+  if( lane_kernel != 0 )
+  {
+    size_t group = lane_count / (unsigned) run->channels;
+    size_t last = ( run->last_block < full_blocks ) ? run->last_block : full_blocks;
+
+    for( ; b + group <= last; b += group )
     {
-      out[o] |= (uint8_t)( nibble << 4 );
-      o++;
+      lane_kernel( run, b );
     }
   }
 
-  if( ( num_samples & 0x1 ) != 0 )
+  for( ; b < run->last_block; b++ )
   {
-    o++;
+    first = b * run->block_samples;
+    frames = run->frames - first;
+    if( frames > run->block_samples ) frames = run->block_samples;
+
+    encode_ima_adpcm_block( run->pcm, first, frames, run->is16bit, run->channels,
+                            run->out + b * run->block_bytes );
+  }
+
+  return 0;
+}
+// Block IMA ADPCM encoder.  Every block_samples frames start a new block, so
+// the blocks are split across threads; the output does not depend on threads.
+uint8_t* encode_ima_adpcm_blocks( const void* pcm, size_t num_samples, int is16bit,
+                                  int channels, size_t block_samples, unsigned threads,
+                                  size_t* out_size )
+{
+  adpcm_block_run_t runs[ IMA_ADPCM_MAX_THREADS ];
+  pthread_t workers[ IMA_ADPCM_MAX_THREADS ];
+  uint8_t spawned[ IMA_ADPCM_MAX_THREADS ] = { 0 };
+  size_t frames, blocks, block_bytes, first_block = 0;
+  uint8_t* out;
+  unsigned t;
+
+  if( !pcm || num_samples == 0 || !out_size ) return NULL;
+  if( channels != 1 && channels != 2 ) return NULL;
+  if( ( num_samples % (size_t)channels ) != 0 ) return NULL;
+  if( block_samples < 2 || ( ( block_samples - 1 ) % IMA_ADPCM_GROUP_SAMPLES ) != 0 ) return NULL;
+
+  frames = num_samples / (size_t)channels;
+  blocks = ( frames + block_samples - 1 ) / block_samples;
+  block_bytes = ima_adpcm_block_bytes( block_samples, channels );
+  *out_size = ( frames / block_samples ) * block_bytes
+              + ima_adpcm_block_bytes( frames % block_samples, channels );
+
+  out = malloc( *out_size );
+  if( !out ) return NULL;
+
+  pthread_once( &quantizer_tables_once, build_quantizer_tables );
+  pthread_once( &lane_kernel_once, select_lane_kernel );
+  if( threads > IMA_ADPCM_MAX_THREADS ) threads = IMA_ADPCM_MAX_THREADS;
+  if( threads > blocks ) threads = (unsigned) blocks;
+  if( threads == 0 ) threads = 1;
+
+  for( t = 0; t < threads; t++ )
+  {
+    runs[t].pcm = pcm;
+    runs[t].first_block = first_block;
+    runs[t].last_block = blocks * ( t + 1 ) / threads;
+    runs[t].frames = frames;
+    runs[t].block_samples = block_samples;
+    runs[t].block_bytes = block_bytes;
+    runs[t].is16bit = is16bit;
+    runs[t].channels = channels;
+    runs[t].out = out;
+    first_block = runs[t].last_block;
+  }
+
+  // The calling thread takes the first run, and any a thread could not be made for.
+  for( t = 1; t < threads; t++ )
+  {
+    spawned[t] = ( pthread_create( &workers[t], 0, encode_block_run, &runs[t] ) == 0 );
+  }
+
+  encode_block_run( &runs[0] );
+
+  for( t = 1; t < threads; t++ )
+  {
+    if( spawned[t] )
+      pthread_join( workers[t], 0 );
+    else
+      encode_block_run( &runs[t] );
   }
 
   return out;
 }
+
+// Decode a stream, continuing from state.  Stereo bytes hold one frame, so the
+// two channels are independent chains decoded side by side.
+size_t decode_ima_adpcm_stream( ima_adpcm_snapshot_t* state, const uint8_t* adpcm, size_t num_samples,
+                                int channels, int16_t* out )
+{
+  int pred[2] = { state->predictor[0], state->predictor[1] };
+  int idx[2] = { state->index[0], state->index[1] };
+  size_t pairs = num_samples / 2;
+  size_t i;
+
+  pthread_once( &quantizer_tables_once, build_quantizer_tables );
+
+  if( channels == 2 )
+  {
+    for( i = 0; i < pairs; i++ )
+    {
+      out[2 * i] = decode_ima_adpcm_nibble( adpcm[i] & 0x0F, &pred[0], &idx[0] );
+      out[2 * i + 1] = decode_ima_adpcm_nibble( adpcm[i] >> 4, &pred[1], &idx[1] );
+    }
+  }
+  else
+  {
+    for( i = 0; i < pairs; i++ )
+    {
+      out[2 * i] = decode_ima_adpcm_nibble( adpcm[i] & 0x0F, &pred[0], &idx[0] );
+      out[2 * i + 1] = decode_ima_adpcm_nibble( adpcm[i] >> 4, &pred[0], &idx[0] );
+    }
+  }
+
+  // A trailing odd sample takes the low nibble of the last byte.
+  if( num_samples & 1 )
+  {
+    out[2 * pairs] = decode_ima_adpcm_nibble( adpcm[pairs] & 0x0F, &pred[0], &idx[0] );
+  }
+
+  state->predictor[0] = (int16_t) pred[0];
+  state->predictor[1] = (int16_t) pred[1];
+  state->index[0] = (uint8_t) idx[0];
+  state->index[1] = (uint8_t) idx[1];
+
+  return ( num_samples + 1 ) / 2;
+}
+
+// Decode one block of frames into out, one channel at a time.
+static void decode_ima_adpcm_block( const uint8_t* block, size_t frames, int channels, int16_t* out )
+{
+  const uint8_t* data = block + IMA_ADPCM_BLOCK_HEADER * channels;
+  size_t f, k;
+  int ch;
+
+  for( ch = 0; ch < channels; ch++ )
+  {
+    const uint8_t* header = block + IMA_ADPCM_BLOCK_HEADER * ch;
+    int predictor = (int16_t)( header[0] | ( header[1] << 8 ) );
+    int index = ( header[2] > 88 ) ? 88 : header[2];
+
+    out[ch] = (int16_t) predictor;
+    for( f = 1; f < frames; f++ )
+    {
+      k = f - 1;
+      const uint8_t* word = data + ( ( k / IMA_ADPCM_GROUP_SAMPLES ) * channels + ch ) * ( IMA_ADPCM_GROUP_SAMPLES / 2 );
+      unsigned byte = word[ ( k % IMA_ADPCM_GROUP_SAMPLES ) >> 1 ];
+
+      out[f * channels + ch] = decode_ima_adpcm_nibble( ( k & 1 ) ? byte >> 4 : byte & 0x0F,
+                                                        &predictor, &index );
+    }
+  }
+}
+
+// Decode block ADPCM.  Whole blocks go through the lane kernel, one channel of
+// one block per lane; the rest and the short last block are decoded one by one.
+int decode_ima_adpcm_blocks( const uint8_t* adpcm, size_t adpcm_size, size_t num_samples, int channels,
+                             size_t block_samples, int16_t* out )
+{
+  adpcm_decode_run_t run;
+  size_t frames, blocks, full_blocks, b = 0;
+
+  if( !adpcm || !out ) return -1;
+  if( channels != 1 && channels != 2 ) return -1;
+  if( ( num_samples % (size_t)channels ) != 0 ) return -1;
+  if( block_samples < 2 || ( ( block_samples - 1 ) % IMA_ADPCM_GROUP_SAMPLES ) != 0 ) return -1;
+
+  frames = num_samples / (size_t)channels;
+  blocks = ( frames + block_samples - 1 ) / block_samples;
+  full_blocks = frames / block_samples;
+  run.adpcm = adpcm;
+  run.block_samples = block_samples;
+  run.block_bytes = ima_adpcm_block_bytes( block_samples, channels );
+  run.channels = channels;
+  run.out = out;
+
+  if( adpcm_size != full_blocks * run.block_bytes
+                    + ima_adpcm_block_bytes( frames % block_samples, channels ) ) return -1;
+
+  pthread_once( &quantizer_tables_once, build_quantizer_tables );
+  pthread_once( &lane_kernel_once, select_lane_kernel );
+
+  if( decode_kernel != 0 )
+  {
+    size_t group = decode_lane_count / (unsigned) channels;
+
+    for( ; b + group <= full_blocks; b += group )
+    {
+      decode_kernel( &run, b );
+    }
+  }
+
+  for( ; b < blocks; b++ )
+  {
+    size_t first = b * block_samples;
+    size_t count = ( frames - first < block_samples ) ? frames - first : block_samples;
+
+    decode_ima_adpcm_block( adpcm + b * run.block_bytes, count, channels, out + first * (size_t)channels );
+  }
+
+  return 0;
+}
+
+// Compare decoded samples against their source, accumulating into err.
+void ima_adpcm_measure( ima_adpcm_error_t* err, const void* pcm, const int16_t* decoded,
+                        size_t num_samples, int is16bit )
+{
+  pthread_once( &lane_kernel_once, select_lane_kernel );
+  measure_kernel( err, pcm, decoded, num_samples, is16bit );
+}
+
+// Decode an encoded stream or set of blocks a slice at a time and measure it
+// against the PCM it came from.
+int ima_adpcm_verify( const void* pcm, size_t num_samples, int is16bit, int channels, size_t block_samples,
+                      const uint8_t* adpcm, size_t adpcm_size, ima_adpcm_error_t* err )
+{
+  ima_adpcm_snapshot_t state = { { 0, 0 }, { 0, 0 } };
+  size_t slice = IMA_ADPCM_VERIFY_SLICE;
+  size_t block_bytes = 0;
+  size_t done = 0;
+  int16_t* decoded;
+  int status = 0;
+
+  if( !pcm || !adpcm || !err ) return -1;
+  if( channels != 1 && channels != 2 ) return -1;
+
+  if( block_samples != 0 )
+  {
+    // Whole blocks per slice.
+    size_t block_len = block_samples * (size_t) channels;
+
+    if( block_samples < 2 || ( num_samples % (size_t) channels ) != 0 ) return -1;
+    slice = ( ( slice + block_len - 1 ) / block_len ) * block_len;
+    block_bytes = ima_adpcm_block_bytes( block_samples, channels );
+    if( adpcm_size != ( num_samples / block_len ) * block_bytes
+                      + ima_adpcm_block_bytes( ( num_samples % block_len ) / (size_t) channels, channels ) )
+      return -1;
+  }
+  else if( adpcm_size != ( num_samples + 1 ) / 2 )
+  {
+    return -1;
+  }
+
+  decoded = malloc( slice * sizeof( int16_t ) );
+  if( !decoded ) return -1;
+
+  while( done < num_samples && status == 0 )
+  {
+    size_t n = ( num_samples - done < slice ) ? num_samples - done : slice;
+    const void* src = is16bit ? (const void*)( (const int16_t*) pcm + done )
+                              : (const void*)( (const uint8_t*) pcm + done );
+
+    if( block_samples != 0 )
+    {
+      size_t first_block = done / ( block_samples * (size_t) channels );
+      size_t frames = n / (size_t) channels;
+      size_t bytes = ( frames / block_samples ) * block_bytes + ima_adpcm_block_bytes( frames % block_samples, channels );
+
+      status = decode_ima_adpcm_blocks( adpcm + first_block * block_bytes, bytes, n, channels,
+                                          block_samples, decoded );
+    }
+    else
+    {
+      // Slices are even, so each one starts on a byte.
+      decode_ima_adpcm_stream( &state, adpcm + done / 2, n, channels, decoded );
+    }
+
+    if( status == 0 )
+    {
+      ima_adpcm_measure( err, src, decoded, n, is16bit );
+    }
+    done += n;
+  }
+
+  free( decoded );
+  return status;
+}
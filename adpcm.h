@@ -4,6 +4,13 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// Block mode: per-channel header bytes, and samples per 4-byte channel group
+#define IMA_ADPCM_BLOCK_HEADER   4
+#define IMA_ADPCM_GROUP_SAMPLES  8
+#define IMA_ADPCM_MAX_THREADS    64
+// Samples ima_adpcm_verify() decodes at a time (even, so slices start on a byte)
+#define IMA_ADPCM_VERIFY_SLICE   16384
+
 /**
  * Encodes PCM audio to IMA ADPCM format.
  *
@@ -19,4 +26,244 @@
 uint8_t* encode_ima_adpcm( const void* pcm, size_t num_samples, int is16bit,
 						   int channels, size_t* out_size );
 
+/**
+ * Encoder state at a seek point: predictor and step index per channel (the
+ * second entry is unused for mono).  Decoding can start at the point's byte
+ * with this state instead of from the start of the stream.
+ */
+typedef struct
+{
+  int16_t  predictor[2];
+  uint8_t  index[2];
+} ima_adpcm_snapshot_t;
+
+/**
+ * Incremental IMA ADPCM encoder state: the per-channel predictor and step
+ * index, and a sample whose nibble is waiting for the next one to fill a byte.
+ * Feeding a stream in any number of pieces gives the same bytes as one call
+ * to encode_ima_adpcm().
+ */
+typedef struct
+{
+  int      predictor[2];
+  int      index[2];
+  int      is16bit;
+  int      channels;
+  uint8_t  pending;
+  uint8_t  has_pending;
+  uint64_t fed;
+  size_t   seek_interval;
+  ima_adpcm_snapshot_t* seek;
+} ima_adpcm_encoder_t;
+
+/**
+ * Starts an incremental encode.
+ *
+ * @param enc Encoder state to initialise
+ * @param is16bit 1 if input is int16_t, 0 if input is uint8_t
+ * @param channels Number of channels in interleaved input (1=mono, 2=stereo)
+ * @return 0 on success, -1 for an unsupported channel count
+ */
+int ima_adpcm_encoder_init( ima_adpcm_encoder_t* enc, int is16bit, int channels );
+
+/**
+ * Encodes the next samples of the stream.  A stereo frame may be split
+ * between calls.
+ *
+ * @param enc Encoder state
+ * @param pcm Pointer to PCM samples, as for encode_ima_adpcm()
+ * @param num_samples Number of samples in pcm
+ * @param out Output buffer of at least (num_samples + 1) / 2 bytes
+ * @return Number of bytes written to out
+ */
+size_t ima_adpcm_encoder_feed( ima_adpcm_encoder_t* enc, const void* pcm, size_t num_samples,
+                               uint8_t* out );
+
+/**
+ * Records the encoder state before frame 0 and every interval frames after
+ * into table, entry k resuming at byte k * interval * channels / 2.  Call
+ * after ima_adpcm_encoder_init() and before the first feed.
+ *
+ * @param enc Encoder state
+ * @param interval Frames between seek points; interval * channels must be even
+ *                 so every point starts on a byte.  0 records nothing.
+ * @param table Room for ima_adpcm_seek_count() entries of the whole stream
+ */
+void ima_adpcm_encoder_set_seek( ima_adpcm_encoder_t* enc, size_t interval, ima_adpcm_snapshot_t* table );
+
+/**
+ * Number of seek points recorded for a stream.
+ *
+ * @param num_samples Number of samples in the stream
+ * @param channels Number of channels (1=mono, 2=stereo)
+ * @param interval Frames between seek points
+ * @return Entries in the seek table, 0 when interval is 0
+ */
+size_t ima_adpcm_seek_count( size_t num_samples, int channels, size_t interval );
+
+/**
+ * Encodes PCM audio to IMA ADPCM like encode_ima_adpcm(), recording a seek
+ * point every interval frames.  The encoded bytes are the same.
+ *
+ * @param pcm Pointer to PCM samples, as for encode_ima_adpcm()
+ * @param num_samples Number of samples to encode
+ * @param is16bit 1 if input is int16_t, 0 if input is uint8_t
+ * @param channels Number of channels in interleaved input (1=mono, 2=stereo)
+ * @param interval Frames between seek points, 0 for none
+ * @param table Room for ima_adpcm_seek_count() entries
+ * @param out_size Output parameter: will be set to encoded data size in bytes
+ * @return Allocated buffer containing encoded ADPCM data, or NULL on failure
+ */
+uint8_t* encode_ima_adpcm_seek( const void* pcm, size_t num_samples, int is16bit, int channels,
+                                size_t interval, ima_adpcm_snapshot_t* table, size_t* out_size );
+
+/**
+ * Ends the stream: a trailing odd sample is written as a byte with an empty
+ * high nibble.
+ *
+ * @param enc Encoder state
+ * @param out Output buffer of at least 1 byte
+ * @return Number of bytes written to out, 0 or 1
+ */
+size_t ima_adpcm_encoder_finish( ima_adpcm_encoder_t* enc, uint8_t* out );
+
+/**
+ * Encodes PCM audio to block IMA ADPCM (WAV 0x11 / DVI layout).
+ *
+ * Each block of block_samples frames starts with a 4-byte header per channel
+ * (first sample as int16 little-endian, step index, 0), followed by the other
+ * frames as 4-byte groups of 8 samples per channel, low nibble first.  The last
+ * block is shortened to the groups it needs, padded with zero nibbles.  Blocks
+ * are independent and are encoded on up to threads threads.
+ *
+ * @param pcm Pointer to PCM samples, as for encode_ima_adpcm()
+ * @param num_samples Number of samples to encode, a multiple of channels
+ * @param is16bit 1 if input is int16_t, 0 if input is uint8_t
+ * @param channels Number of channels in interleaved input (1=mono, 2=stereo)
+ * @param block_samples Frames per block, 8 * n + 1
+ * @param threads Number of encoding threads
+ * @param out_size Output parameter: will be set to encoded data size in bytes
+ * @return Allocated buffer containing encoded ADPCM data, or NULL on failure
+ */
+uint8_t* encode_ima_adpcm_blocks( const void* pcm, size_t num_samples, int is16bit,
+                                  int channels, size_t block_samples, unsigned threads,
+                                  size_t* out_size );
+
+/**
+ * Size of one ADPCM block.
+ *
+ * @param frames Frames in the block, including the one in the header
+ * @param channels Number of channels (1=mono, 2=stereo)
+ * @return Block size in bytes
+ */
+size_t ima_adpcm_block_bytes( size_t frames, int channels );
+
+/**
+ * Selects the block encoder implementation.  Whole blocks are encoded one
+ * channel per SIMD lane (AVX2, SSE4.1 or NEON, picked at runtime); the scalar
+ * encoder stays the reference and produces the same bytes.  The same switch
+ * applies to block decoding (AVX2 only) and to ima_adpcm_measure().  Call
+ * before encoding, not while blocks are being encoded.
+ *
+ * @param enable 1 to use the widest kernel the CPU supports, 0 for scalar only
+ * @return Number of lanes block encoding now uses, 1 for scalar
+ */
+unsigned ima_adpcm_simd_lanes( int enable );
+
+/**
+ * Decodes part of an IMA ADPCM stream as written by encode_ima_adpcm(),
+ * continuing from state: zeroed for the start of the stream, or a seek
+ * point from encode_ima_adpcm_seek().  Stereo channels are decoded side by
+ * side, one from each nibble of a byte.
+ *
+ * @param state Decoder state, updated to the end of the decoded samples
+ * @param adpcm Encoded bytes, starting at the state's byte
+ * @param num_samples Samples to decode; even unless the stream ends there
+ * @param channels Number of channels (1=mono, 2=stereo)
+ * @param out Interleaved output samples
+ * @return Number of encoded bytes consumed
+ */
+size_t decode_ima_adpcm_stream( ima_adpcm_snapshot_t* state, const uint8_t* adpcm, size_t num_samples,
+                                int channels, int16_t* out );
+
+/**
+ * Decodes block IMA ADPCM as written by encode_ima_adpcm_blocks().  Whole
+ * blocks are decoded one channel per SIMD lane where the CPU has AVX2.
+ *
+ * @param adpcm Encoded blocks
+ * @param adpcm_size Size of adpcm in bytes
+ * @param num_samples Samples to decode, a multiple of channels
+ * @param channels Number of channels (1=mono, 2=stereo)
+ * @param block_samples Frames per block, 8 * n + 1
+ * @param out Interleaved output samples
+ * @return 0 on success, -1 when adpcm_size does not match the blocks
+ */
+int decode_ima_adpcm_blocks( const uint8_t* adpcm, size_t adpcm_size, size_t num_samples, int channels,
+                             size_t block_samples, int16_t* out );
+
+/**
+ * Round-trip error totals: sums of the squared source samples and of the
+ * squared errors, and the largest error, all on the 16-bit scale (8-bit
+ * input is scaled as the encoder reads it).
+ */
+typedef struct
+{
+  uint64_t samples;
+  uint64_t signal;
+  uint64_t noise;
+  uint32_t peak;
+} ima_adpcm_error_t;
+
+/**
+ * Adds the error of decoded samples against their source to err.
+ *
+ * @param err Totals to add to, zeroed before the first call
+ * @param pcm Source samples, as for encode_ima_adpcm()
+ * @param decoded Decoded samples
+ * @param num_samples Number of samples
+ * @param is16bit 1 if pcm is int16_t, 0 if uint8_t
+ */
+void ima_adpcm_measure( ima_adpcm_error_t* err, const void* pcm, const int16_t* decoded,
+                        size_t num_samples, int is16bit );
+
+/**
+ * Decodes encoded output and measures it against the source, decoding
+ * IMA_ADPCM_VERIFY_SLICE samples at a time.
+ *
+ * @param pcm Source samples, as for encode_ima_adpcm()
+ * @param num_samples Number of source samples
+ * @param is16bit 1 if pcm is int16_t, 0 if uint8_t
+ * @param channels Number of channels (1=mono, 2=stereo)
+ * @param block_samples Frames per block for block ADPCM, 0 for a stream
+ * @param adpcm Encoded data
+ * @param adpcm_size Size of adpcm in bytes
+ * @param err Totals to add to, zeroed before the first call
+ * @return 0 on success, -1 when the sizes do not match or memory runs out
+ */
+int ima_adpcm_verify( const void* pcm, size_t num_samples, int is16bit, int channels, size_t block_samples,
+                      const uint8_t* adpcm, size_t adpcm_size, ima_adpcm_error_t* err );
+
+/**
+ * Encodes PCM audio to IMA ADPCM like encode_ima_adpcm_seek(), writing the
+ * encoded bytes over the start of pcm instead of a new buffer.  The output
+ * never outgrows the input it has read, so the buffer needs no extra room.
+ * With err set, each slice is also decoded and measured before its source
+ * samples are overwritten, as ima_adpcm_verify() would.
+ *
+ * @param pcm PCM samples, as for encode_ima_adpcm(); holds the encoded bytes on return
+ * @param num_samples Number of samples to encode
+ * @param is16bit 1 if input is 16-bit PCM, 0 if input is uint8_t
+ * @param bigendian 1 if 16-bit samples are stored most significant byte first;
+ *                  each slice is converted to host order just before it is encoded
+ * @param channels Number of channels in interleaved input (1=mono, 2=stereo)
+ * @param interval Frames between seek points, 0 for none
+ * @param table Room for ima_adpcm_seek_count() entries, or NULL without seek points
+ * @param err Round-trip totals to add to, or NULL to skip the check
+ * @param out_size Output parameter: will be set to encoded data size in bytes
+ * @return 0 on success, -1 on invalid arguments or when memory runs out
+ */
+int encode_ima_adpcm_in_place( void* pcm, size_t num_samples, int is16bit, int bigendian, int channels,
+                               size_t interval, ima_adpcm_snapshot_t* table,
+                               ima_adpcm_error_t* err, size_t* out_size );
+
 #endif // ADPCM_H
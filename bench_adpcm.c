@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "adpcm.h"
+
+// Input samples per run, and runs timed per specialization
+#define BENCH_SAMPLES   ( 8u * 1024 * 1024 )
+#define BENCH_RUNS      5
+
+static double nowSeconds( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/** Time one encoder configuration and print its rate.
+ *
+ * @param name label printed with the result
+ * @param pcm input samples
+ * @param is16bit 1 for int16_t input, 0 for uint8_t
+ * @param channels 1 or 2
+ * @param block_samples frames per block, 0 for the stream encoder
+ * @retval int 0 on success, 1 if the encoder failed
+ */
+static int benchEncoder( const char* name, const void* pcm, int is16bit, int channels,
+                         size_t block_samples )
+{
+  double best = 0.0;
+
+  for( int run = 0; run < BENCH_RUNS; run++ )
+  {
+    size_t out_size = 0;
+    double start = nowSeconds();
+    uint8_t* out;
+
+    if( block_samples != 0 )
+      out = encode_ima_adpcm_blocks( pcm, BENCH_SAMPLES, is16bit, channels, block_samples, 1, &out_size );
+    else
+      out = encode_ima_adpcm( pcm, BENCH_SAMPLES, is16bit, channels, &out_size );
+
+    double elapsed = nowSeconds() - start;
+
+    if( !out )
+    {
+      fprintf( stderr, "%s: encoder failed\n", name );
+      return 1;
+    }
+    free( out );
+
+    if( best == 0.0 || elapsed < best ) best = elapsed;
+  }
+
+  printf( "  %-24s %8.1f Msamples/s\n", name, BENCH_SAMPLES / best / 1e6 );
+  return 0;
+}
+
+/** Time the decoder on one encoded configuration and print its rate.
+ *
+ * @param name label printed with the result
+ * @param pcm16 16-bit input samples, encoded once before timing
+ * @param channels 1 or 2
+ * @param block_samples frames per block, 0 for the stream decoder
+ * @retval int 0 on success, 1 if encoding or decoding failed
+ */
+static int benchDecoder( const char* name, const int16_t* pcm16, int channels, size_t block_samples )
+{
+  size_t size = 0;
+  uint8_t* adpcm;
+  int16_t* out = malloc( BENCH_SAMPLES * sizeof( int16_t ) );
+  double best = 0.0;
+  int failed = 0;
+
+  if( block_samples != 0 )
+    adpcm = encode_ima_adpcm_blocks( pcm16, BENCH_SAMPLES, 1, channels, block_samples, 1, &size );
+  else
+    adpcm = encode_ima_adpcm( pcm16, BENCH_SAMPLES, 1, channels, &size );
+
+  for( int run = 0; run < BENCH_RUNS && adpcm && out && !failed; run++ )
+  {
+    ima_adpcm_snapshot_t state = { { 0, 0 }, { 0, 0 } };
+    double start = nowSeconds();
+
+    if( block_samples != 0 )
+      failed = decode_ima_adpcm_blocks( adpcm, size, BENCH_SAMPLES, channels, block_samples, out ) != 0;
+    else
+      decode_ima_adpcm_stream( &state, adpcm, BENCH_SAMPLES, channels, out );
+
+    double elapsed = nowSeconds() - start;
+    if( best == 0.0 || elapsed < best ) best = elapsed;
+  }
+
+  if( !adpcm || !out || failed )
+  {
+    fprintf( stderr, "%s: decoder failed\n", name );
+    free( adpcm );
+    free( out );
+    return 1;
+  }
+
+  printf( "  %-24s %8.1f Msamples/s\n", name, BENCH_SAMPLES / best / 1e6 );
+  free( adpcm );
+  free( out );
+  return 0;
+}
+
+int main( void )
+{
+  int16_t* pcm16 = malloc( BENCH_SAMPLES * sizeof( int16_t ) );
+  uint8_t* pcm8 = malloc( BENCH_SAMPLES );
+  uint32_t noise = 1;
+  int failed = 0;
+
+  if( !pcm16 || !pcm8 )
+  {
+    fprintf( stderr, "Error: failed to allocate benchmark input.\n" );
+    free( pcm16 );
+    free( pcm8 );
+    return 1;
+  }
+
+  // Noisy triangle waves keep the step index moving across its whole range.
+  for( uint32_t i = 0; i < BENCH_SAMPLES; i++ )
+  {
+    int wave = (int)( i % 4096 ) * 16 - 32768;
+
+    noise = noise * 1664525u + 1013904223u;
+    pcm16[i] = (int16_t)( ( wave >> ( ( i >> 16 ) & 3 ) ) + (int)( noise >> 22 ) - 512 );
+    pcm8[i] = (uint8_t)( ( pcm16[i] >> 8 ) + 128 );
+  }
+
+  printf( "IMA ADPCM encoder, %u samples, best of %d runs, one thread\n", BENCH_SAMPLES, BENCH_RUNS );
+
+  failed |= benchEncoder( "stream 8-bit mono", pcm8, 0, 1, 0 );
+  failed |= benchEncoder( "stream 8-bit stereo", pcm8, 0, 2, 0 );
+  failed |= benchEncoder( "stream 16-bit mono", pcm16, 1, 1, 0 );
+  failed |= benchEncoder( "stream 16-bit stereo", pcm16, 1, 2, 0 );
+
+  ima_adpcm_simd_lanes( 0 );
+  failed |= benchEncoder( "block 16-bit stereo", pcm16, 1, 2, 1017 );
+  if( ima_adpcm_simd_lanes( 1 ) > 1 )
+  {
+    failed |= benchEncoder( "block 16-bit stereo SIMD", pcm16, 1, 2, 1017 );
+  }
+
+  printf( "IMA ADPCM decoder, same input\n" );
+
+  failed |= benchDecoder( "stream mono", pcm16, 1, 0 );
+  failed |= benchDecoder( "stream stereo", pcm16, 2, 0 );
+  ima_adpcm_simd_lanes( 0 );
+  failed |= benchDecoder( "block stereo", pcm16, 2, 1017 );
+  if( ima_adpcm_simd_lanes( 1 ) > 1 )
+  {
+    failed |= benchDecoder( "block stereo SIMD", pcm16, 2, 1017 );
+  }
+
+  free( pcm16 );
+  free( pcm8 );
+  return failed;
+}
@@ -0,0 +1,190 @@
+#include "pcm_ingest.h"
+#include <string.h>
+#include <pthread.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#elif defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
+
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PCM_HOST_BIG_ENDIAN 1
+#else
+#define PCM_HOST_BIG_ENDIAN 0
+#endif
+
+// Swaps whole vectors of words and returns the bytes done; the caller
+// finishes the tail with the scalar loop.
+typedef size_t ( *swap_kernel_t )( uint8_t* dst, const uint8_t* src, size_t len, size_t word_bytes );
+
+static swap_kernel_t swap_kernel = 0;
+static unsigned swap_vector_bytes = 1;
+static pthread_once_t swap_kernel_once = PTHREAD_ONCE_INIT;
+
+// Reverse each word one byte pair at a time; dst may equal src.
+static void swap_words_scalar( uint8_t* dst, const uint8_t* src, size_t len, size_t word_bytes )
+{
+  for( size_t i = 0; i + word_bytes <= len; i += word_bytes )
+  {
+    for( size_t lo = 0, hi = word_bytes - 1; lo < hi; lo++, hi-- )
+    {
+      uint8_t b = src[ i + lo ];
+
+      dst[ i + lo ] = src[ i + hi ];
+      dst[ i + hi ] = b;
+    }
+  }
+}
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+
+// Shuffle control reversing every word_bytes-byte word of a 16-byte lane.
+__attribute__(( target( "ssse3" ) ))
+static inline __m128i swap_mask( size_t word_bytes )
+{
+  uint8_t idx[16];
+
+  for( size_t i = 0; i < 16; i++ )
+  {
+    idx[i] = (uint8_t)( ( i & ~( word_bytes - 1 ) ) + ( word_bytes - 1 - ( i & ( word_bytes - 1 ) ) ) );
+  }
+  return _mm_loadu_si128( (const __m128i*) idx );
+}
+
+__attribute__(( target( "avx2" ) ))
+static size_t swap_words_avx2( uint8_t* dst, const uint8_t* src, size_t len, size_t word_bytes )
+{
+  const __m256i mask = _mm256_broadcastsi128_si256( swap_mask( word_bytes ) );
+  size_t i = 0;
+
+  for( ; i + 64 <= len; i += 64 )
+  {
+    __m256i a = _mm256_loadu_si256( (const __m256i*)( src + i ) );
+    __m256i b = _mm256_loadu_si256( (const __m256i*)( src + i + 32 ) );
+
+    _mm256_storeu_si256( (__m256i*)( dst + i ), _mm256_shuffle_epi8( a, mask ) );
+    _mm256_storeu_si256( (__m256i*)( dst + i + 32 ), _mm256_shuffle_epi8( b, mask ) );
+  }
+  for( ; i + 32 <= len; i += 32 )
+  {
+    __m256i a = _mm256_loadu_si256( (const __m256i*)( src + i ) );
+
+    _mm256_storeu_si256( (__m256i*)( dst + i ), _mm256_shuffle_epi8( a, mask ) );
+  }
+
+  return i;
+}
+
+__attribute__(( target( "ssse3" ) ))
+static size_t swap_words_ssse3( uint8_t* dst, const uint8_t* src, size_t len, size_t word_bytes )
+{
+  const __m128i mask = swap_mask( word_bytes );
+  size_t i = 0;
+
+  for( ; i + 16 <= len; i += 16 )
+  {
+    __m128i a = _mm_loadu_si128( (const __m128i*)( src + i ) );
+
+    _mm_storeu_si128( (__m128i*)( dst + i ), _mm_shuffle_epi8( a, mask ) );
+  }
+
+  return i;
+}
+
+#elif defined( __aarch64__ )
+
+static size_t swap_words_neon( uint8_t* dst, const uint8_t* src, size_t len, size_t word_bytes )
+{
+  size_t i = 0;
+
+  for( ; i + 16 <= len; i += 16 )
+  {
+    uint8x16_t a = vld1q_u8( src + i );
+
+    a = ( word_bytes == 2 ) ? vrev16q_u8( a ) : ( word_bytes == 4 ) ? vrev32q_u8( a ) : vrev64q_u8( a );
+    vst1q_u8( dst + i, a );
+  }
+
+  return i;
+}
+
+#endif
+
+// Pick the widest shuffle the running CPU supports.
+static void select_swap_kernel( void )
+{
+  swap_kernel = 0;
+  swap_vector_bytes = 1;
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) )
+  {
+    swap_kernel = swap_words_avx2;
+    swap_vector_bytes = 32;
+  }
+  else if( __builtin_cpu_supports( "ssse3" ) )
+  {
+    swap_kernel = swap_words_ssse3;
+    swap_vector_bytes = 16;
+  }
+#elif defined( __aarch64__ )
+  swap_kernel = swap_words_neon;
+  swap_vector_bytes = 16;
+#endif
+}
+
+unsigned pcm_ingest_simd( int enable )
+{
+  pthread_once( &swap_kernel_once, select_swap_kernel );
+  if( enable )
+  {
+    select_swap_kernel();
+  }
+  else
+  {
+    swap_kernel = 0;
+    swap_vector_bytes = 1;
+  }
+
+  return swap_vector_bytes;
+}
+
+void pcm_swap_words( void* dst, const void* src, size_t len, size_t word_bytes )
+{
+  uint8_t* d = dst;
+  const uint8_t* s = src;
+  size_t done = 0;
+
+  if( word_bytes != 2 && word_bytes != 4 && word_bytes != 8 )
+  {
+    if( dst != src ) memcpy( dst, src, len );
+    return;
+  }
+
+  pthread_once( &swap_kernel_once, select_swap_kernel );
+  if( swap_kernel )
+  {
+    done = swap_kernel( d, s, len, word_bytes );
+  }
+  swap_words_scalar( d + done, s + done, len - done, word_bytes );
+
+  // The scalar loop stops at the last whole word.
+  if( dst != src && len % word_bytes != 0 )
+  {
+    memcpy( d + len - len % word_bytes, s + len - len % word_bytes, len % word_bytes );
+  }
+}
+
+void pcm_ingest( void* dst, const void* src, size_t len, size_t word_bytes, int bigendian )
+{
+  if( word_bytes > 1 && ( bigendian == 1 ) != PCM_HOST_BIG_ENDIAN )
+  {
+    pcm_swap_words( dst, src, len, word_bytes );
+  }
+  else if( dst != src )
+  {
+    memcpy( dst, src, len );
+  }
+}
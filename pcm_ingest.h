@@ -0,0 +1,41 @@
+#ifndef PCM_INGEST_H
+#define PCM_INGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Copies words with their bytes reversed, a vector at a time where the CPU
+ * allows.  dst may equal src; otherwise the ranges must not overlap.  A
+ * trailing partial word is copied unchanged.
+ *
+ * @param dst Destination
+ * @param src Source words
+ * @param len Size in bytes
+ * @param word_bytes Word size: 2, 4 or 8 (1 copies the bytes unchanged)
+ */
+void pcm_swap_words( void* dst, const void* src, size_t len, size_t word_bytes );
+
+/**
+ * Converts words stored in the given byte order to host order, so 16-bit PCM
+ * can be read as int16_t (and wider words as their host types).  Swaps only
+ * when the stored order differs from the host's, and is a plain copy, or
+ * nothing when dst equals src, otherwise.
+ *
+ * @param dst Destination, may equal src
+ * @param src Stored words
+ * @param len Size in bytes
+ * @param word_bytes Word size: 1, 2, 4 or 8
+ * @param bigendian 1 if words are stored most significant byte first
+ */
+void pcm_ingest( void* dst, const void* src, size_t len, size_t word_bytes, int bigendian );
+
+/**
+ * Selects the byte shuffle kernels.
+ *
+ * @param enable 0 falls back to the scalar reference, 1 picks the widest the CPU supports
+ * @return Bytes swapped per vector step, 1 for the scalar reference
+ */
+unsigned pcm_ingest_simd( int enable );
+
+#endif // PCM_INGEST_H
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "raw2header_io.h"
+#include "raw2header_cli.h"
+#include "raw2header_convert.h"
+#include "raw2header_batch.h"
+
+/** One manifest line: its tokens, in argv form, and the outcome.
+ */
+typedef struct
+{
+  unsigned  line;
+  char*     text;
+  int       argc;
+  char*     argv[ MANIFEST_MAX_ARGS ];
+  off_t     input_size;
+  int       result;
+} manifest_entry_t;
+
+/** Work queue shared by the pool threads.
+ */
+typedef struct
+{
+  const r2h_job_t*  base;
+  manifest_entry_t* entries;
+  size_t            count;
+  size_t            next;
+  pthread_mutex_t   lock;
+} manifest_queue_t;
+
+
+/** Split a manifest line into whitespace separated tokens in place.
+ *
+ * A token may be wrapped in double quotes to hold spaces.  argv[0] is set to
+ * the program name so the result can go straight to parseArgs().
+ *
+ * @param text line to split, modified
+ * @param argv receives the tokens
+ * @retval int token count including argv[0], 1 for a blank or comment line,
+ *             -1 on too many tokens or an unterminated quote
+ */
+int splitManifestLine( char* text, char** argv )
+{
+  int argc = 1;
+  char* p = text;
+
+  argv[0] = "raw2header";
+
+  while( *p != '\0' )
+  {
+    char* token;
+
+    while( isspace( (unsigned char) *p ) )
+    {
+      p++;
+    }
+    if( *p == '\0' || ( *p == '#' && argc == 1 ) )
+    {
+      break;
+    }
+    if( argc == MANIFEST_MAX_ARGS )
+    {
+      return -1;
+    }
+
+    if( *p == '"' )
+    {
+      token = ++p;
+      p = strchr( p, '"' );
+      if( p == 0 )
+      {
+        return -1;
+      }
+    }
+    else
+    {
+      token = p;
+      while( *p != '\0' && !isspace( (unsigned char) *p ) )
+      {
+        p++;
+      }
+    }
+
+    if( *p != '\0' )
+    {
+      *p++ = '\0';
+    }
+    argv[ argc++ ] = token;
+  }
+
+  return argc;
+}
+
+
+/** Order entries largest input first so big assets do not finish last.
+ */
+static int compareEntrySize( const void* a, const void* b )
+{
+  const manifest_entry_t* ea = a;
+  const manifest_entry_t* eb = b;
+
+  if( ea->input_size != eb->input_size )
+  {
+    return ( ea->input_size > eb->input_size ) ? -1 : 1;
+  }
+
+  return ( ea->line < eb->line ) ? -1 : ( ea->line > eb->line );
+}
+
+
+/** Run one conversion given as argv, with its own conversion state.
+ *
+ * The conversion is quiet and single threaded unless it asks for threads,
+ * as its caller already keeps every CPU busy.
+ *
+ * @param base options shared by every conversion: incremental applies to all
+ * @param argc token count including argv[0]
+ * @param argv [flags] <input_file> <output_file> <varname>, after the program name
+ * @param job receives the finished conversion, for its output counts
+ * @retval int EXIT_SUCCESS, EXIT_FAILURE, or ARGUMENTS_ERROR for invalid flags or arguments
+ */
+int convertArgs( const r2h_job_t* base, int argc, char** argv, r2h_job_t* job )
+{
+  char* input_file = 0;
+  char* output_file = 0;
+  char* varname = 0;
+
+  initJob( job );
+  if( parseArgs( job, argc, argv, &input_file, &output_file, &varname, 0, 0 ) != 0 )
+  {
+    return ARGUMENTS_ERROR;
+  }
+
+  // Requests share the process's stdin and stdout with the manifest reader,
+  // the request stream and each other.
+  if( strcmp( input_file, "-" ) == 0 || strcmp( output_file, "-" ) == 0 )
+  {
+    fprintf( stderr, "Error: stdin/stdout are not available in manifest or serve requests.\n" );
+    return ARGUMENTS_ERROR;
+  }
+
+  job->quiet = 1;
+  job->incremental |= base->incremental;
+  if( job->worker_threads == 0 )
+  {
+    job->worker_threads = 1;
+  }
+
+  buildGeneratedWith( job, argc - 4, argv + 1 );
+  return convertFile( job, input_file, output_file, varname );
+}
+
+
+/** Convert one manifest entry with its own conversion state.
+ */
+static void runManifestEntry( const r2h_job_t* base, manifest_entry_t* entry )
+{
+  r2h_job_t job;
+
+  entry->result = convertArgs( base, entry->argc, entry->argv, &job );
+  if( entry->result == ARGUMENTS_ERROR )
+  {
+    fprintf( stderr, "Error: manifest line %u: invalid flags or arguments.\n", entry->line );
+    entry->result = EXIT_FAILURE;
+  }
+  else if( entry->result != EXIT_SUCCESS )
+  {
+    fprintf( stderr, "Error: manifest line %u (%s) failed.\n", entry->line, entry->argv[ entry->argc - 3 ] );
+  }
+}
+
+
+/** Pool thread body: take entries off the queue until it is empty.
+ */
+static void* manifestWorker( void* arg )
+{
+  manifest_queue_t* queue = arg;
+
+  for( ;; )
+  {
+    manifest_entry_t* entry = 0;
+
+    pthread_mutex_lock( &queue->lock );
+    if( queue->next < queue->count )
+    {
+      entry = &queue->entries[ queue->next++ ];
+    }
+    pthread_mutex_unlock( &queue->lock );
+
+    if( entry == 0 )
+    {
+      return 0;
+    }
+    runManifestEntry( queue->base, entry );
+  }
+}
+
+
+/** Read a manifest into entries, skipping blank and comment lines.
+ *
+ * @param manifest_path file to read
+ * @param queue receives the entries
+ * @retval int 0 on success, -1 on error (already reported)
+ */
+static int loadManifest( const char* manifest_path, manifest_queue_t* queue )
+{
+  FILE* fp;
+  char* line = 0;
+  size_t line_cap = 0;
+  size_t cap = 0;
+  unsigned line_no = 0;
+
+  fp = fopen( manifest_path, "r" );
+  if( fp == 0 )
+  {
+    printSystemError( "open manifest", manifest_path );
+    return -1;
+  }
+
+  while( getline( &line, &line_cap, fp ) >= 0 )
+  {
+    manifest_entry_t* entry;
+    struct stat st;
+
+    line_no++;
+    if( queue->count == cap )
+    {
+      size_t new_cap = ( cap == 0 ) ? 64 : cap * 2;
+      manifest_entry_t* grown = realloc( queue->entries, new_cap * sizeof( *grown ) );
+
+      if( grown == 0 )
+      {
+        fprintf( stderr, "Error: failed to allocate manifest entries.\n" );
+        break;
+      }
+      queue->entries = grown;
+      cap = new_cap;
+    }
+
+    entry = &queue->entries[ queue->count ];
+    memset( entry, 0, sizeof( *entry ) );
+    entry->line = line_no;
+    entry->text = strdup( line );
+    if( entry->text == 0 )
+    {
+      fprintf( stderr, "Error: failed to allocate manifest entries.\n" );
+      break;
+    }
+
+    entry->argc = splitManifestLine( entry->text, entry->argv );
+    if( entry->argc == 1 )
+    {
+      free( entry->text );
+      continue;
+    }
+    if( entry->argc < 0 )
+    {
+      fprintf( stderr, "Error: manifest line %u: too many tokens or unterminated quote.\n", line_no );
+      free( entry->text );
+      break;
+    }
+
+    if( entry->argc >= 4 && stat( entry->argv[ entry->argc - 3 ], &st ) == 0 )
+    {
+      entry->input_size = st.st_size;
+    }
+    queue->count++;
+  }
+
+  free( line );
+  if( ferror( fp ) != 0 || !feof( fp ) )
+  {
+    if( ferror( fp ) != 0 )
+    {
+      printSystemError( "read manifest", manifest_path );
+    }
+    fclose( fp );
+    return -1;
+  }
+
+  fclose( fp );
+  return 0;
+}
+
+
+/** Convert every asset listed in a manifest on a pool of threads.
+ *
+ * Each line holds the usual [flags] <input_file> <output_file> <varname>
+ * and runs as an independent, quiet conversion.  Lines are scheduled largest
+ * input first.
+ *
+ * @param base command line options: worker_threads sizes the pool (0 for one
+ *             per online CPU) and incremental applies to every line
+ * @param manifest_path manifest file
+ * @retval int EXIT_SUCCESS if every conversion succeeded, EXIT_FAILURE otherwise
+ */
+int runManifest( const r2h_job_t* base, const char* manifest_path )
+{
+  unsigned threads = base->worker_threads;
+  manifest_queue_t queue;
+  pthread_t* workers;
+  unsigned started = 0;
+  size_t failed = 0;
+  int state;
+
+  memset( &queue, 0, sizeof( queue ) );
+  queue.base = base;
+  state = loadManifest( manifest_path, &queue );
+  if( state == 0 )
+  {
+    qsort( queue.entries, queue.count, sizeof( *queue.entries ), compareEntrySize );
+
+    if( threads == 0 )
+    {
+      long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+      threads = ( cpus > 0 ) ? (unsigned) cpus : 1;
+    }
+    if( threads > queue.count )
+    {
+      threads = ( queue.count == 0 ) ? 1 : (unsigned) queue.count;
+    }
+
+    pthread_mutex_init( &queue.lock, 0 );
+    workers = calloc( threads, sizeof( *workers ) );
+    if( workers != 0 )
+    {
+      for( started = 0; started < threads; started++ )
+      {
+        if( pthread_create( &workers[ started ], 0, manifestWorker, &queue ) != 0 )
+        {
+          break;
+        }
+      }
+    }
+
+    // Without any pool thread the caller works the queue itself.
+    if( started == 0 )
+    {
+      manifestWorker( &queue );
+    }
+    for( unsigned t = 0; t < started; t++ )
+    {
+      pthread_join( workers[t], 0 );
+    }
+    free( workers );
+    pthread_mutex_destroy( &queue.lock );
+
+    for( size_t e = 0; e < queue.count; e++ )
+    {
+      failed += ( queue.entries[e].result != EXIT_SUCCESS );
+    }
+    printf( "Converted %zu of %zu assets from %s\n", queue.count - failed, queue.count, manifest_path );
+  }
+
+  for( size_t e = 0; e < queue.count; e++ )
+  {
+    free( queue.entries[e].text );
+  }
+  free( queue.entries );
+
+  return ( state == 0 && failed == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,13 @@
+#ifndef RAW2HEADER_BATCH_H
+#define RAW2HEADER_BATCH_H
+
+#include "raw2header_io.h"
+
+// Most tokens accepted on one manifest line, including the program name slot.
+#define MANIFEST_MAX_ARGS   32
+
+int splitManifestLine( char* text, char** argv );
+int convertArgs( const r2h_job_t* base, int argc, char** argv, r2h_job_t* job );
+int runManifest( const r2h_job_t* base, const char* manifest_path );
+
+#endif
@@ -4,9 +4,18 @@
 #include <stdint.h>
 #include "raw2header_io.h"
 #include "raw2header_cli.h"
+#include "raw2header_elf.h"
+#include "adpcm.h"
 
-static int parseCombinedShortFlags( const char* arg );
-static int parsePadFlag( const char* arg );
+static int parseCombinedShortFlags( r2h_job_t* job, const char* arg );
+static int parsePadFlag( r2h_job_t* job, const char* arg );
+static int parseMaxMemoryFlag( r2h_job_t* job, const char* arg );
+static int parseThreadsFlag( r2h_job_t* job, const char* arg );
+static int parseAdpcmBlockFlag( r2h_job_t* job, const char* arg );
+static int parseAdpcmSeekFlag( r2h_job_t* job, const char* arg );
+static int parseVerifyFlag( r2h_job_t* job, const char* arg );
+static int parseObjectFlag( r2h_job_t* job, const char* arg );
+static int setWordMode( r2h_job_t* job, uint8_t wordmode, uint8_t bigendian );
 
 
 /**
@@ -14,30 +23,62 @@ static int parsePadFlag( const char* arg );
   */
 void printUsage( void )
 {
-  printf( "\nraw2header file convertion utility V3.02.0\n\n" );
+  printf( "\nraw2header file convertion utility " RAW2HEADER_VERSION "\n\n" );
   printf( "Written in 2024, by Jennifer Gunn.\n\n" );
   printf( "Takes the input file and converts it to a header file.\n\n" );
-  printf( "Usage: raw2header [--mono|-m|--stereo|-s] [-16/-b16] [--adpcm|-a|-a16|-ab16] [--source-pair|--split-c|-c] <input_file> <output_file> <varname>\n" );
+  printf( "Usage: raw2header [--mono|-m|--stereo|-s] [-16/-b16/-32/-b32/-64/-b64] [--adpcm|-a|-a16|-ab16] [--source-pair|--split-c|-c|--incbin] <input_file> <output_file> <varname>\n" );
   printf( "If <output_file> has no extension, .h is appended automatically.\n" );
+  printf( "Use - for <input_file> to read stdin, or for <output_file> to write the header to stdout.\n" );
   printf( "where -b16 generate a big-endian uint16_t and -16 generates a\n" );
-  printf( "little endian uint16_t array.\n\n" );
+  printf( "little endian uint16_t array.  -32/-b32 and -64/-b64 pack the bytes into\n" );
+  printf( "uint32_t and uint64_t words the same way.\n\n" );
   printf( "--adpcm/-a encodes the input as IMA ADPCM and stores it as a uint8_t array.\n" );
   printf( "With --adpcm, -16/-b16 select 16-bit PCM input endianness.\n" );
-  printf( "-a16/--adpcm16 and -ab16/--adpcm16be are one-step ADPCM + 16-bit PCM input flags.\n\n" );
+  printf( "-a16/--adpcm16 and -ab16/--adpcm16be are one-step ADPCM + 16-bit PCM input flags.\n" );
+  printf( "--adpcm-block=N encodes independent blocks of N frames (8 * n + 1, e.g. 505 or 1017),\n" );
+  printf( "each starting with a predictor and step index header, on --threads=N threads.\n" );
+  printf( "--adpcm-seek=N adds a <varname>_seek table with the decoder state every N frames\n" );
+  printf( "(even), so playback can start mid-stream; the ADPCM bytes are unchanged.\n" );
+  printf( "--adpcm-decoder also writes ima_adpcm_decode.h next to <output_file>: a target-side\n" );
+  printf( "decoder for streams, blocks and seek tables with its tables in flash.\n" );
+  printf( "--verify[=DB] decodes the ADPCM again and reports its SNR and peak error against the\n" );
+  printf( "input; with DB, the conversion fails when the SNR is below DB decibels.\n\n" );
   printf( "--source-pair/--split-c/-c writes externs to <output_file> and data to a paired .c file.\n\n" );
-  printf( "--pad=NN or --pad=0xNN appends one byte for odd sized files.\n\n" );
+  printf( "--incbin writes externs to <output_file> and a .S that pulls the data in with .incbin,\n" );
+  printf( "from the input itself or from a .bin sidecar for ADPCM, padded or -b16 data (ELF targets).\n\n" );
+  printf( "--embed writes the payload to a .bin next to <output_file> and defines the array with\n" );
+  printf( "C23 #embed where __has_embed finds it, keeping the hex list as fallback (uint8_t only).\n\n" );
+  printf( "--string defines the array as string literals instead of a hex list, about half the\n" );
+  printf( "size and much faster to compile (uint8_t only, C not C++).\n\n" );
+  printf( "--emit-object[=TARGET] writes externs to <output_file> and the data to an ELF .o\n" );
+  printf( "with <varname> and <varname>_size symbols; TARGET is x86_64, i386, aarch64, arm, armhf,\n" );
+  printf( "riscv32 or riscv64 (default: host).  --section=NAME (default .rodata) and\n" );
+  printf( "--elf-flags=N override the data section and the object's e_flags.\n\n" );
+  printf( "--pad=NN or --pad=0xNN pads the file up to a whole number of words.\n\n" );
+  printf( "--max-memory=SIZE[K|M|G] streams the input in chunks so peak memory stays\n" );
+  printf( "within SIZE bytes, for inputs larger than RAM (ADPCM is encoded on the fly;\n" );
+  printf( "not available with --adpcm-block).\n\n" );
+  printf( "--threads=N formats large arrays with N threads (default: one per CPU).\n\n" );
+  printf( "--manifest <file> converts every asset listed in <file> in one process, one per\n" );
+  printf( "line as [flags] <input_file> <output_file> <varname>, on --threads=N workers.\n\n" );
+  printf( "--serve takes the same lines as length-prefixed requests on stdin and answers on\n" );
+  printf( "stdout, or on a Unix socket with --serve=PATH; see the README for the framing.\n\n" );
+  printf( "--incremental skips the conversion when the input, options and version match\n" );
+  printf( "the <output_file>.stamp of the last run, and only replaces outputs whose text changed.\n\n" );
   printf( "--mono/-m or --stereo/-s emits a mode define in the output header.\n\n" );
-  printf( "uint16_t arrays require an even sized file unless padding is enabled.\n\n" );
+  printf( "Word arrays require a file size that is a multiple of the word size unless\n" );
+  printf( "padding is enabled.\n\n" );
   printf( "For ADPCM with 8-bit PCM input, omit -16/-b16.\n\n" );
 }
 
 
 /**
   * Parses combined short flags like -ms for mono and stereo.
+  * @param job Conversion the flags apply to.
   * @param arg The command-line argument string starting with a single dash followed by multiple characters.
   * @retval int status code: 0 on success, 1 for help, -1 on invalid flag
   */
-static int parseCombinedShortFlags( const char* arg )
+static int parseCombinedShortFlags( r2h_job_t* job, const char* arg )
 {
   const char* shortflags = arg + 1;
 
@@ -46,26 +87,26 @@ static int parseCombinedShortFlags( const char* arg )
     switch( *shortflags )
     {
       case 'm':
-        if( channelmode == MODE_STEREO )
+        if( job->channelmode == MODE_STEREO )
         {
           fprintf( stderr, "Error: conflicting flags -m (mono) and -s (stereo).\n" );
           return -1;
         }
-        channelmode = MODE_MONO;
+        job->channelmode = MODE_MONO;
         break;
       case 's':
-        if( channelmode == MODE_MONO )
+        if( job->channelmode == MODE_MONO )
         {
           fprintf( stderr, "Error: conflicting flags -m (mono) and -s (stereo).\n" );
           return -1;
         }
-        channelmode = MODE_STEREO;
+        job->channelmode = MODE_STEREO;
         break;
       case 'a':
-        adpcm_enabled = 1;
+        job->adpcm_enabled = 1;
         break;
       case 'c':
-        sourcepair_enabled = 1;
+        job->sourcepair_enabled = 1;
         break;
       case 'h':
         return 1;
@@ -81,10 +122,11 @@ static int parseCombinedShortFlags( const char* arg )
 
 /**
   * Parses the --pad=NN flag to enable padding for odd byte counts in uint16_t modes.
+  * @param job Conversion the flag applies to.
   * @param arg The command-line argument string starting with "--pad=".
   * @retval int status code: 0 on success, -1 on invalid format or value
   */
-static int parsePadFlag( const char* arg )
+static int parsePadFlag( r2h_job_t* job, const char* arg )
 {
   const char* pad_text = arg + 6;
   char* endptr = 0;
@@ -101,22 +143,266 @@ static int parsePadFlag( const char* arg )
     return -1;
   }
 
-  pad_enabled = 1;
-  pad_value = (uint8_t) pad;
+  job->pad_enabled = 1;
+  job->pad_value = (uint8_t) pad;
   return 0;
 }
 
 
 /**
- * Parses command-line arguments and sets configuration variables.
+  * Parses the --max-memory=SIZE flag that enables bounded-memory streaming.
+  * @param job Conversion the flag applies to.
+  * @param arg The command-line argument string starting with "--max-memory=".
+  * @retval int status code: 0 on success, -1 on invalid format or value
+  */
+static int parseMaxMemoryFlag( r2h_job_t* job, const char* arg )
+{
+  const char* size_text = arg + 13;
+  char* endptr = 0;
+  unsigned long long size = 0;
+  unsigned shift = 0;
+
+  if( size_text[0] < '0' || size_text[0] > '9' )
+  {
+    return -1;
+  }
+
+  size = strtoull( size_text, &endptr, 10 );
+  switch( *endptr )
+  {
+    case 'k': case 'K': shift = 10; endptr++; break;
+    case 'm': case 'M': shift = 20; endptr++; break;
+    case 'g': case 'G': shift = 30; endptr++; break;
+    default: break;
+  }
+
+  if( endptr == size_text || *endptr != '\0' || size == 0 || size > ( SIZE_MAX >> shift ) )
+  {
+    return -1;
+  }
+
+  job->max_memory = (size_t)( size << shift );
+  return 0;
+}
+
+
+/**
+  * Parses the --threads=N flag that sets the number of formatting threads.
+  * @param job Conversion the flag applies to.
+  * @param arg The command-line argument string starting with "--threads=".
+  * @retval int status code: 0 on success, -1 on invalid format or value
+  */
+static int parseThreadsFlag( r2h_job_t* job, const char* arg )
+{
+  const char* count_text = arg + 10;
+  char* endptr = 0;
+  unsigned long count = 0;
+
+  if( count_text[0] < '0' || count_text[0] > '9' )
+  {
+    return -1;
+  }
+
+  count = strtoul( count_text, &endptr, 10 );
+  if( *endptr != '\0' || count == 0 || count > 1024 )
+  {
+    return -1;
+  }
+
+  job->worker_threads = (unsigned) count;
+  return 0;
+}
+
+
+/**
+  * Parses the --adpcm-block=N flag that selects block ADPCM with N frames per block.
+  * @param job Conversion the flag applies to.
+  * @param arg The command-line argument string starting with "--adpcm-block=".
+  * @retval int status code: 0 on success, -1 on invalid format or value
+  */
+static int parseAdpcmBlockFlag( r2h_job_t* job, const char* arg )
+{
+  const char* count_text = arg + 14;
+  char* endptr = 0;
+  unsigned long count = 0;
+
+  if( count_text[0] < '0' || count_text[0] > '9' )
+  {
+    return -1;
+  }
+
+  count = strtoul( count_text, &endptr, 10 );
+  if( *endptr != '\0' || count < IMA_ADPCM_GROUP_SAMPLES + 1 || count > ADPCM_BLOCK_MAX
+      || ( ( count - 1 ) % IMA_ADPCM_GROUP_SAMPLES ) != 0 )
+  {
+    return -1;
+  }
+
+  job->adpcm_block = (uint32_t) count;
+  return 0;
+}
+
+
+/**
+  * Parses the --adpcm-seek=N flag that records an ADPCM seek point every N frames.
+  * @param job Conversion the flag applies to.
+  * @param arg The command-line argument string starting with "--adpcm-seek=".
+  * @retval int status code: 0 on success, -1 on invalid format or value
+  */
+static int parseAdpcmSeekFlag( r2h_job_t* job, const char* arg )
+{
+  const char* count_text = arg + 13;
+  char* endptr = 0;
+  unsigned long count = 0;
+
+  if( count_text[0] < '0' || count_text[0] > '9' )
+  {
+    return -1;
+  }
+
+  count = strtoul( count_text, &endptr, 10 );
+  if( *endptr != '\0' || count < ADPCM_SEEK_MIN || count > UINT32_MAX || ( count % 2 ) != 0 )
+  {
+    return -1;
+  }
+
+  job->adpcm_seek = (uint32_t) count;
+  return 0;
+}
+
+
+/**
+  * Parses the --verify and --verify=DB flags that check the ADPCM round trip.
+  * @param job Conversion the flag applies to.
+  * @param arg The command-line argument string starting with "--verify".
+  * @retval int status code: 0 on success, -1 on invalid format or value
+  */
+static int parseVerifyFlag( r2h_job_t* job, const char* arg )
+{
+  const char* db_text = arg + 8;
+  char* endptr = 0;
+  double db = 0.0;
+
+  if( *db_text != '\0' )
+  {
+    if( *db_text != '=' || db_text[1] < '0' || db_text[1] > '9' )
+    {
+      return -1;
+    }
+
+    db = strtod( db_text + 1, &endptr );
+    if( *endptr != '\0' || db > 200.0 )
+    {
+      return -1;
+    }
+  }
+
+  job->verify_enabled = 1;
+  job->verify_min_snr = db;
+  return 0;
+}
+
+
+/**
+  * Parses the object output flags --emit-object[=TARGET], --section=NAME and --elf-flags=N.
+  * @param job Conversion the flag applies to.
+  * @param arg The command-line argument string.
+  * @retval int status code: 0 on success, -1 on invalid format or value, 2 if not an object flag
+  */
+static int parseObjectFlag( r2h_job_t* job, const char* arg )
+{
+  char* endptr = 0;
+  unsigned long flags;
+
+  if( strcmp( arg, "--emit-object" ) == 0 )
+  {
+    job->object_enabled = 1;
+    job->elf_target = 0;
+    return 0;
+  }
+
+  if( strncmp( arg, "--emit-object=", 14 ) == 0 )
+  {
+    if( findElfTarget( arg + 14 ) == 0 )
+    {
+      fprintf( stderr, "Error: unknown object target '%s' (x86_64, i386, aarch64, arm, armhf, riscv32, riscv64).\n", arg + 14 );
+      return -1;
+    }
+    job->object_enabled = 1;
+    job->elf_target = arg + 14;
+    return 0;
+  }
+
+  if( strncmp( arg, "--section=", 10 ) == 0 )
+  {
+    if( arg[10] == '\0' )
+    {
+      fprintf( stderr, "Error: empty --section name.\n" );
+      return -1;
+    }
+    job->object_section = arg + 10;
+    return 0;
+  }
+
+  if( strncmp( arg, "--elf-flags=", 12 ) == 0 )
+  {
+    flags = strtoul( arg + 12, &endptr, 0 );
+    if( arg[12] == '\0' || *endptr != '\0' || flags > UINT32_MAX )
+    {
+      fprintf( stderr, "Error: invalid --elf-flags value '%s'.\n", arg + 12 );
+      return -1;
+    }
+    job->elf_flags = (uint32_t) flags;
+    job->elf_flags_set = 1;
+    return 0;
+  }
+
+  return 2;
+}
+
+
+/**
+  * Selects the word size and endianness of a -16/-b16/-32/-b32/-64/-b64 flag.
+  * @param job Conversion the flag applies to.
+  * @param wordmode WORD_16, WORD_32 or WORD_64.
+  * @param bigendian 1 for the -bNN form.
+  * @retval int status code: 0 on success, -1 when an earlier word flag conflicts
+  */
+static int setWordMode( r2h_job_t* job, uint8_t wordmode, uint8_t bigendian )
+{
+  if( job->wordmode != WORD_8 && job->wordmode != wordmode )
+  {
+    fprintf( stderr, "Error: conflicting word size flags -%u and -%u.\n",
+             8u << job->wordmode, 8u << wordmode );
+    return -1;
+  }
+  if( job->wordmode != WORD_8 && job->bigendian != bigendian )
+  {
+    fprintf( stderr, "Error: conflicting flags -%u and -b%u.\n", 8u << wordmode, 8u << wordmode );
+    return -1;
+  }
+
+  job->wordmode = wordmode;
+  job->bigendian = bigendian;
+  return 0;
+}
+
+
+/**
+ * Parses command-line arguments into the options of a conversion.
+ * @param job Conversion to configure; options not given are reset to defaults.
  * @param argc Argument count from main.
  * @param argv Argument vector from main.
- * @param input Output pointer for input filename.
+ * @param input Output pointer for input filename, or null to accept switches only.
  * @param output Output pointer for output filename.
  * @param varname Output pointer for variable name in the header.
+ * @param manifest Output pointer for the --manifest path, or null where a manifest is not allowed.
+ * @param serve Output pointer for the --serve socket path, "-" for stdin/stdout, or null where
+ *              serving is not allowed.
  * @retval int status code: 0 on success, 1 for help, -1 for invalid flag, -2 for missing positional args.
  */
-int parseArgs( int argc, char** argv, char** input, char** output, char** varname )
+int parseArgs( r2h_job_t* job, int argc, char** argv, char** input, char** output, char** varname,
+               char** manifest, char** serve )
 {
   int i = 1;
   size_t option = 0;
@@ -125,13 +411,22 @@ int parseArgs( int argc, char** argv, char** input, char** output, char** varnam
   {
     OPT_WORD_LE,
     OPT_WORD_BE,
+    OPT_WORD32_LE,
+    OPT_WORD32_BE,
+    OPT_WORD64_LE,
+    OPT_WORD64_BE,
     OPT_HELP,
     OPT_MONO,
     OPT_STEREO,
     OPT_ADPCM,
     OPT_ADPCM16_LE,
     OPT_ADPCM16_BE,
-    OPT_SOURCE_PAIR
+    OPT_SOURCE_PAIR,
+    OPT_INCREMENTAL,
+    OPT_INCBIN,
+    OPT_EMBED,
+    OPT_STRING,
+    OPT_ADPCM_DECODER
   } option_action_t;
 
   typedef struct
@@ -143,6 +438,10 @@ int parseArgs( int argc, char** argv, char** input, char** output, char** varnam
   const option_map_t options[] = {
     { "-16",      OPT_WORD_LE },
     { "-b16",     OPT_WORD_BE },
+    { "-32",      OPT_WORD32_LE },
+    { "-b32",     OPT_WORD32_BE },
+    { "-64",      OPT_WORD64_LE },
+    { "-b64",     OPT_WORD64_BE },
     { "-h",       OPT_HELP },
     { "--help",   OPT_HELP },
     { "--mono",   OPT_MONO },
@@ -157,24 +456,55 @@ int parseArgs( int argc, char** argv, char** input, char** output, char** varnam
     { "-ab16",       OPT_ADPCM16_BE },
     { "--source-pair", OPT_SOURCE_PAIR },
     { "--split-c",     OPT_SOURCE_PAIR },
-    { "-c",            OPT_SOURCE_PAIR }
+    { "-c",            OPT_SOURCE_PAIR },
+    { "--incremental", OPT_INCREMENTAL },
+    { "--incbin",      OPT_INCBIN },
+    { "--embed",       OPT_EMBED },
+    { "--string",      OPT_STRING },
+    { "--adpcm-decoder", OPT_ADPCM_DECODER }
   };
 
   const size_t options_count = sizeof( options ) / sizeof( options[0] );
 
-  wordmode = 0;
-  bigendian = 0;
-  channelmode = MODE_NONE;
-  pad_enabled = 0;
-  pad_value = 0;
-  adpcm_enabled = 0;
-  sourcepair_enabled = 0;
+  job->wordmode = WORD_8;
+  job->bigendian = 0;
+  job->channelmode = MODE_NONE;
+  job->pad_enabled = 0;
+  job->pad_value = 0;
+  job->adpcm_enabled = 0;
+  job->adpcm_block = 0;
+  job->adpcm_seek = 0;
+  job->adpcm_decoder = 0;
+  job->verify_enabled = 0;
+  job->verify_min_snr = 0.0;
+  job->sourcepair_enabled = 0;
+  job->incbin_enabled = 0;
+  job->embed_enabled = 0;
+  job->string_enabled = 0;
+  job->object_enabled = 0;
+  job->elf_flags_set = 0;
+  job->elf_flags = 0;
+  job->elf_target = 0;
+  job->object_section = 0;
+  job->max_memory = 0;
+  job->worker_threads = 0;
+  job->incremental = 0;
 
-  while( i < argc && argv[i][0] == '-' )
+  if( manifest != 0 )
+  {
+    *manifest = 0;
+  }
+  if( serve != 0 )
+  {
+    *serve = 0;
+  }
+
+  // A lone "-" is stdin or stdout, the first positional argument.
+  while( i < argc && argv[i][0] == '-' && argv[i][1] != '\0' )
   {
     if( strncmp( argv[i], "--pad=", 6 ) == 0 )
     {
-      int pad_state = parsePadFlag( argv[i] );
+      int pad_state = parsePadFlag( job, argv[i] );
       if( pad_state != 0 )
       {
         return pad_state;
@@ -183,11 +513,99 @@ int parseArgs( int argc, char** argv, char** input, char** output, char** varnam
       continue;
     }
 
+    if( strncmp( argv[i], "--max-memory=", 13 ) == 0 )
+    {
+      if( parseMaxMemoryFlag( job, argv[i] ) != 0 )
+      {
+        fprintf( stderr, "Error: invalid --max-memory size '%s'.\n", argv[i] + 13 );
+        return -1;
+      }
+      i++;
+      continue;
+    }
+
+    if( strncmp( argv[i], "--threads=", 10 ) == 0 )
+    {
+      if( parseThreadsFlag( job, argv[i] ) != 0 )
+      {
+        fprintf( stderr, "Error: invalid --threads count '%s'.\n", argv[i] + 10 );
+        return -1;
+      }
+      i++;
+      continue;
+    }
+
+    if( strncmp( argv[i], "--adpcm-block=", 14 ) == 0 )
+    {
+      if( parseAdpcmBlockFlag( job, argv[i] ) != 0 )
+      {
+        fprintf( stderr, "Error: invalid --adpcm-block size '%s' (8 * n + 1 frames, at most %u).\n",
+                 argv[i] + 14, ADPCM_BLOCK_MAX );
+        return -1;
+      }
+      i++;
+      continue;
+    }
+
+    if( strncmp( argv[i], "--adpcm-seek=", 13 ) == 0 )
+    {
+      if( parseAdpcmSeekFlag( job, argv[i] ) != 0 )
+      {
+        fprintf( stderr, "Error: invalid --adpcm-seek interval '%s' (an even number of frames, at least %u).\n",
+                 argv[i] + 13, ADPCM_SEEK_MIN );
+        return -1;
+      }
+      i++;
+      continue;
+    }
+
+    if( strncmp( argv[i], "--verify", 8 ) == 0 )
+    {
+      if( parseVerifyFlag( job, argv[i] ) != 0 )
+      {
+        fprintf( stderr, "Error: invalid --verify threshold '%s' (an SNR in dB, e.g. --verify=30).\n", argv[i] );
+        return -1;
+      }
+      i++;
+      continue;
+    }
+
+    if( strncmp( argv[i], "--emit-object", 13 ) == 0 || strncmp( argv[i], "--section=", 10 ) == 0
+        || strncmp( argv[i], "--elf-flags=", 12 ) == 0 )
+    {
+      if( parseObjectFlag( job, argv[i] ) != 0 )
+      {
+        return -1;
+      }
+      i++;
+      continue;
+    }
+
+    if( manifest != 0 && strcmp( argv[i], "--manifest" ) == 0 )
+    {
+      if( i + 1 >= argc )
+      {
+        return -2;
+      }
+      *manifest = argv[i + 1];
+      i += 2;
+      continue;
+    }
+
+    if( serve != 0 && ( strcmp( argv[i], "--serve" ) == 0 || strncmp( argv[i], "--serve=", 8 ) == 0 ) )
+    {
+      *serve = ( argv[i][7] == '=' && argv[i][8] != '\0' ) ? argv[i] + 8 : "-";
+      i++;
+      continue;
+    }
+
     if( strcmp( argv[i], "-16" ) != 0 && strcmp( argv[i], "-b16" ) != 0
+      && strcmp( argv[i], "-32" ) != 0 && strcmp( argv[i], "-b32" ) != 0
+      && strcmp( argv[i], "-64" ) != 0 && strcmp( argv[i], "-b64" ) != 0
       && strcmp( argv[i], "-a16" ) != 0 && strcmp( argv[i], "-ab16" ) != 0
       && strncmp( argv[i], "--", 2 ) != 0 && strlen( argv[i] ) > 2 )
     {
-      int short_state = parseCombinedShortFlags( argv[i] );
+      int short_state = parseCombinedShortFlags( job, argv[i] );
       if( short_state != 0 )
       {
         return short_state;
@@ -207,56 +625,89 @@ int parseArgs( int argc, char** argv, char** input, char** output, char** varnam
         switch( options[ option ].action )
         {
           case OPT_WORD_LE:
-            if( wordmode && bigendian )
+            if( setWordMode( job, WORD_16, 0 ) != 0 )
             {
-              fprintf( stderr, "Error: conflicting flags -16 and -b16.\n" );
               return -1;
             }
-            wordmode = 1;
-            bigendian = 0;
             break;
           case OPT_WORD_BE:
-            if( wordmode && !bigendian )
+            if( setWordMode( job, WORD_16, 1 ) != 0 )
+            {
+              return -1;
+            }
+            break;
+          case OPT_WORD32_LE:
+            if( setWordMode( job, WORD_32, 0 ) != 0 )
+            {
+              return -1;
+            }
+            break;
+          case OPT_WORD32_BE:
+            if( setWordMode( job, WORD_32, 1 ) != 0 )
+            {
+              return -1;
+            }
+            break;
+          case OPT_WORD64_LE:
+            if( setWordMode( job, WORD_64, 0 ) != 0 )
+            {
+              return -1;
+            }
+            break;
+          case OPT_WORD64_BE:
+            if( setWordMode( job, WORD_64, 1 ) != 0 )
             {
-              fprintf( stderr, "Error: conflicting flags -16 and -b16.\n" );
               return -1;
             }
-            wordmode = 1;
-            bigendian = 1;
             break;
           case OPT_HELP:
             return 1;
           case OPT_MONO:
-            if( channelmode == MODE_STEREO )
+            if( job->channelmode == MODE_STEREO )
             {
               fprintf( stderr, "Error: conflicting flags --mono and --stereo.\n" );
               return -1;
             }
-            channelmode = MODE_MONO;
+            job->channelmode = MODE_MONO;
             break;
           case OPT_STEREO:
-            if( channelmode == MODE_MONO )
+            if( job->channelmode == MODE_MONO )
             {
               fprintf( stderr, "Error: conflicting flags --mono and --stereo.\n" );
               return -1;
             }
-            channelmode = MODE_STEREO;
+            job->channelmode = MODE_STEREO;
             break;
           case OPT_ADPCM:
-            adpcm_enabled = 1;
+            job->adpcm_enabled = 1;
             break;
           case OPT_ADPCM16_LE:
-            adpcm_enabled = 1;
-            wordmode = 1;
-            bigendian = 0;
+            job->adpcm_enabled = 1;
+            job->wordmode = WORD_16;
+            job->bigendian = 0;
             break;
           case OPT_ADPCM16_BE:
-            adpcm_enabled = 1;
-            wordmode = 1;
-            bigendian = 1;
+            job->adpcm_enabled = 1;
+            job->wordmode = WORD_16;
+            job->bigendian = 1;
             break;
           case OPT_SOURCE_PAIR:
-            sourcepair_enabled = 1;
+            job->sourcepair_enabled = 1;
+            break;
+          case OPT_INCBIN:
+            job->incbin_enabled = 1;
+            break;
+          case OPT_EMBED:
+            job->embed_enabled = 1;
+            break;
+          case OPT_STRING:
+            job->string_enabled = 1;
+            break;
+          case OPT_ADPCM_DECODER:
+            job->adpcm_decoder = 1;
+            break;
+          case OPT_INCREMENTAL:
+            job->incremental = 1;
             break;
         }
         break;
@@ -270,6 +721,18 @@ int parseArgs( int argc, char** argv, char** input, char** output, char** varnam
     i++;
   }
 
+  if( ( manifest != 0 && *manifest != 0 ) || ( serve != 0 && *serve != 0 ) )
+  {
+    // Conversions come from the manifest lines or requests, not the command line.
+    return ( argc == i ) ? 0 : -2;
+  }
+
+  if( input == 0 )
+  {
+    // Switches only, for a conversion whose input and output are given elsewhere.
+    return ( argc == i ) ? 0 : -2;
+  }
+
   if( ( argc - i ) != 3 )
   {
     return -2;
@@ -1,7 +1,10 @@
 #ifndef RAW2HEADER_CLI_H
 #define RAW2HEADER_CLI_H
 
+#include "raw2header_io.h"
+
 void printUsage( void );
-int parseArgs( int argc, char** argv, char** input, char** output, char** varname );
+int parseArgs( r2h_job_t* job, int argc, char** argv, char** input, char** output, char** varname,
+               char** manifest, char** serve );
 
 #endif
@@ -0,0 +1,622 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "adpcm.h"
+#include "pcm_ingest.h"
+#include "raw2header_io.h"
+#include "raw2header_cli.h"
+#include "raw2header_convert.h"
+#include "raw2header_stamp.h"
+
+static int normalizeOutputHeaderPath( const char* input_path, char* output_path, size_t output_path_sz )
+{
+  const char* slash = strrchr( input_path, '/' );
+  const char* dot = strrchr( input_path, '.' );
+  int has_extension = ( dot != 0 && ( slash == 0 || dot > slash ) );
+  size_t in_len = strlen( input_path );
+
+  if( has_extension )
+  {
+    if( in_len + 1 > output_path_sz )
+    {
+      return -1;
+    }
+
+    memcpy( output_path, input_path, in_len + 1 );
+    return 0;
+  }
+
+  if( in_len + 3 > output_path_sz )
+  {
+    return -1;
+  }
+
+  memcpy( output_path, input_path, in_len );
+  output_path[ in_len ] = '\0';
+  strcat( output_path, ".h" );
+
+  return 0;
+}
+
+
+/** Check whether the outputs a stamp vouches for are all still present.
+ *
+ * @param job configured conversion
+ * @param input_file path of the raw input
+ * @param header_path normalized output header path
+ * @retval int 1 when every output exists
+ */
+static int outputsPresent( const r2h_job_t* job, const char* input_file, const char* header_path )
+{
+  char path[512];
+  struct stat st;
+
+  if( access( header_path, F_OK ) != 0 )
+  {
+    return 0;
+  }
+  if( job->sourcepair_enabled )
+  {
+    if( buildSourcePath( header_path, path, sizeof( path ) ) != 0 || access( path, F_OK ) != 0 )
+    {
+      return 0;
+    }
+  }
+  if( job->embed_enabled )
+  {
+    if( buildSidecarPath( header_path, path, sizeof( path ) ) != 0 || access( path, F_OK ) != 0 )
+    {
+      return 0;
+    }
+  }
+  if( job->object_enabled )
+  {
+    if( buildObjectPath( header_path, path, sizeof( path ) ) != 0 || access( path, F_OK ) != 0 )
+    {
+      return 0;
+    }
+  }
+  if( job->adpcm_decoder )
+  {
+    if( buildDecoderPath( header_path, path, sizeof( path ) ) != 0 || access( path, F_OK ) != 0 )
+    {
+      return 0;
+    }
+  }
+  if( job->incbin_enabled )
+  {
+    if( buildIncbinPath( header_path, path, sizeof( path ) ) != 0 || access( path, F_OK ) != 0 )
+    {
+      return 0;
+    }
+
+    // Same test as the writer: the data only differs from the input when transformed.
+    if( job->adpcm_enabled || ( job->wordmode && job->bigendian )
+        || ( job->wordmode && job->pad_enabled && stat( input_file, &st ) == 0
+             && ( st.st_size % ( 1 << job->wordmode ) ) != 0 ) )
+    {
+      if( buildSidecarPath( header_path, path, sizeof( path ) ) != 0 || access( path, F_OK ) != 0 )
+      {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+
+/** Print the --verify result of a conversion and check it against the threshold.
+ *
+ * Always printed, also for quiet manifest lines, since it is the point of the
+ * option.  Silence gives no SNR, so a lossless round trip reports "exact".
+ *
+ * @param job conversion that was verified
+ * @param output_file normalized output header path
+ * @param err round-trip totals
+ * @retval int 0 when the SNR meets job->verify_min_snr, -1 otherwise
+ */
+static int reportVerify( const r2h_job_t* job, const char* output_file, const ima_adpcm_error_t* err )
+{
+  // Output that is not a named file may be going to stdout itself.
+  FILE* out = ( job->out_target == OUT_PATH ) ? stdout : stderr;
+  double snr = INFINITY;
+
+  if( err->noise != 0 )
+  {
+    snr = ( err->signal != 0 ) ? 10.0 * log10( (double) err->signal / (double) err->noise ) : -INFINITY;
+  }
+
+  if( err->noise == 0 )
+  {
+    fprintf( out, "Verify %s: exact, %llu samples\n", output_file, (unsigned long long) err->samples );
+  }
+  else
+  {
+    fprintf( out, "Verify %s: SNR %.2f dB, peak error %u of 32768, %llu samples\n", output_file,
+             snr, (unsigned) err->peak, (unsigned long long) err->samples );
+  }
+
+  if( job->verify_min_snr > 0.0 && snr < job->verify_min_snr )
+  {
+    fprintf( stderr, "Error: %s: ADPCM SNR %.2f dB is below --verify=%g.\n", output_file, snr,
+             job->verify_min_snr );
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/** Record the switches of a conversion for the generated header comment.
+ *
+ * @param job conversion to describe
+ * @param count number of switches
+ * @param flags the switches, without the program name or positional arguments
+ */
+void buildGeneratedWith( r2h_job_t* job, int count, char** flags )
+{
+  job->generated_with[0] = '\0';
+  for( int i = 0; i < count; i++ )
+  {
+    strncat( job->generated_with, flags[i], sizeof( job->generated_with ) - strlen( job->generated_with ) - 1 );
+    strncat( job->generated_with, " ", sizeof( job->generated_with ) - strlen( job->generated_with ) - 1 );
+  }
+  {
+    size_t len = strlen( job->generated_with );
+    if( len > 0 ) job->generated_with[ len - 1 ] = '\0';
+  }
+}
+
+
+/** Check a configured conversion for options that cannot be combined.
+ *
+ * @param job configured conversion, see parseArgs()
+ * @retval int 0 when the options are usable, -1 after reporting the problem
+ */
+int checkJobOptions( const r2h_job_t* job )
+{
+  if( job->pad_enabled && !job->wordmode )
+  {
+    // Padding only applies to word output.
+    fprintf( stderr, "Error: --pad requires -16, -b16, -32, -b32, -64 or -b64.\n" );
+    if( !job->quiet && job->out_target == OUT_PATH ) printUsage();
+    return -1;
+  }
+
+  if( ( job->incbin_enabled || job->object_enabled )
+      && job->incbin_enabled + job->object_enabled + job->sourcepair_enabled + job->embed_enabled > 1 )
+  {
+    fprintf( stderr, "Error: --incbin, --emit-object and --source-pair/--embed are mutually exclusive.\n" );
+    return -1;
+  }
+
+  if( job->string_enabled && ( ( job->wordmode && !job->adpcm_enabled ) || job->embed_enabled
+                               || job->incbin_enabled || job->object_enabled ) )
+  {
+    // A string literal initialises a byte array only.
+    fprintf( stderr, "Error: --string needs uint8_t output (8-bit or ADPCM) and a C array.\n" );
+    return -1;
+  }
+
+  if( job->embed_enabled && job->wordmode && !job->adpcm_enabled )
+  {
+    // #embed yields bytes, so it only fits uint8_t arrays.
+    fprintf( stderr, "Error: --embed needs uint8_t output (8-bit or ADPCM).\n" );
+    return -1;
+  }
+
+  if( job->adpcm_enabled && job->wordmode > WORD_16 )
+  {
+    fprintf( stderr, "Error: ADPCM input is 8-bit or 16-bit PCM, -32/-64 do not apply.\n" );
+    return -1;
+  }
+
+  if( job->adpcm_block != 0 && !job->adpcm_enabled )
+  {
+    fprintf( stderr, "Error: --adpcm-block needs --adpcm.\n" );
+    return -1;
+  }
+
+  if( job->adpcm_seek != 0 && ( !job->adpcm_enabled || job->adpcm_block != 0 ) )
+  {
+    fprintf( stderr, "Error: --adpcm-seek needs --adpcm without --adpcm-block (blocks are seek points already).\n" );
+    return -1;
+  }
+
+  if( job->verify_enabled && !job->adpcm_enabled )
+  {
+    fprintf( stderr, "Error: --verify needs --adpcm.\n" );
+    return -1;
+  }
+
+  if( job->adpcm_decoder && !job->adpcm_enabled )
+  {
+    fprintf( stderr, "Error: --adpcm-decoder needs --adpcm.\n" );
+    return -1;
+  }
+
+  if( job->adpcm_seek != 0 && ( job->incbin_enabled || job->object_enabled ) )
+  {
+    fprintf( stderr, "Error: --adpcm-seek writes a C table, it cannot be used with --incbin or --emit-object.\n" );
+    return -1;
+  }
+
+  if( job->max_memory != 0 && job->adpcm_block != 0 )
+  {
+    fprintf( stderr, "Error: --max-memory does not support --adpcm-block.\n" );
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/** Refuse options that write more than the one output the target can take.
+ *
+ * @param job configured conversion
+ * @param target what the output goes to, for the message, e.g. "stdout"
+ * @retval int 0 when usable, -1 after reporting the problem
+ */
+int checkSingleOutput( const r2h_job_t* job, const char* target )
+{
+  if( job->sourcepair_enabled || job->incbin_enabled || job->embed_enabled || job->object_enabled
+      || job->adpcm_decoder )
+  {
+    fprintf( stderr, "Error: --source-pair, --incbin, --embed, --emit-object and --adpcm-decoder write "
+                     "several files, which cannot all go to %s.\n", target );
+    return -1;
+  }
+
+  if( job->incremental )
+  {
+    fprintf( stderr, "Error: --incremental needs named input and output files, not %s.\n", target );
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/** Release everything a conversion loaded: payload, input stream and seek table.
+ */
+static void dropPayload( r2h_job_t* job )
+{
+  free( job->adpcm_seek_table );
+  job->adpcm_seek_table = 0;
+  releaseRaw( job );
+  closeRawStream( job );
+}
+
+
+/** Pad or encode the loaded payload into what the writers emit.
+ *
+ * @param job conversion with its payload loaded or its input stream open
+ * @param output_file output name for the --verify report
+ * @param verify_error round-trip totals for --verify
+ * @retval int 0 on success, -1 after reporting the problem
+ */
+static int preparePayload( r2h_job_t* job, const char* output_file, ima_adpcm_error_t* verify_error )
+{
+  int streaming = ( job->stream_fd >= 0 );
+  const off_t word_bytes = (off_t) 1 << job->wordmode;
+  int state = 0;
+
+  if( job->adpcm_enabled )
+  {
+    size_t frame_bytes = 1;
+
+    if( job->channelmode == MODE_STEREO )
+    {
+      frame_bytes = ( job->wordmode == 1 ) ? 4 : 2;
+    }
+    else if( job->wordmode == 1 )
+    {
+      frame_bytes = 2;
+    }
+
+    if( ( job->table_size % (off_t)frame_bytes ) != 0 )
+    {
+      fprintf( stderr, "Error: ADPCM input size must align to %zu-byte %s frame size.\n",
+               frame_bytes, ( job->channelmode == MODE_STEREO ) ? "stereo" : "mono" );
+      return -1;
+    }
+  }
+  else if( job->wordmode && ( job->table_size % word_bytes ) != 0 )
+  {
+    // Pad to a whole number of words.
+    size_t pad_bytes = (size_t)( word_bytes - job->table_size % word_bytes );
+
+    if( job->pad_enabled && streaming )
+    {
+      // The stream appends the pad bytes after the last chunk.
+      job->table_size += (off_t) pad_bytes;
+    }
+    else if( job->pad_enabled )
+    {
+      if( makeRawWritable( job, pad_bytes ) != 0 )
+      {
+        fprintf( stderr, "Error: failed to allocate padding bytes.\n" );
+        return -1;
+      }
+
+      memset( job->rawdata_p + job->table_size, job->pad_value, pad_bytes );
+      job->table_size += (off_t) pad_bytes;
+    }
+    else
+    {
+      if( job->wordmode == WORD_16 )
+      {
+        fprintf( stderr, "\nError: uint16_t modes require an even sized file or --pad=NN\n\n" );
+      }
+      else
+      {
+        fprintf( stderr, "\nError: uint%u_t modes require a file size that is a multiple of %u or --pad=NN\n\n",
+                 8u << job->wordmode, 1u << job->wordmode );
+      }
+      if( !job->quiet && job->out_target == OUT_PATH ) printUsage();
+      return -1;
+    }
+  } 
+
+
+
+  // Streamed ADPCM is encoded while the output is written; only its size is needed here.
+  if( job->adpcm_enabled && streaming )
+  {
+    size_t num_samples = (size_t)( job->table_size / ( ( job->wordmode == WORD_16 ) ? 2 : 1 ) );
+
+    job->adpcm_frames = num_samples / ( ( job->channelmode == MODE_STEREO ) ? 2 : 1 );
+    job->table_size = (off_t)( ( num_samples + 1 ) / 2 );
+
+    // The seek table goes in the text around the array, so it is needed first.
+    // The round trip is checked in the same pass, before any output is written.
+    if( job->adpcm_seek != 0 || job->verify_enabled )
+    {
+      if( job->adpcm_seek != 0 )
+      {
+        job->adpcm_seek_count = ima_adpcm_seek_count( num_samples, ( job->channelmode == MODE_STEREO ) ? 2 : 1,
+                                                      job->adpcm_seek );
+        job->adpcm_seek_table = calloc( job->adpcm_seek_count, sizeof( ima_adpcm_snapshot_t ) );
+      }
+      job->adpcm_error = job->verify_enabled ? verify_error : 0;
+      state = ( job->adpcm_seek != 0 && job->adpcm_seek_table == 0 ) ? NO_MALLOC : scanAdpcmStream( job );
+      job->adpcm_error = 0;
+      if( state != 0 )
+      {
+        fprintf( stderr, "Error: failed to %s the streamed ADPCM.\n", job->adpcm_seek ? "index" : "verify" );
+        return -1;
+      }
+      if( job->verify_enabled && reportVerify( job, output_file, verify_error ) != 0 )
+      {
+        return -1;
+      }
+    }
+  }
+  // If ADPCM is enabled, encode and replace job->rawdata_p
+  else if (job->adpcm_enabled) {
+    size_t adpcm_size = 0;
+    int is16bit = 0;
+    size_t num_samples = job->table_size;
+    if (job->table_size % 2 == 0 && job->wordmode == 1) {
+      // -16/-b16 indicates 16-bit PCM input for ADPCM mode.
+      is16bit = 1;
+      num_samples = job->table_size / 2;
+    }
+
+    int channels = ( job->channelmode == MODE_STEREO ) ? 2 : 1;
+    int verify_failed = 0;
+    uint8_t* adpcm_data = 0;
+
+    if( job->adpcm_seek != 0 )
+    {
+      job->adpcm_seek_count = ima_adpcm_seek_count( num_samples, channels, job->adpcm_seek );
+      job->adpcm_seek_table = calloc( job->adpcm_seek_count, sizeof( ima_adpcm_snapshot_t ) );
+    }
+
+    // Blocks can outgrow their input and are encoded out of order, so they get
+    // their own buffer; a stream is encoded over the samples it comes from.
+    if( job->adpcm_block != 0 )
+    {
+      // Block lanes read samples out of order, so they go to host order in one pass first.
+      if( is16bit )
+      {
+        pcm_ingest( job->rawdata_p, job->rawdata_p, (size_t) job->table_size, 2, job->bigendian );
+      }
+      adpcm_data = encode_ima_adpcm_blocks( job->rawdata_p, num_samples, is16bit, channels,
+                                            job->adpcm_block, resolveWorkerThreads( job ), &adpcm_size );
+      state = ( adpcm_data == 0 ) ? -1 : 0;
+    }
+    else
+    {
+      state = ( job->adpcm_seek != 0 && job->adpcm_seek_table == 0 ) ? -1
+            : encode_ima_adpcm_in_place( job->rawdata_p, num_samples, is16bit, job->bigendian, channels,
+                                         job->adpcm_seek, job->adpcm_seek_table,
+                                         job->verify_enabled ? verify_error : 0, &adpcm_size );
+    }
+    if( state != 0 )
+    {
+      fprintf(stderr, "Error: failed to encode IMA ADPCM.\n");
+      return -1;
+    }
+    if( job->verify_enabled && adpcm_data
+        && ima_adpcm_verify( job->rawdata_p, num_samples, is16bit, channels, job->adpcm_block,
+                             adpcm_data, adpcm_size, verify_error ) != 0 )
+    {
+      fprintf( stderr, "Error: failed to verify the ADPCM output.\n" );
+      verify_failed = 1;
+    }
+    else if( job->verify_enabled && reportVerify( job, output_file, verify_error ) != 0 )
+    {
+      verify_failed = 1;
+    }
+    if( verify_failed )
+    {
+      free( adpcm_data );
+      return -1;
+    }
+    if( adpcm_data )
+    {
+      releaseRaw( job );
+      job->rawdata_p = (int8_t*)adpcm_data;
+    }
+    job->table_size = adpcm_size;
+    job->adpcm_frames = num_samples / (size_t) channels;
+  }
+
+  return 0;
+}
+
+
+/** Convert a loaded payload: transform it, write the outputs and drop it.
+ *
+ * The payload comes from getRaw(), getRawFd(), loadRaw() or openRawStream(),
+ * and is released whatever the outcome.
+ *
+ * @param job configured conversion that passed checkJobOptions()
+ * @param output_file normalized header path, or the name of job->out_target
+ * @param varname array name
+ * @retval int EXIT_SUCCESS or EXIT_FAILURE
+ */
+int convertPayload( r2h_job_t* job, const char* output_file, const char* varname )
+{
+  ima_adpcm_error_t verify_error = { 0, 0, 0, 0 };
+  int state;
+
+  if( preparePayload( job, output_file, &verify_error ) != 0 )
+  {
+    dropPayload( job );
+    return EXIT_FAILURE;
+  }
+
+  // Write the output file.
+  if (job->adpcm_enabled)
+    state = writeFile( job, output_file, varname ); // Output as uint8_t array
+  else if( job->wordmode == WORD_8 )
+    state = writeFile( job, output_file, varname );
+  else if( job->wordmode == WORD_16 )
+    state = writeFile16( job, output_file, varname );
+  else if( job->wordmode == WORD_32 )
+    state = writeFile32( job, output_file, varname );
+  else
+    state = writeFile64( job, output_file, varname );
+
+  if( state == WRITE_SUCCESS && job->adpcm_decoder )
+  {
+    state = writeAdpcmDecoder( job, output_file );
+  }
+
+  dropPayload( job );
+
+  if( state == ERROR_NOT_OPEN )
+  {
+    fprintf( stderr, "Error: could not write output file.\n" );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
+/** Run one conversion: load the input, apply the transforms and write the output.
+ *
+ * @param job configured conversion, see parseArgs()
+ * @param input_file path of the raw input, "-" for stdin
+ * @param output_file header path, .h is appended when it has no extension; "-" for stdout
+ * @param varname array name
+ * @retval int EXIT_SUCCESS or EXIT_FAILURE
+ */
+int convertFile( r2h_job_t* job, const char* input_file, const char* output_file, const char* varname )
+{
+  char normalized_output_file[1024] = {0};
+  char stamp_file[1100] = {0};
+  uint64_t stamp = 0;
+  int state = 0;
+
+  if( strcmp( output_file, "-" ) == 0 )
+  {
+    // A pipeline stage: the header goes to stdout, and messages to stderr.
+    job->out_target = OUT_FD;
+    job->out_fd = STDOUT_FILENO;
+    strcpy( normalized_output_file, "stdout" );
+    if( checkSingleOutput( job, "stdout" ) != 0 )
+    {
+      return EXIT_FAILURE;
+    }
+  }
+  else if( normalizeOutputHeaderPath( output_file, normalized_output_file, sizeof( normalized_output_file ) ) != 0 )
+  {
+    fprintf( stderr, "Error: output filename is too long.\n" );
+    return EXIT_FAILURE;
+  }
+
+  if( strcmp( input_file, "-" ) == 0 && job->incremental )
+  {
+    fprintf( stderr, "Error: --incremental needs a named input file, not stdin.\n" );
+    return EXIT_FAILURE;
+  }
+
+  if( checkJobOptions( job ) != 0 )
+  {
+    return EXIT_FAILURE;
+  }
+
+  if( job->incremental )
+  {
+    snprintf( stamp_file, sizeof( stamp_file ), "%s%s", normalized_output_file, STAMP_SUFFIX );
+    if( computeStamp( job, input_file, normalized_output_file, varname, &stamp ) != 0 )
+    {
+      fprintf( stderr, "Error: could not read input file.\n" );
+      return EXIT_FAILURE;
+    }
+    if( stampMatches( stamp_file, stamp ) && outputsPresent( job, input_file, normalized_output_file ) )
+    {
+      printProgress( job, "Up to date: %s\n", normalized_output_file );
+      return EXIT_SUCCESS;
+    }
+  }
+
+  printProgress( job, "Processing\n" );
+  
+  if( job->max_memory != 0 )
+  {
+    state = openRawStream( job, input_file, job->max_memory );
+  }
+  else
+  {
+    state = getRaw( job, input_file );
+  }
+  switch( state )
+  {
+    case ERROR_NOT_OPEN:
+      fprintf( stderr, "Error: could not read input file.\n" );
+      return EXIT_FAILURE;
+    case EMPTY_FILE:
+      fprintf( stderr, "Error: empty file, nothing to do.\n" );
+      return EXIT_FAILURE;
+    case READ_SUCCESS:
+      break;
+    default:
+      fprintf( stderr, "Error: failed to load input file.\n" );
+      return EXIT_FAILURE;
+  }
+
+  if( convertPayload( job, normalized_output_file, varname ) != EXIT_SUCCESS )
+  {
+    return EXIT_FAILURE;
+  }
+
+  if( job->incremental && writeStamp( stamp_file, stamp ) != 0 )
+  {
+    return EXIT_FAILURE;
+  }
+
+  printProgress( job, "Header file completed successfully\n" );
+
+  return EXIT_SUCCESS;
+}
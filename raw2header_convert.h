@@ -0,0 +1,12 @@
+#ifndef RAW2HEADER_CONVERT_H
+#define RAW2HEADER_CONVERT_H
+
+#include "raw2header_io.h"
+
+void buildGeneratedWith( r2h_job_t* job, int count, char** flags );
+int checkJobOptions( const r2h_job_t* job );
+int checkSingleOutput( const r2h_job_t* job, const char* target );
+int convertPayload( r2h_job_t* job, const char* output_file, const char* varname );
+int convertFile( r2h_job_t* job, const char* input_file, const char* output_file, const char* varname );
+
+#endif
@@ -0,0 +1,233 @@
+#include <stddef.h>
+#include "raw2header_decoder.h"
+
+// Text of ima_adpcm_decode.h.  It must follow the encoder in adpcm.c: nibble
+// order, stereo interleaving and block layout.  test_adpcm_decoder builds
+// the copy the tool writes and round-trips it against the encoder.
+static const char decoder_text[] =
+  "/* IMA ADPCM decoder for raw2header --adpcm output.\n"
+  " *\n"
+  " * Streams (--adpcm) hold two samples per byte, low nibble first.  Mono byte k\n"
+  " * holds samples 2k and 2k + 1; stereo byte k holds frame k, left channel in\n"
+  " * the low nibble.  An odd mono stream ends with an unused high nibble.\n"
+  " * Decoding starts from a zeroed state, or from a <varname>_seek entry\n"
+  " * (--adpcm-seek) at byte k * NAME_SEEK_INTERVAL * channels / 2.\n"
+  " *\n"
+  " * Blocks (--adpcm-block) start with a 4-byte header per channel (first\n"
+  " * sample as int16 LE, step index, 0), followed by groups of 4 bytes per\n"
+  " * channel holding 8 samples each, low nibble first.\n"
+  " *\n"
+  " * The tables are const, so they stay in flash.  Targets that need an\n"
+  " * attribute and an accessor for that (AVR PROGMEM) define IMA_ADPCM_FLASH,\n"
+  " * IMA_ADPCM_STEP(i) and IMA_ADPCM_INDEX(n) before including this file.\n"
+  " */\n"
+  "#ifndef IMA_ADPCM_DECODE_H\n"
+  "#define IMA_ADPCM_DECODE_H\n"
+  "\n"
+  "#include <stdint.h>\n"
+  "#include <stddef.h>\n"
+  "\n"
+  "#ifndef IMA_ADPCM_FLASH\n"
+  "#define IMA_ADPCM_FLASH\n"
+  "#endif\n"
+  "#ifndef IMA_ADPCM_STEP\n"
+  "#define IMA_ADPCM_STEP( i )   ( ima_adpcm_step_table[ ( i ) ] )\n"
+  "#endif\n"
+  "#ifndef IMA_ADPCM_INDEX\n"
+  "#define IMA_ADPCM_INDEX( n )  ( ima_adpcm_index_table[ ( n ) ] )\n"
+  "#endif\n"
+  "\n"
+  "static const int16_t ima_adpcm_step_table[89] IMA_ADPCM_FLASH =\n"
+  "{\n"
+  "  7, 8, 9, 10, 11, 12, 13, 14, 16, 17,\n"
+  "  19, 21, 23, 25, 28, 31, 34, 37, 41, 45,\n"
+  "  50, 55, 60, 66, 73, 80, 88, 97, 107, 118,\n"
+  "  130, 143, 157, 173, 190, 209, 230, 253, 279, 307,\n"
+  "  337, 371, 408, 449, 494, 544, 598, 658, 724, 796,\n"
+  "  876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,\n"
+  "  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,\n"
+  "  5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,\n"
+  "  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767\n"
+  "};\n"
+  "\n"
+  "static const int8_t ima_adpcm_index_table[16] IMA_ADPCM_FLASH =\n"
+  "{\n"
+  "  -1, -1, -1, -1, 2, 4, 6, 8,\n"
+  "  -1, -1, -1, -1, 2, 4, 6, 8\n"
+  "};\n"
+  "\n"
+  "/* Decoder state: predictor and step index per channel. */\n"
+  "typedef struct\n"
+  "{\n"
+  "  int predictor[2];\n"
+  "  int index[2];\n"
+  "} ima_adpcm_decoder_t;\n"
+  "\n"
+  "/* Decode one nibble, updating the channel state, and return the sample. */\n"
+  "static inline int16_t ima_adpcm_decode_nibble( unsigned nibble, int* predictor, int* index )\n"
+  "{\n"
+  "  int step = IMA_ADPCM_STEP( *index );\n"
+  "  int diff = step >> 3;\n"
+  "  int sample = *predictor;\n"
+  "  int next = *index + IMA_ADPCM_INDEX( nibble );\n"
+  "\n"
+  "  if( nibble & 4 ) diff += step;\n"
+  "  if( nibble & 2 ) diff += step >> 1;\n"
+  "  if( nibble & 1 ) diff += step >> 2;\n"
+  "  sample = ( nibble & 8 ) ? sample - diff : sample + diff;\n"
+  "\n"
+  "  if( sample > 32767 ) sample = 32767;\n"
+  "  else if( sample < -32768 ) sample = -32768;\n"
+  "  if( next < 0 ) next = 0;\n"
+  "  else if( next > 88 ) next = 88;\n"
+  "\n"
+  "  *predictor = sample;\n"
+  "  *index = next;\n"
+  "  return (int16_t) sample;\n"
+  "}\n"
+  "\n"
+  "/* Reset the state to the start of a stream. */\n"
+  "static inline void ima_adpcm_decode_init( ima_adpcm_decoder_t* dec )\n"
+  "{\n"
+  "  dec->predictor[0] = dec->predictor[1] = 0;\n"
+  "  dec->index[0] = dec->index[1] = 0;\n"
+  "}\n"
+  "\n"
+  "/* Load the state from a seek table entry, e.g. name_seek[k]. */\n"
+  "static inline void ima_adpcm_decode_seek( ima_adpcm_decoder_t* dec, const int16_t entry[][2], int channels )\n"
+  "{\n"
+  "  for( int ch = 0; ch < channels; ch++ )\n"
+  "  {\n"
+  "    dec->predictor[ch] = entry[ch][0];\n"
+  "    dec->index[ch] = entry[ch][1];\n"
+  "  }\n"
+  "}\n"
+  "\n"
+  "/* Decode samples of a mono stream into dst and return the next input byte.\n"
+  " * Keep samples even except at the end of the stream: the state cannot stop\n"
+  " * halfway through a byte. */\n"
+  "static inline const uint8_t* ima_adpcm_decode_mono( ima_adpcm_decoder_t* dec, const uint8_t* src,\n"
+  "                                                    int16_t* dst, size_t samples )\n"
+  "{\n"
+  "  int predictor = dec->predictor[0];\n"
+  "  int index = dec->index[0];\n"
+  "  unsigned byte;\n"
+  "\n"
+  "  for( ; samples >= 4; samples -= 4, src += 2, dst += 4 )\n"
+  "  {\n"
+  "    byte = src[0];\n"
+  "    dst[0] = ima_adpcm_decode_nibble( byte & 0x0F, &predictor, &index );\n"
+  "    dst[1] = ima_adpcm_decode_nibble( byte >> 4, &predictor, &index );\n"
+  "    byte = src[1];\n"
+  "    dst[2] = ima_adpcm_decode_nibble( byte & 0x0F, &predictor, &index );\n"
+  "    dst[3] = ima_adpcm_decode_nibble( byte >> 4, &predictor, &index );\n"
+  "  }\n"
+  "  for( ; samples >= 2; samples -= 2, src++, dst += 2 )\n"
+  "  {\n"
+  "    byte = *src;\n"
+  "    dst[0] = ima_adpcm_decode_nibble( byte & 0x0F, &predictor, &index );\n"
+  "    dst[1] = ima_adpcm_decode_nibble( byte >> 4, &predictor, &index );\n"
+  "  }\n"
+  "  if( samples != 0 )\n"
+  "  {\n"
+  "    dst[0] = ima_adpcm_decode_nibble( *src++ & 0x0F, &predictor, &index );\n"
+  "  }\n"
+  "\n"
+  "  dec->predictor[0] = predictor;\n"
+  "  dec->index[0] = index;\n"
+  "  return src;\n"
+  "}\n"
+  "\n"
+  "/* Decode frames of a stereo stream into interleaved dst (left, right) and\n"
+  " * return the next input byte. */\n"
+  "static inline const uint8_t* ima_adpcm_decode_stereo( ima_adpcm_decoder_t* dec, const uint8_t* src,\n"
+  "                                                      int16_t* dst, size_t frames )\n"
+  "{\n"
+  "  int left = dec->predictor[0];\n"
+  "  int left_index = dec->index[0];\n"
+  "  int right = dec->predictor[1];\n"
+  "  int right_index = dec->index[1];\n"
+  "  unsigned byte;\n"
+  "\n"
+  "  for( ; frames >= 2; frames -= 2, src += 2, dst += 4 )\n"
+  "  {\n"
+  "    byte = src[0];\n"
+  "    dst[0] = ima_adpcm_decode_nibble( byte & 0x0F, &left, &left_index );\n"
+  "    dst[1] = ima_adpcm_decode_nibble( byte >> 4, &right, &right_index );\n"
+  "    byte = src[1];\n"
+  "    dst[2] = ima_adpcm_decode_nibble( byte & 0x0F, &left, &left_index );\n"
+  "    dst[3] = ima_adpcm_decode_nibble( byte >> 4, &right, &right_index );\n"
+  "  }\n"
+  "  if( frames != 0 )\n"
+  "  {\n"
+  "    byte = *src++;\n"
+  "    dst[0] = ima_adpcm_decode_nibble( byte & 0x0F, &left, &left_index );\n"
+  "    dst[1] = ima_adpcm_decode_nibble( byte >> 4, &right, &right_index );\n"
+  "  }\n"
+  "\n"
+  "  dec->predictor[0] = left;\n"
+  "  dec->index[0] = left_index;\n"
+  "  dec->predictor[1] = right;\n"
+  "  dec->index[1] = right_index;\n"
+  "  return src;\n"
+  "}\n"
+  "\n"
+  "/* Decode one block of frames (NAME_ADPCM_BLOCK_SAMPLES, or fewer for the\n"
+  " * last block) into interleaved dst and return the next block. */\n"
+  "static inline const uint8_t* ima_adpcm_decode_block( const uint8_t* block, int16_t* dst, size_t frames,\n"
+  "                                                     int channels )\n"
+  "{\n"
+  "  const uint8_t* group = block + 4 * channels;\n"
+  "  size_t left = ( frames != 0 ) ? frames - 1 : 0;\n"
+  "\n"
+  "  if( frames == 0 )\n"
+  "  {\n"
+  "    return block;\n"
+  "  }\n"
+  "\n"
+  "  for( int ch = 0; ch < channels; ch++ )\n"
+  "  {\n"
+  "    const uint8_t* header = block + 4 * ch;\n"
+  "    int predictor = (int16_t)( header[0] | ( header[1] << 8 ) );\n"
+  "    int index = header[2] > 88 ? 88 : header[2];\n"
+  "    const uint8_t* src = group + 4 * ch;\n"
+  "    int16_t* out = dst + ch;\n"
+  "    size_t todo = left;\n"
+  "\n"
+  "    *out = (int16_t) predictor;\n"
+  "    out += channels;\n"
+  "\n"
+  "    for( ; todo >= 8; todo -= 8, src += 4 * channels )\n"
+  "    {\n"
+  "      for( int k = 0; k < 4; k++ )\n"
+  "      {\n"
+  "        unsigned byte = src[k];\n"
+  "        out[0] = ima_adpcm_decode_nibble( byte & 0x0F, &predictor, &index );\n"
+  "        out[channels] = ima_adpcm_decode_nibble( byte >> 4, &predictor, &index );\n"
+  "        out += 2 * channels;\n"
+  "      }\n"
+  "    }\n"
+  "    for( size_t k = 0; k < todo; k++ )\n"
+  "    {\n"
+  "      unsigned nibble = ( k & 1 ) ? ( src[k >> 1] >> 4 ) : ( src[k >> 1] & 0x0F );\n"
+  "      *out = ima_adpcm_decode_nibble( nibble, &predictor, &index );\n"
+  "      out += channels;\n"
+  "    }\n"
+  "  }\n"
+  "\n"
+  "  return group + 4 * channels * ( ( left + 7 ) / 8 );\n"
+  "}\n"
+  "\n"
+  "#endif\n";
+
+
+/** Text of the target-side decoder header written by --adpcm-decoder.
+ *
+ * @param len receives the length of the text
+ * @retval const char* the header text
+ */
+const char* adpcmDecoderText( size_t* len )
+{
+  *len = sizeof( decoder_text ) - 1;
+  return decoder_text;
+}
@@ -0,0 +1,11 @@
+#ifndef RAW2HEADER_DECODER_H
+#define RAW2HEADER_DECODER_H
+
+#include <stddef.h>
+
+// File name of the decoder header, written next to the output header.
+#define DECODER_HEADER_NAME "ima_adpcm_decode.h"
+
+const char* adpcmDecoderText( size_t* len );
+
+#endif
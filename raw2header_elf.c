@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "raw2header_io.h"
+#include "raw2header_elf.h"
+
+// ELF constants used by the writer
+#define EM_386              3
+#define EM_ARM              40
+#define EM_X86_64           62
+#define EM_AARCH64          183
+#define EM_RISCV            243
+
+#define EF_ARM_EABI_VER5    0x05000000
+#define EF_ARM_FLOAT_SOFT   0x00000200
+#define EF_ARM_FLOAT_HARD   0x00000400
+#define EF_RISCV_FLOAT_SINGLE 0x0002
+#define EF_RISCV_FLOAT_DOUBLE 0x0004
+
+#define ET_REL              1
+#define SHT_PROGBITS        1
+#define SHT_SYMTAB          2
+#define SHT_STRTAB          3
+#define SHF_ALLOC           0x2
+#define STB_LOCAL           0
+#define STB_GLOBAL          1
+#define STT_OBJECT          1
+#define STT_SECTION         3
+
+// Section indexes of the object, in header order
+#define SEC_NULL            0
+#define SEC_DATA            1
+#define SEC_SYMTAB          2
+#define SEC_STRTAB          3
+#define SEC_SHSTRTAB        4
+#define SEC_NOTE_STACK      5
+#define SEC_COUNT           6
+
+// Symbols: null, data section, varname, varname_size
+#define SYM_COUNT           4
+#define SYM_FIRST_GLOBAL    2
+
+// Targets accepted by --emit-object=TARGET, all little-endian.
+static const elf_target_t elf_targets[] =
+{
+  { "x86_64",   ELF_CLASS_64, EM_X86_64,  0 },
+  { "i386",     ELF_CLASS_32, EM_386,     0 },
+  { "aarch64",  ELF_CLASS_64, EM_AARCH64, 0 },
+  { "arm",      ELF_CLASS_32, EM_ARM,     EF_ARM_EABI_VER5 | EF_ARM_FLOAT_SOFT },
+  { "armhf",    ELF_CLASS_32, EM_ARM,     EF_ARM_EABI_VER5 | EF_ARM_FLOAT_HARD },
+  { "riscv32",  ELF_CLASS_32, EM_RISCV,   0 },
+  { "riscv64",  ELF_CLASS_64, EM_RISCV,   EF_RISCV_FLOAT_DOUBLE },
+};
+
+// Target of the machine raw2header was built for, if it is one of the above.
+#if defined( __x86_64__ )
+#define HOST_ELF_TARGET     "x86_64"
+#elif defined( __i386__ )
+#define HOST_ELF_TARGET     "i386"
+#elif defined( __aarch64__ )
+#define HOST_ELF_TARGET     "aarch64"
+#elif defined( __arm__ ) && defined( __ARM_PCS_VFP )
+#define HOST_ELF_TARGET     "armhf"
+#elif defined( __arm__ )
+#define HOST_ELF_TARGET     "arm"
+#elif defined( __riscv ) && __riscv_xlen == 64
+#define HOST_ELF_TARGET     "riscv64"
+#elif defined( __riscv )
+#define HOST_ELF_TARGET     "riscv32"
+#endif
+
+
+/** Look up an object target by name.
+ *
+ * @param name target name, or null for the host
+ * @retval const elf_target_t* target, or null when unknown
+ */
+const elf_target_t* findElfTarget( const char* name )
+{
+  if( name == 0 )
+  {
+#ifdef HOST_ELF_TARGET
+    name = HOST_ELF_TARGET;
+#else
+    return 0;
+#endif
+  }
+
+  for( size_t t = 0; t < sizeof( elf_targets ) / sizeof( elf_targets[0] ); t++ )
+  {
+    if( strcmp( name, elf_targets[t].name ) == 0 )
+    {
+      return &elf_targets[t];
+    }
+  }
+
+  return 0;
+}
+
+
+static void put8( FILE* fp, uint8_t v )
+{
+  fputc( v, fp );
+}
+
+static void put16( FILE* fp, uint16_t v )
+{
+  put8( fp, (uint8_t) v );
+  put8( fp, (uint8_t)( v >> 8 ) );
+}
+
+static void put32( FILE* fp, uint32_t v )
+{
+  put16( fp, (uint16_t) v );
+  put16( fp, (uint16_t)( v >> 16 ) );
+}
+
+static void put64( FILE* fp, uint64_t v )
+{
+  put32( fp, (uint32_t) v );
+  put32( fp, (uint32_t)( v >> 32 ) );
+}
+
+/** Address sized field: 4 bytes in ELF32, 8 in ELF64.
+ */
+static void putAddr( FILE* fp, uint8_t elf_class, uint64_t v )
+{
+  if( elf_class == ELF_CLASS_64 )
+  {
+    put64( fp, v );
+  }
+  else
+  {
+    put32( fp, (uint32_t) v );
+  }
+}
+
+static void putZeros( FILE* fp, size_t n )
+{
+  while( n-- > 0 )
+  {
+    put8( fp, 0 );
+  }
+}
+
+static uint64_t alignUp( uint64_t v, uint64_t align )
+{
+  return ( v + align - 1 ) & ~( align - 1 );
+}
+
+
+static void putSectionHeader( FILE* fp, uint8_t elf_class, uint32_t name, uint32_t type, uint64_t flags,
+                              uint64_t offset, uint64_t size, uint32_t link, uint32_t info,
+                              uint64_t addralign, uint64_t entsize )
+{
+  put32( fp, name );
+  put32( fp, type );
+  putAddr( fp, elf_class, flags );
+  putAddr( fp, elf_class, 0 );
+  putAddr( fp, elf_class, offset );
+  putAddr( fp, elf_class, size );
+  put32( fp, link );
+  put32( fp, info );
+  putAddr( fp, elf_class, addralign );
+  putAddr( fp, elf_class, entsize );
+}
+
+
+static void putSymbol( FILE* fp, uint8_t elf_class, uint32_t name, uint64_t value, uint64_t size,
+                       uint8_t info, uint16_t shndx )
+{
+  if( elf_class == ELF_CLASS_64 )
+  {
+    put32( fp, name );
+    put8( fp, info );
+    put8( fp, 0 );
+    put16( fp, shndx );
+    put64( fp, value );
+    put64( fp, size );
+  }
+  else
+  {
+    put32( fp, name );
+    put32( fp, (uint32_t) value );
+    put32( fp, (uint32_t) size );
+    put8( fp, info );
+    put8( fp, 0 );
+    put16( fp, shndx );
+  }
+}
+
+
+/** Lay out a relocatable object holding the payload.
+ *
+ * The object has one data section with the payload at offset 0 followed by a
+ * word holding its length, a global object symbol for each, and the usual
+ * symbol, string and section name tables.  The payload itself is not part
+ * of the result: it goes between head and tail, so callers can stream it.
+ *
+ * @param target machine and class to write
+ * @param flags e_flags of the object
+ * @param section name of the data section
+ * @param symbol name of the payload symbol, the length symbol gets _size appended
+ * @param payload_len payload length in bytes
+ * @param element_bytes width of one payload element, the section is aligned to it when wider than a word
+ * @param obj receives the text before and after the payload, release with freeElfObject()
+ * @retval int 0 on success, NO_MALLOC on failure
+ */
+int buildElfObject( const elf_target_t* target, uint32_t flags, const char* section, const char* symbol,
+                    uint64_t payload_len, unsigned element_bytes, elf_object_t* obj )
+{
+  static const char shstr_fixed[] = ".symtab\0.strtab\0.shstrtab\0.note.GNU-stack";
+  const uint8_t elf_class = target->elf_class;
+  const uint64_t word = ( elf_class == ELF_CLASS_64 ) ? 8 : 4;
+  const uint64_t ehdr_len = ( elf_class == ELF_CLASS_64 ) ? 64 : 52;
+  const uint64_t shdr_len = ( elf_class == ELF_CLASS_64 ) ? 64 : 40;
+  const uint64_t sym_len = ( elf_class == ELF_CLASS_64 ) ? 24 : 16;
+  const uint64_t symbol_len = strlen( symbol );
+  const uint64_t section_len = strlen( section );
+  const uint64_t data_align = ( element_bytes > word ) ? element_bytes : word;
+
+  // File layout
+  uint64_t data_off = alignUp( ehdr_len, data_align );
+  uint64_t size_word_off = alignUp( payload_len, word );
+  uint64_t data_len = size_word_off + word;
+  uint64_t symtab_off = alignUp( data_off + data_len, word );
+  uint64_t strtab_off = symtab_off + SYM_COUNT * sym_len;
+  uint64_t strtab_len = 1 + ( symbol_len + 1 ) + ( symbol_len + 6 );
+  uint64_t shstrtab_off = strtab_off + strtab_len;
+  uint64_t shstrtab_len = 1 + ( section_len + 1 ) + sizeof( shstr_fixed );
+  uint64_t shdr_off = alignUp( shstrtab_off + shstrtab_len, word );
+
+  // Offsets of the names in .shstrtab
+  uint32_t sh_data = 1;
+  uint32_t sh_symtab = sh_data + (uint32_t) section_len + 1;
+  uint32_t sh_strtab = sh_symtab + 8;
+  uint32_t sh_shstrtab = sh_strtab + 8;
+  uint32_t sh_note = sh_shstrtab + 10;
+  FILE* fp;
+
+  memset( obj, 0, sizeof( *obj ) );
+
+  // ELF header
+  fp = open_memstream( &obj->head, &obj->head_len );
+  if( fp == 0 )
+  {
+    return NO_MALLOC;
+  }
+  put8( fp, 0x7F );
+  put8( fp, 'E' );
+  put8( fp, 'L' );
+  put8( fp, 'F' );
+  put8( fp, elf_class );
+  put8( fp, 1 );                // ELFDATA2LSB
+  put8( fp, 1 );                // EV_CURRENT
+  putZeros( fp, 9 );
+  put16( fp, ET_REL );
+  put16( fp, target->machine );
+  put32( fp, 1 );
+  putAddr( fp, elf_class, 0 );  // e_entry
+  putAddr( fp, elf_class, 0 );  // e_phoff
+  putAddr( fp, elf_class, shdr_off );
+  put32( fp, flags );
+  put16( fp, (uint16_t) ehdr_len );
+  put16( fp, 0 );
+  put16( fp, 0 );
+  put16( fp, (uint16_t) shdr_len );
+  put16( fp, SEC_COUNT );
+  put16( fp, SEC_SHSTRTAB );
+  putZeros( fp, (size_t)( data_off - ehdr_len ) );
+  if( fclose( fp ) != 0 )
+  {
+    freeElfObject( obj );
+    return NO_MALLOC;
+  }
+
+  // Everything after the payload
+  fp = open_memstream( &obj->tail, &obj->tail_len );
+  if( fp == 0 )
+  {
+    freeElfObject( obj );
+    return NO_MALLOC;
+  }
+
+  putZeros( fp, (size_t)( size_word_off - payload_len ) );
+  putAddr( fp, elf_class, payload_len );
+  putZeros( fp, (size_t)( symtab_off - ( data_off + data_len ) ) );
+
+  putSymbol( fp, elf_class, 0, 0, 0, 0, 0 );
+  putSymbol( fp, elf_class, 0, 0, 0, ( STB_LOCAL << 4 ) | STT_SECTION, SEC_DATA );
+  putSymbol( fp, elf_class, 1, 0, payload_len, ( STB_GLOBAL << 4 ) | STT_OBJECT, SEC_DATA );
+  putSymbol( fp, elf_class, 1 + (uint32_t) symbol_len + 1, size_word_off, word,
+             ( STB_GLOBAL << 4 ) | STT_OBJECT, SEC_DATA );
+
+  put8( fp, 0 );
+  fwrite( symbol, 1, symbol_len + 1, fp );
+  fwrite( symbol, 1, symbol_len, fp );
+  fwrite( "_size", 1, 6, fp );
+
+  put8( fp, 0 );
+  fwrite( section, 1, section_len + 1, fp );
+  fwrite( shstr_fixed, 1, sizeof( shstr_fixed ), fp );
+  putZeros( fp, (size_t)( shdr_off - ( shstrtab_off + shstrtab_len ) ) );
+
+  putSectionHeader( fp, elf_class, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+  putSectionHeader( fp, elf_class, sh_data, SHT_PROGBITS, SHF_ALLOC, data_off, data_len, 0, 0, data_align, 0 );
+  putSectionHeader( fp, elf_class, sh_symtab, SHT_SYMTAB, 0, symtab_off, SYM_COUNT * sym_len,
+                    SEC_STRTAB, SYM_FIRST_GLOBAL, word, sym_len );
+  putSectionHeader( fp, elf_class, sh_strtab, SHT_STRTAB, 0, strtab_off, strtab_len, 0, 0, 1, 0 );
+  putSectionHeader( fp, elf_class, sh_shstrtab, SHT_STRTAB, 0, shstrtab_off, shstrtab_len, 0, 0, 1, 0 );
+  putSectionHeader( fp, elf_class, sh_note, SHT_PROGBITS, 0, shdr_off, 0, 0, 0, 1, 0 );
+
+  if( fclose( fp ) != 0 )
+  {
+    freeElfObject( obj );
+    return NO_MALLOC;
+  }
+
+  return 0;
+}
+
+
+void freeElfObject( elf_object_t* obj )
+{
+  free( obj->head );
+  free( obj->tail );
+  obj->head = 0;
+  obj->tail = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef RAW2HEADER_ELF_H
+#define RAW2HEADER_ELF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ELF classes
+#define ELF_CLASS_32        1
+#define ELF_CLASS_64        2
+
+/** Machine an object file is written for.
+ */
+typedef struct
+{
+  const char* name;
+  uint8_t     elf_class;
+  uint16_t    machine;
+  uint32_t    flags;
+} elf_target_t;
+
+/** Layout of the object around the payload, see buildElfObject().
+ */
+typedef struct
+{
+  char*   head;
+  size_t  head_len;
+  char*   tail;
+  size_t  tail_len;
+} elf_object_t;
+
+const elf_target_t* findElfTarget( const char* name );
+int buildElfObject( const elf_target_t* target, uint32_t flags, const char* section, const char* symbol,
+                    uint64_t payload_len, unsigned element_bytes, elf_object_t* obj );
+void freeElfObject( elf_object_t* obj );
+
+#endif
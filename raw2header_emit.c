@@ -0,0 +1,1024 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "raw2header_io.h"
+#include "raw2header_emit.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define EMIT_SIMD_X86
+#elif defined( __aarch64__ )
+#include <arm_neon.h>
+#define EMIT_SIMD_NEON
+#endif
+
+// Worst case bytes produced by one element, including row lead and break.
+#define EMIT_ELEMENT_MAX    24
+// Worst case bytes produced by one full row, including the SIMD store overrun.
+#define EMIT_ROW_MAX        ( NUM_COLUMNS * EMIT_ELEMENT_MAX )
+// Full row text padded to whole 32 byte vectors.
+#define ROW_PAD             96
+// Shuffle index that yields zero on every supported ISA.
+#define ROW_NO_HEX          0xFF
+
+typedef char* ( *row_kernel_t )( char* out, const uint8_t* src, size_t rows, uint8_t bigendian );
+
+/** Text of one full row with its hex digit slots.
+ *
+ * tmpl holds the constant text with zeros in the digit slots and hex_idx
+ * holds, per output byte, which hex digit of the row lands there.
+ */
+typedef struct
+{
+  uint8_t   tmpl[ ROW_PAD ] __attribute__(( aligned( 32 ) ));
+  uint8_t   hex_idx[ ROW_PAD ] __attribute__(( aligned( 32 ) ));
+  size_t    len;
+} row_layout_t;
+
+static const char digits[] = "0123456789ABCDEF";
+
+static char hex8[256][2];
+static char hex16[65536][4];
+static row_layout_t row8;
+static row_layout_t row16;
+static row_kernel_t row_kernel8;
+static row_kernel_t row_kernel16;
+static pthread_once_t hex_tables_once = PTHREAD_ONCE_INIT;
+
+static char* formatRow8( char* out, const uint8_t* src );
+static char* formatRow16( char* out, const uint8_t* src, uint8_t bigendian );
+
+
+/** Describe a full row of NUM_COLUMNS elements of the given width.
+ *
+ * @param row layout to fill
+ * @param word_bytes element width in bytes, 1 or 2
+ */
+static void initRowLayout( row_layout_t* row, int word_bytes )
+{
+  size_t pos = 0;
+  int hex = 0;
+
+  memset( row->tmpl, 0, sizeof( row->tmpl ) );
+  memset( row->hex_idx, ROW_NO_HEX, sizeof( row->hex_idx ) );
+
+  for( int col = 0; col < NUM_COLUMNS; col++ )
+  {
+    if( ( col * word_bytes ) % NUM_COLUMNS == 0 )
+    {
+      row->tmpl[ pos++ ] = ' ';
+    }
+    row->tmpl[ pos++ ] = ' ';
+    row->tmpl[ pos++ ] = '0';
+    row->tmpl[ pos++ ] = 'x';
+    for( int digit = 0; digit < word_bytes * 2; digit++ )
+    {
+      row->hex_idx[ pos++ ] = (uint8_t) hex++;
+    }
+    row->tmpl[ pos++ ] = ',';
+  }
+  row->tmpl[ pos++ ] = '\n';
+  row->len = pos;
+}
+
+
+/** Portable row kernels built on the lookup tables.
+ */
+static char* rowKernel8Scalar( char* out, const uint8_t* src, size_t rows, uint8_t bigendian )
+{
+  (void) bigendian;
+
+  while( rows-- != 0 )
+  {
+    out = formatRow8( out, src );
+    src += NUM_COLUMNS;
+  }
+
+  return out;
+}
+
+
+static char* rowKernel16Scalar( char* out, const uint8_t* src, size_t rows, uint8_t bigendian )
+{
+  while( rows-- != 0 )
+  {
+    out = formatRow16( out, src, bigendian );
+    src += NUM_COLUMNS * 2;
+  }
+
+  return out;
+}
+
+
+#if defined( EMIT_SIMD_X86 )
+
+/** Split bytes into nibbles and map them to ASCII hex, most significant first.
+ *
+ * @param bytes up to 8 (lo) or 16 (lo and hi) source bytes
+ * @param lo receives the digits of bytes 0..7
+ * @param hi receives the digits of bytes 8..15
+ */
+__attribute__(( target( "ssse3" ) ))
+static inline void hexDigitsSsse3( __m128i bytes, __m128i* lo, __m128i* hi )
+{
+  const __m128i lut = _mm_loadu_si128( (const __m128i*) digits );
+  const __m128i mask = _mm_set1_epi8( 0x0F );
+  __m128i high_nib = _mm_and_si128( _mm_srli_epi16( bytes, 4 ), mask );
+  __m128i low_nib = _mm_and_si128( bytes, mask );
+
+  *lo = _mm_shuffle_epi8( lut, _mm_unpacklo_epi8( high_nib, low_nib ) );
+  *hi = _mm_shuffle_epi8( lut, _mm_unpackhi_epi8( high_nib, low_nib ) );
+}
+
+
+/** Put 16-bit words into most-significant-byte-first order for printing.
+ */
+__attribute__(( target( "ssse3" ) ))
+static inline __m128i wordOrderSsse3( __m128i bytes, uint8_t bigendian )
+{
+  const __m128i swap = _mm_setr_epi8( 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+
+  return ( bigendian == 1 ) ? bytes : _mm_shuffle_epi8( bytes, swap );
+}
+
+
+/** Select the digits of one output vector: indexes 0..15 come from lo,
+ *  16..31 from hi, anything else is left zero for the template.
+ */
+__attribute__(( target( "ssse3" ) ))
+static inline __m128i placeDigitsSsse3( __m128i lo, __m128i hi, __m128i idx )
+{
+  const __m128i sixteen = _mm_set1_epi8( 16 );
+  __m128i from_lo = _mm_shuffle_epi8( lo, idx );
+  __m128i from_hi = _mm_shuffle_epi8( hi, _mm_sub_epi8( idx, sixteen ) );
+
+  // idx 0..15 minus 16 has the top bit set, so from_hi is zero there.
+  from_lo = _mm_andnot_si128( _mm_cmpgt_epi8( idx, _mm_set1_epi8( 15 ) ), from_lo );
+  return _mm_or_si128( from_lo, from_hi );
+}
+
+
+__attribute__(( target( "ssse3" ) ))
+static char* rowKernel8Ssse3( char* out, const uint8_t* src, size_t rows, uint8_t bigendian )
+{
+  (void) bigendian;
+
+  while( rows-- != 0 )
+  {
+    __m128i lo, hi;
+
+    hexDigitsSsse3( _mm_loadl_epi64( (const __m128i*) src ), &lo, &hi );
+    for( size_t b = 0; b < row8.len; b += 16 )
+    {
+      __m128i tmpl = _mm_load_si128( (const __m128i*)( row8.tmpl + b ) );
+      __m128i idx = _mm_load_si128( (const __m128i*)( row8.hex_idx + b ) );
+      _mm_storeu_si128( (__m128i*)( out + b ), _mm_or_si128( tmpl, _mm_shuffle_epi8( lo, idx ) ) );
+    }
+    out += row8.len;
+    src += NUM_COLUMNS;
+  }
+
+  return out;
+}
+
+
+__attribute__(( target( "ssse3" ) ))
+static char* rowKernel16Ssse3( char* out, const uint8_t* src, size_t rows, uint8_t bigendian )
+{
+  while( rows-- != 0 )
+  {
+    __m128i lo, hi;
+
+    hexDigitsSsse3( wordOrderSsse3( _mm_loadu_si128( (const __m128i*) src ), bigendian ), &lo, &hi );
+    for( size_t b = 0; b < row16.len; b += 16 )
+    {
+      __m128i tmpl = _mm_load_si128( (const __m128i*)( row16.tmpl + b ) );
+      __m128i idx = _mm_load_si128( (const __m128i*)( row16.hex_idx + b ) );
+      _mm_storeu_si128( (__m128i*)( out + b ), _mm_or_si128( tmpl, placeDigitsSsse3( lo, hi, idx ) ) );
+    }
+    out += row16.len;
+    src += NUM_COLUMNS * 2;
+  }
+
+  return out;
+}
+
+
+/** AVX2 variants place a whole 32 byte stretch of the row per shuffle.
+ *
+ * vpshufb only indexes within a 128-bit lane, so the digit vectors are
+ * broadcast to both lanes first.
+ */
+__attribute__(( target( "avx2" ) ))
+static inline __m256i placeDigitsAvx2( __m256i lo, __m256i hi, __m256i idx )
+{
+  __m256i from_lo = _mm256_shuffle_epi8( lo, idx );
+  __m256i from_hi = _mm256_shuffle_epi8( hi, _mm256_sub_epi8( idx, _mm256_set1_epi8( 16 ) ) );
+
+  from_lo = _mm256_andnot_si256( _mm256_cmpgt_epi8( idx, _mm256_set1_epi8( 15 ) ), from_lo );
+  return _mm256_or_si256( from_lo, from_hi );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static char* rowKernel8Avx2( char* out, const uint8_t* src, size_t rows, uint8_t bigendian )
+{
+  (void) bigendian;
+
+  while( rows-- != 0 )
+  {
+    __m128i lo, hi;
+    __m256i lo2;
+
+    hexDigitsSsse3( _mm_loadl_epi64( (const __m128i*) src ), &lo, &hi );
+    lo2 = _mm256_broadcastsi128_si256( lo );
+    for( size_t b = 0; b < row8.len; b += 32 )
+    {
+      __m256i tmpl = _mm256_load_si256( (const __m256i*)( row8.tmpl + b ) );
+      __m256i idx = _mm256_load_si256( (const __m256i*)( row8.hex_idx + b ) );
+      _mm256_storeu_si256( (__m256i*)( out + b ), _mm256_or_si256( tmpl, _mm256_shuffle_epi8( lo2, idx ) ) );
+    }
+    out += row8.len;
+    src += NUM_COLUMNS;
+  }
+
+  return out;
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static char* rowKernel16Avx2( char* out, const uint8_t* src, size_t rows, uint8_t bigendian )
+{
+  while( rows-- != 0 )
+  {
+    __m128i lo, hi;
+    __m256i lo2, hi2;
+
+    hexDigitsSsse3( wordOrderSsse3( _mm_loadu_si128( (const __m128i*) src ), bigendian ), &lo, &hi );
+    lo2 = _mm256_broadcastsi128_si256( lo );
+    hi2 = _mm256_broadcastsi128_si256( hi );
+    for( size_t b = 0; b < row16.len; b += 32 )
+    {
+      __m256i tmpl = _mm256_load_si256( (const __m256i*)( row16.tmpl + b ) );
+      __m256i idx = _mm256_load_si256( (const __m256i*)( row16.hex_idx + b ) );
+      _mm256_storeu_si256( (__m256i*)( out + b ), _mm256_or_si256( tmpl, placeDigitsAvx2( lo2, hi2, idx ) ) );
+    }
+    out += row16.len;
+    src += NUM_COLUMNS * 2;
+  }
+
+  return out;
+}
+
+#elif defined( EMIT_SIMD_NEON )
+
+/** NEON kernels; tbl returns zero for out of range indexes, so the
+ *  template slots need no extra masking.
+ */
+static inline uint8x16x2_t hexDigitsNeon( uint8x16_t bytes )
+{
+  const uint8x16_t lut = vld1q_u8( (const uint8_t*) digits );
+  uint8x16_t high_nib = vshrq_n_u8( bytes, 4 );
+  uint8x16_t low_nib = vandq_u8( bytes, vdupq_n_u8( 0x0F ) );
+  uint8x16x2_t hex;
+
+  hex.val[0] = vqtbl1q_u8( lut, vzip1q_u8( high_nib, low_nib ) );
+  hex.val[1] = vqtbl1q_u8( lut, vzip2q_u8( high_nib, low_nib ) );
+  return hex;
+}
+
+
+static char* rowKernel8Neon( char* out, const uint8_t* src, size_t rows, uint8_t bigendian )
+{
+  (void) bigendian;
+
+  while( rows-- != 0 )
+  {
+    uint8x16x2_t hex = hexDigitsNeon( vcombine_u8( vld1_u8( src ), vdup_n_u8( 0 ) ) );
+
+    for( size_t b = 0; b < row8.len; b += 16 )
+    {
+      uint8x16_t tmpl = vld1q_u8( row8.tmpl + b );
+      uint8x16_t idx = vld1q_u8( row8.hex_idx + b );
+      vst1q_u8( (uint8_t*)( out + b ), vorrq_u8( tmpl, vqtbl2q_u8( hex, idx ) ) );
+    }
+    out += row8.len;
+    src += NUM_COLUMNS;
+  }
+
+  return out;
+}
+
+
+static char* rowKernel16Neon( char* out, const uint8_t* src, size_t rows, uint8_t bigendian )
+{
+  while( rows-- != 0 )
+  {
+    uint8x16_t bytes = vld1q_u8( src );
+    uint8x16x2_t hex;
+
+    if( bigendian != 1 )
+    {
+      bytes = vrev16q_u8( bytes );
+    }
+    hex = hexDigitsNeon( bytes );
+
+    for( size_t b = 0; b < row16.len; b += 16 )
+    {
+      uint8x16_t tmpl = vld1q_u8( row16.tmpl + b );
+      uint8x16_t idx = vld1q_u8( row16.hex_idx + b );
+      vst1q_u8( (uint8_t*)( out + b ), vorrq_u8( tmpl, vqtbl2q_u8( hex, idx ) ) );
+    }
+    out += row16.len;
+    src += NUM_COLUMNS * 2;
+  }
+
+  return out;
+}
+
+#endif
+
+
+/** Pick the fastest row kernels the running CPU supports.
+ */
+static void selectRowKernels( void )
+{
+  row_kernel8 = rowKernel8Scalar;
+  row_kernel16 = rowKernel16Scalar;
+
+#if defined( EMIT_SIMD_X86 )
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) )
+  {
+    row_kernel8 = rowKernel8Avx2;
+    row_kernel16 = rowKernel16Avx2;
+  }
+  else if( __builtin_cpu_supports( "ssse3" ) )
+  {
+    row_kernel8 = rowKernel8Ssse3;
+    row_kernel16 = rowKernel16Ssse3;
+  }
+#elif defined( EMIT_SIMD_NEON )
+  row_kernel8 = rowKernel8Neon;
+  row_kernel16 = rowKernel16Neon;
+#endif
+}
+
+
+/** Build the lookup tables and row layouts and select kernels, run once.
+ */
+static void buildHexTables( void )
+{
+  for( int i = 0; i < 256; i++ )
+  {
+    hex8[i][0] = digits[ i >> 4 ];
+    hex8[i][1] = digits[ i & 0x0F ];
+  }
+
+  for( int i = 0; i < 65536; i++ )
+  {
+    memcpy( &hex16[i][0], hex8[ i >> 8 ], 2 );
+    memcpy( &hex16[i][2], hex8[ i & 0xFF ], 2 );
+  }
+
+  initRowLayout( &row8, 1 );
+  initRowLayout( &row16, 2 );
+  selectRowKernels();
+}
+
+
+static void initHexTables( void )
+{
+  pthread_once( &hex_tables_once, buildHexTables );
+}
+
+
+/** Write out whatever is sitting in the emitter buffer.
+ *
+ * @param em emitter
+ * @retval int 0 on success, ERROR_NOT_OPEN if the stream rejected the data
+ */
+static int flushBuffer( hex_emitter_t* em )
+{
+  if( em->buf_len == 0 || em->sink == EMIT_SINK_MEMORY )
+  {
+    return 0;
+  }
+
+  if( em->sink == EMIT_SINK_STREAM )
+  {
+    if( fwrite( em->buf, 1, em->buf_len, em->fp ) != em->buf_len )
+    {
+      return ERROR_NOT_OPEN;
+    }
+  }
+  else
+  {
+    const char* p = em->buf;
+    size_t left = em->buf_len;
+
+    while( left > 0 )
+    {
+      ssize_t done = pwrite( em->fd, p, left, em->offset );
+
+      if( done < 0 && errno == EINTR )
+      {
+        continue;
+      }
+      if( done <= 0 )
+      {
+        return ERROR_NOT_OPEN;
+      }
+      p += done;
+      left -= (size_t) done;
+      em->offset += done;
+    }
+  }
+
+  em->buf_len = 0;
+  return 0;
+}
+
+
+/** Format one element, honouring the row lead, separator and row break rules.
+ *
+ * The 16-bit layout inherits a lead space every NUM_COLUMNS bytes, which is
+ * every half row of words, so it is kept to stay byte-identical.
+ *
+ * @param em emitter, element index is advanced
+ * @param out output cursor
+ * @param src first byte of the element
+ * @retval char* advanced output cursor
+ */
+static char* formatElement( hex_emitter_t* em, char* out, const uint8_t* src )
+{
+  uint64_t e = em->element;
+
+  if( ( e * em->word_bytes ) % NUM_COLUMNS == 0 )
+  {
+    *out++ = ' ';
+  }
+
+  memcpy( out, " 0x", 3 );
+  out += 3;
+
+  if( em->word_bytes == 1 )
+  {
+    memcpy( out, hex8[ src[0] ], 2 );
+    out += 2;
+  }
+  else if( em->word_bytes == 2 )
+  {
+    unsigned word = ( em->bigendian == 1 ) ? ( ( src[0] << 8 ) | src[1] ) : ( ( src[1] << 8 ) | src[0] );
+    memcpy( out, hex16[ word ], 4 );
+    out += 4;
+  }
+  else
+  {
+    // Wider words are printed most significant byte first.
+    for( int b = 0; b < em->word_bytes; b++ )
+    {
+      memcpy( out, hex8[ src[ ( em->bigendian == 1 ) ? b : em->word_bytes - 1 - b ] ], 2 );
+      out += 2;
+    }
+  }
+
+  if( e < em->count - 1 )
+  {
+    *out++ = ',';
+  }
+
+  if( e % NUM_COLUMNS == NUM_COLUMNS - 1 )
+  {
+    *out++ = '\n';
+  }
+
+  em->element = e + 1;
+  return out;
+}
+
+
+/** Format a complete uint8_t row that is known not to hold the final element.
+ */
+static char* formatRow8( char* out, const uint8_t* src )
+{
+  *out++ = ' ';
+  for( int col = 0; col < NUM_COLUMNS; col++ )
+  {
+    memcpy( out, " 0x", 3 );
+    memcpy( out + 3, hex8[ src[ col ] ], 2 );
+    out[5] = ',';
+    out += 6;
+  }
+  *out++ = '\n';
+
+  return out;
+}
+
+
+/** Format a complete uint16_t row that is known not to hold the final element.
+ */
+static char* formatRow16( char* out, const uint8_t* src, uint8_t bigendian )
+{
+  const int hi = ( bigendian == 1 ) ? 0 : 1;
+
+  for( int col = 0; col < NUM_COLUMNS; col++ )
+  {
+    if( ( col * 2 ) % NUM_COLUMNS == 0 )
+    {
+      *out++ = ' ';
+    }
+    memcpy( out, " 0x", 3 );
+    memcpy( out + 3, hex16[ ( src[ hi ] << 8 ) | src[ hi ^ 1 ] ], 4 );
+    out[7] = ',';
+    out += 8;
+    src += 2;
+  }
+  *out++ = '\n';
+
+  return out;
+}
+
+
+/** Prepare an emitter for an array of count elements.
+ *
+ * @param em emitter to initialise
+ * @param fp destination stream, positioned after the opening brace
+ * @param count total number of elements in the array
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @param bigendian 1 if words are stored most significant byte first
+ * @retval int 0 on success, NO_MALLOC if the buffer could not be allocated
+ */
+int emitterInit( hex_emitter_t* em, FILE* fp, uint64_t count, uint8_t word_bytes, uint8_t bigendian )
+{
+  initHexTables();
+
+  memset( em, 0, sizeof( *em ) );
+  em->buf = malloc( EMIT_BUFFER_SIZE );
+  if( em->buf == 0 )
+  {
+    return NO_MALLOC;
+  }
+
+  em->sink = EMIT_SINK_STREAM;
+  em->buf_cap = EMIT_BUFFER_SIZE;
+  em->fp = fp;
+  em->fd = -1;
+  em->count = count;
+  em->word_bytes = word_bytes;
+  em->bigendian = bigendian;
+
+  return 0;
+}
+
+
+/** Prepare an emitter that writes a slice of the array with pwrite.
+ *
+ * @param em emitter to initialise
+ * @param fd destination descriptor
+ * @param offset file offset of the text of element first
+ * @param count total number of elements in the array
+ * @param first index of the first element that will be fed, row aligned
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @param bigendian 1 if words are stored most significant byte first
+ * @retval int 0 on success, NO_MALLOC if the buffer could not be allocated
+ */
+int emitterInitAt( hex_emitter_t* em, int fd, off_t offset, uint64_t count, uint64_t first,
+                   uint8_t word_bytes, uint8_t bigendian )
+{
+  int state = emitterInit( em, 0, count, word_bytes, bigendian );
+
+  em->sink = EMIT_SINK_FD;
+  em->fd = fd;
+  em->offset = offset;
+  em->element = first;
+
+  return state;
+}
+
+
+/** Prepare an emitter that formats a slice of the array straight into memory.
+ *
+ * Nothing is buffered or flushed; dst must have room for exactly the text of
+ * the elements that will be fed, as given by emitTextLength().
+ *
+ * @param em emitter to initialise
+ * @param dst destination of the text of element first
+ * @param cap bytes available at dst
+ * @param count total number of elements in the array
+ * @param first index of the first element that will be fed, row aligned
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @param bigendian 1 if words are stored most significant byte first
+ */
+void emitterInitMem( hex_emitter_t* em, char* dst, size_t cap, uint64_t count, uint64_t first,
+                     uint8_t word_bytes, uint8_t bigendian )
+{
+  initHexTables();
+
+  memset( em, 0, sizeof( *em ) );
+  em->sink = EMIT_SINK_MEMORY;
+  em->buf = dst;
+  em->buf_cap = cap;
+  em->fd = -1;
+  em->count = count;
+  em->element = first;
+  em->word_bytes = word_bytes;
+  em->bigendian = bigendian;
+}
+
+
+/** Length of the element list text for an array of count elements.
+ *
+ * Every element is " 0x" plus its digits and a comma, except the last which
+ * has no comma, plus the row lead spaces and row breaks.
+ *
+ * @param count number of elements
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @retval uint64_t text length in bytes
+ */
+uint64_t emitTextLength( uint64_t count, uint8_t word_bytes )
+{
+  const uint64_t lead_every = NUM_COLUMNS / word_bytes;
+
+  if( count == 0 )
+  {
+    return 0;
+  }
+
+  return count * ( 4 + 2 * (uint64_t) word_bytes ) - 1
+         + ( count + lead_every - 1 ) / lead_every
+         + count / NUM_COLUMNS;
+}
+
+
+/** Text offset of a row aligned element within the element list.
+ */
+static uint64_t emitTextOffset( uint64_t element, uint8_t word_bytes )
+{
+  // The comma after the previous element is not counted by emitTextLength().
+  return ( element == 0 ) ? 0 : emitTextLength( element, word_bytes ) + 1;
+}
+
+
+typedef struct
+{
+  int             fd;
+  char*           dst;
+  off_t           offset;
+  uint64_t        text_len;
+  const uint8_t*  data;
+  uint64_t        count;
+  uint64_t        first;
+  uint64_t        last;
+  uint8_t         word_bytes;
+  uint8_t         bigendian;
+  int             state;
+} emit_slice_t;
+
+
+/** Worker body: format one row aligned slice of the array at its offset.
+ */
+static void* emitSliceWorker( void* arg )
+{
+  emit_slice_t* slice = arg;
+  hex_emitter_t em;
+  uint64_t start = emitTextOffset( slice->first, slice->word_bytes );
+  uint64_t end = ( slice->last == slice->count ) ? slice->text_len
+                                                 : emitTextOffset( slice->last, slice->word_bytes );
+
+  if( slice->dst != 0 )
+  {
+    emitterInitMem( &em, slice->dst + slice->offset + start, (size_t)( end - start ), slice->count,
+                    slice->first, slice->word_bytes, slice->bigendian );
+  }
+  else
+  {
+    slice->state = emitterInitAt( &em, slice->fd, slice->offset + (off_t) start, slice->count,
+                                  slice->first, slice->word_bytes, slice->bigendian );
+    if( slice->state != 0 )
+    {
+      return 0;
+    }
+  }
+
+  slice->state = emitterFeed( &em, slice->data + slice->first * slice->word_bytes,
+                              (size_t)( slice->last - slice->first ) * slice->word_bytes );
+  if( emitterFinish( &em ) != 0 )
+  {
+    slice->state = ERROR_NOT_OPEN;
+  }
+
+  return 0;
+}
+
+
+/** Format a whole array with several threads writing straight to its destination.
+ *
+ * Every element has a fixed text width, so the offset of each row is known
+ * up front; the rows are split into contiguous slices, one per thread, and
+ * each thread formats its text in place, either into dst or with pwrite to
+ * fd.  The caller writes the text before offset and after
+ * offset + emitTextLength().
+ *
+ * @param fd destination descriptor, a regular file, used when dst is null
+ * @param dst destination memory such as an output mapping, or null
+ * @param offset offset of the first element in the file or in dst
+ * @param data raw bytes
+ * @param count number of elements
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @param bigendian 1 if words are stored most significant byte first
+ * @param threads number of worker threads wanted
+ * @retval int 0 on success, error code otherwise
+ */
+int emitParallel( int fd, char* dst, off_t offset, const uint8_t* data, uint64_t count,
+                  uint8_t word_bytes, uint8_t bigendian, unsigned threads )
+{
+  emit_slice_t slices[ EMIT_MAX_THREADS ];
+  pthread_t workers[ EMIT_MAX_THREADS ];
+  uint8_t spawned[ EMIT_MAX_THREADS ] = { 0 };
+  uint64_t rows = ( count + NUM_COLUMNS - 1 ) / NUM_COLUMNS;
+  uint64_t first_row = 0;
+  int state = 0;
+
+  initHexTables();
+
+  if( threads > EMIT_MAX_THREADS ) threads = EMIT_MAX_THREADS;
+  if( threads > rows ) threads = (unsigned) rows;
+  if( threads == 0 ) threads = 1;
+
+  for( unsigned t = 0; t < threads; t++ )
+  {
+    uint64_t last_row = rows * ( t + 1 ) / threads;
+    emit_slice_t* slice = &slices[t];
+
+    slice->fd = fd;
+    slice->dst = dst;
+    slice->offset = offset;
+    slice->text_len = emitTextLength( count, word_bytes );
+    slice->data = data;
+    slice->count = count;
+    slice->first = first_row * NUM_COLUMNS;
+    slice->last = ( last_row * NUM_COLUMNS < count ) ? last_row * NUM_COLUMNS : count;
+    slice->word_bytes = word_bytes;
+    slice->bigendian = bigendian;
+    slice->state = 0;
+    first_row = last_row;
+  }
+
+  // The calling thread takes the first slice, and any a thread could not be made for.
+  for( unsigned t = 1; t < threads; t++ )
+  {
+    spawned[t] = ( pthread_create( &workers[t], 0, emitSliceWorker, &slices[t] ) == 0 );
+  }
+
+  emitSliceWorker( &slices[0] );
+
+  for( unsigned t = 1; t < threads; t++ )
+  {
+    if( spawned[t] )
+    {
+      pthread_join( workers[t], 0 );
+    }
+    else
+    {
+      emitSliceWorker( &slices[t] );
+    }
+  }
+
+  for( unsigned t = 0; t < threads; t++ )
+  {
+    if( slices[t].state != 0 )
+    {
+      state = slices[t].state;
+    }
+  }
+
+  return state;
+}
+
+
+/** Append raw bytes to the array.
+ *
+ * @param em emitter
+ * @param data raw bytes, any length; a split word is carried over
+ * @param len number of bytes in data
+ * @retval int 0 on success, ERROR_NOT_OPEN on write failure
+ */
+int emitterFeed( hex_emitter_t* em, const uint8_t* data, size_t len )
+{
+  const size_t wb = em->word_bytes;
+  const size_t row_bytes = wb * NUM_COLUMNS;
+  char* out = em->buf + em->buf_len;
+
+  if( em->pending_len != 0 )
+  {
+    size_t take = wb - em->pending_len;
+
+    if( take > len )
+    {
+      take = len;
+    }
+    memcpy( em->pending + em->pending_len, data, take );
+    em->pending_len += (uint8_t) take;
+    data += take;
+    len -= take;
+
+    if( em->pending_len < wb )
+    {
+      return 0;
+    }
+    out = formatElement( em, out, em->pending );
+    em->pending_len = 0;
+  }
+
+  while( len >= wb && em->element < em->count )
+  {
+    size_t room = em->buf_cap - (size_t)( out - em->buf );
+
+    if( room < EMIT_ROW_MAX && em->sink != EMIT_SINK_MEMORY )
+    {
+      em->buf_len = (size_t)( out - em->buf );
+      if( flushBuffer( em ) != 0 )
+      {
+        return ERROR_NOT_OPEN;
+      }
+      out = em->buf;
+      room = em->buf_cap;
+    }
+
+    // Full rows away from the end of the array go through the row kernel,
+    // which may store up to a row past its text, so it needs the headroom.
+    if( wb <= 2 && em->element % NUM_COLUMNS == 0 && room >= EMIT_ROW_MAX )
+    {
+      size_t rows = len / row_bytes;
+      uint64_t body_rows = ( em->count - em->element - 1 ) / NUM_COLUMNS;
+      size_t room_rows = room / EMIT_ROW_MAX;
+
+      if( rows > body_rows ) rows = (size_t) body_rows;
+      if( rows > room_rows ) rows = room_rows;
+
+      if( rows != 0 )
+      {
+        out = ( wb == 1 ) ? row_kernel8( out, data, rows, em->bigendian )
+                          : row_kernel16( out, data, rows, em->bigendian );
+        em->element += (uint64_t) rows * NUM_COLUMNS;
+        data += rows * row_bytes;
+        len -= rows * row_bytes;
+        continue;
+      }
+    }
+
+    out = formatElement( em, out, data );
+    data += wb;
+    len -= wb;
+  }
+
+  if( len != 0 && em->element < em->count )
+  {
+    memcpy( em->pending, data, len );
+    em->pending_len = (uint8_t) len;
+  }
+
+  em->buf_len = (size_t)( out - em->buf );
+  return 0;
+}
+
+
+/** Flush the remaining formatted text and release the emitter buffer.
+ *
+ * A memory emitter keeps its text in place; buf_len is the length written.
+ *
+ * @param em emitter
+ * @retval int 0 on success, ERROR_NOT_OPEN on write failure
+ */
+int emitterFinish( hex_emitter_t* em )
+{
+  int state = flushBuffer( em );
+
+  if( em->sink != EMIT_SINK_MEMORY )
+  {
+    free( em->buf );
+  }
+  em->buf = 0;
+
+  return state;
+}
+
+
+/** Characters a byte takes inside a string literal, and its escape if any.
+ *
+ * Printable characters stay as they are apart from the quote, backslash and
+ * '?' (which could start a trigraph).  A hex digit right after a \xNN escape
+ * would extend that escape, so it is escaped too.
+ */
+static inline int stringByteLength( uint8_t c, int after_hex )
+{
+  if( c < 0x20 || c > 0x7E )
+  {
+    return 4;
+  }
+  if( c == '"' || c == '\\' || c == '?' )
+  {
+    return 2;
+  }
+  if( after_hex && isxdigit( c ) )
+  {
+    return 4;
+  }
+
+  return 1;
+}
+
+
+/** Length of the string literal text for a run of payload bytes.
+ *
+ * Each line holds STRING_LINE_BYTES bytes as "  \"..." and the closing quote
+ * goes in front of the newline that starts the next line (the last one is
+ * part of the array tail), so the text of a line only depends on its own bytes.
+ *
+ * @param data payload bytes
+ * @param len number of bytes, a multiple of STRING_LINE_BYTES unless the run ends the array
+ * @param first array index of data[0], a multiple of STRING_LINE_BYTES
+ * @retval uint64_t text length in bytes
+ */
+uint64_t stringTextLength( const uint8_t* data, size_t len, uint64_t first )
+{
+  uint64_t total = 0;
+  int after_hex = 0;
+
+  for( size_t i = 0; i < len; i++ )
+  {
+    int n;
+
+    if( ( i % STRING_LINE_BYTES ) == 0 )
+    {
+      total += ( first + i == 0 ) ? 3 : 5;
+      after_hex = 0;
+    }
+
+    n = stringByteLength( data[i], after_hex );
+    after_hex = ( n == 4 );
+    total += (uint64_t) n;
+  }
+
+  return total;
+}
+
+
+/** Format a run of payload bytes as string literal lines.
+ *
+ * @param out destination, at least stringTextLength() bytes
+ * @param data payload bytes
+ * @param len number of bytes, see stringTextLength()
+ * @param first array index of data[0], a multiple of STRING_LINE_BYTES
+ * @retval char* end of the text written
+ */
+char* formatStringText( char* out, const uint8_t* data, size_t len, uint64_t first )
+{
+  int after_hex = 0;
+
+  for( size_t i = 0; i < len; i++ )
+  {
+    uint8_t c = data[i];
+
+    if( ( i % STRING_LINE_BYTES ) == 0 )
+    {
+      if( first + i != 0 )
+      {
+        *out++ = '"';
+        *out++ = '\n';
+      }
+      *out++ = ' ';
+      *out++ = ' ';
+      *out++ = '"';
+      after_hex = 0;
+    }
+
+    switch( stringByteLength( c, after_hex ) )
+    {
+      case 1:
+        *out++ = (char) c;
+        after_hex = 0;
+        break;
+      case 2:
+        *out++ = '\\';
+        *out++ = (char) c;
+        after_hex = 0;
+        break;
+      default:
+        *out++ = '\\';
+        *out++ = 'x';
+        *out++ = digits[ c >> 4 ];
+        *out++ = digits[ c & 0x0F ];
+        after_hex = 1;
+        break;
+    }
+  }
+
+  return out;
+}
@@ -0,0 +1,66 @@
+#ifndef RAW2HEADER_EMIT_H
+#define RAW2HEADER_EMIT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Array layout constants
+#define NUM_COLUMNS         8
+#define EMIT_MAX_WORD       8
+#define EMIT_BUFFER_SIZE    ( 256 * 1024 )
+#define EMIT_MAX_THREADS    64
+// Payloads below this size are not worth splitting across threads.
+#define EMIT_PARALLEL_MIN   ( 4 * 1024 * 1024 )
+
+// String literal layout: input bytes per line, and worst-case text per line
+// ("\n" + two spaces + quotes around four characters per byte).
+#define STRING_LINE_BYTES   32
+#define STRING_TEXT_MAX( len ) \
+  ( (uint64_t)( len ) * 4 + ( ( (uint64_t)( len ) + STRING_LINE_BYTES - 1 ) / STRING_LINE_BYTES ) * 5 )
+
+// Emitter destinations
+#define EMIT_SINK_STREAM    0
+#define EMIT_SINK_FD        1
+#define EMIT_SINK_MEMORY    2
+
+/** Block hex emitter state.
+ *
+ * Formats array elements into a large private buffer using precomputed hex
+ * lookup tables and hands the buffer to fwrite in big blocks.  Elements may
+ * be fed in arbitrary chunks; the layout only depends on the element index.
+ * Output goes to fp, with pwrite to fd at offset, or straight into memory,
+ * according to sink.
+ */
+typedef struct
+{
+  uint8_t   sink;
+  FILE*     fp;
+  int       fd;
+  off_t     offset;
+  char*     buf;
+  size_t    buf_len;
+  size_t    buf_cap;
+  uint64_t  element;
+  uint64_t  count;
+  uint8_t   word_bytes;
+  uint8_t   bigendian;
+  uint8_t   pending[ EMIT_MAX_WORD ];
+  uint8_t   pending_len;
+} hex_emitter_t;
+
+int emitterInit( hex_emitter_t* em, FILE* fp, uint64_t count, uint8_t word_bytes, uint8_t bigendian );
+int emitterInitAt( hex_emitter_t* em, int fd, off_t offset, uint64_t count, uint64_t first,
+                   uint8_t word_bytes, uint8_t bigendian );
+void emitterInitMem( hex_emitter_t* em, char* dst, size_t cap, uint64_t count, uint64_t first,
+                     uint8_t word_bytes, uint8_t bigendian );
+int emitterFeed( hex_emitter_t* em, const uint8_t* data, size_t len );
+int emitterFinish( hex_emitter_t* em );
+uint64_t emitTextLength( uint64_t count, uint8_t word_bytes );
+int emitParallel( int fd, char* dst, off_t offset, const uint8_t* data, uint64_t count,
+                  uint8_t word_bytes, uint8_t bigendian, unsigned threads );
+uint64_t stringTextLength( const uint8_t* data, size_t len, uint64_t first );
+char* formatStringText( char* out, const uint8_t* data, size_t len, uint64_t first );
+
+#endif
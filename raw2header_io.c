@@ -1,13 +1,40 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdint.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 #include "raw2header_io.h"
+#include "raw2header_emit.h"
+#include "raw2header_elf.h"
+#include "raw2header_decoder.h"
+#include "adpcm.h"
+#include "pcm_ingest.h"
 
-// Configuration constants
-#define NUM_COLUMNS         8
+// Room kept in a stream chunk for trailing pad bytes.
+#define STREAM_PAD_MAX      16
+// Bodies written between the head and tail text by writeOutputText(); 1, 2, 4
+// and 8 are hex arrays of that many bytes per element.
+#define BODY_NONE           0
+#define BODY_BINARY         16
+#define BODY_STRING         17
+
+// Payload bytes formatted per string literal step, a multiple of STRING_LINE_BYTES.
+#define STRING_RUN          ( 32 * 1024 )
+
+// Block size used when comparing a new output against the old one.
+#define COMPARE_CHUNK       ( 256 * 1024 )
+
+// First buffer size for input of unknown length, doubled as it fills.
+#define READ_GROW_MIN       ( 64 * 1024 )
 
 
 static const char* getFilenamePart( const char* path )
@@ -17,503 +44,2225 @@ static const char* getFilenamePart( const char* path )
 }
 
 
-static int buildSourcePath( const char* header_path, char* source_path, size_t source_path_sz )
-{
-  const char* slash = strrchr( header_path, '/' );
-  const char* dot = strrchr( header_path, '.' );
-  size_t base_len = strlen( header_path );
+/** Replace the extension of a path, or append one when it has none.
+  *
+  * @param path original path
+  * @param ext new extension including the dot, e.g. ".c"
+  * @param out receives the new path
+  * @param out_sz size of out
+  * @retval int 0 on success, -1 when the path does not fit
+  */
+static int replaceExtension( const char* path, const char* ext, char* out, size_t out_sz )
+{
+  const char* slash = strrchr( path, '/' );
+  const char* dot = strrchr( path, '.' );
+  size_t base_len = strlen( path );
+
+  if( dot != 0 && ( slash == 0 || dot > slash ) )
+  {
+    base_len = (size_t)( dot - path );
+  }
+
+  if( base_len + strlen( ext ) >= out_sz )
+  {
+    return -1;
+  }
+
+  memcpy( out, path, base_len );
+  out[ base_len ] = '\0';
+  strcat( out, ext );
+
+  return 0;
+}
+
+
+/** Derive the source pair path from a header path by replacing its extension with .c
+  *
+  * @param header_path output header path
+  * @param source_path receives the source path
+  * @param source_path_sz size of source_path
+  * @retval int 0 on success, -1 when the path does not fit
+  */
+int buildSourcePath( const char* header_path, char* source_path, size_t source_path_sz )
+{
+  return replaceExtension( header_path, ".c", source_path, source_path_sz );
+}
+
+
+/** Derive the assembler source path of --incbin output from a header path.
+  */
+int buildIncbinPath( const char* header_path, char* asm_path, size_t asm_path_sz )
+{
+  return replaceExtension( header_path, ".S", asm_path, asm_path_sz );
+}
+
+
+/** Derive the object path of --emit-object output from a header path.
+  */
+int buildObjectPath( const char* header_path, char* obj_path, size_t obj_path_sz )
+{
+  return replaceExtension( header_path, ".o", obj_path, obj_path_sz );
+}
+
+
+/** Derive the sidecar data path of --incbin and --embed output from a header path.
+  */
+int buildSidecarPath( const char* header_path, char* bin_path, size_t bin_path_sz )
+{
+  return replaceExtension( header_path, ".bin", bin_path, bin_path_sz );
+}
+
+
+/** Derive the --adpcm-decoder path: DECODER_HEADER_NAME in the header's directory,
+  * so every array written there shares one decoder.
+  */
+int buildDecoderPath( const char* header_path, char* decoder_path, size_t decoder_path_sz )
+{
+  size_t dir_len = (size_t)( getFilenamePart( header_path ) - header_path );
+
+  if( dir_len + sizeof( DECODER_HEADER_NAME ) > decoder_path_sz )
+  {
+    return -1;
+  }
+
+  memcpy( decoder_path, header_path, dir_len );
+  memcpy( decoder_path + dir_len, DECODER_HEADER_NAME, sizeof( DECODER_HEADER_NAME ) );
+
+  return 0;
+}
+
+
+/** Read exactly len bytes from a descriptor, retrying short reads.
+  *
+  * @param fd descriptor to read
+  * @param dst destination buffer
+  * @param len number of bytes wanted
+  * @retval int 0 on success, -1 on error or early end of file
+  */
+static int readFully( int fd, uint8_t* dst, size_t len )
+{
+  while( len > 0 )
+  {
+    ssize_t got = read( fd, dst, len );
+
+    if( got < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( got <= 0 )
+    {
+      return -1;
+    }
+    dst += got;
+    len -= (size_t) got;
+  }
+
+  return 0;
+}
+
+
+/** Called with consecutive runs of the payload by visitPayload().
+ *
+ * first is the index of data[0] in the payload.
+ */
+typedef int ( *payload_visit_t )( void* ctx, const uint8_t* data, size_t len, uint64_t first );
+
+
+/** Encode the streamed PCM input as it is read and hand the ADPCM bytes to a visitor.
+ *
+ * Input is read in whole multiples of 2 * STREAM_MIN_CHUNK samples, so every
+ * run but the last is a multiple of STREAM_MIN_CHUNK bytes and the encoder
+ * only carries its predictor and index from one chunk to the next.  With
+ * job->adpcm_error set, each run is decoded again and measured against the
+ * PCM it came from.
+ *
+ * @param job conversion with an open input stream and ADPCM enabled
+ * @param visit visitor
+ * @param ctx visitor state
+ * @retval int 0 on success, the visitor's or a read error otherwise
+ */
+static int visitAdpcmStream( r2h_job_t* job, payload_visit_t visit, void* ctx )
+{
+  const int is16bit = ( job->wordmode == WORD_16 );
+  const size_t sample_bytes = is16bit ? 2 : 1;
+  const size_t unit = 2 * sample_bytes * STREAM_MIN_CHUNK;
+  size_t raw_len = ( job->stream_chunk * 2 / 3 ) / unit * unit;
+  off_t remaining = job->stream_len;
+  uint64_t done = 0;
+  ima_adpcm_encoder_t enc;
+  ima_adpcm_snapshot_t decoder = { { 0, 0 }, { 0, 0 } };
+  int16_t* decoded = 0;
+  uint8_t* raw;
+  uint8_t* encoded;
+  size_t len;
+  size_t samples = 0;
+  int state = 0;
+
+  // Two thirds of the chunk for PCM and the rest for the ADPCM it encodes to.
+  if( raw_len == 0 )
+  {
+    raw_len = unit;
+  }
+
+  raw = malloc( raw_len );
+  encoded = malloc( raw_len / ( 2 * sample_bytes ) + 1 );
+  if( job->adpcm_error != 0 )
+  {
+    decoded = malloc( IMA_ADPCM_VERIFY_SLICE * sizeof( int16_t ) );
+  }
+  if( raw == 0 || encoded == 0 || ( job->adpcm_error != 0 && decoded == 0 ) )
+  {
+    free( raw );
+    free( encoded );
+    free( decoded );
+    return NO_MALLOC;
+  }
+
+  ima_adpcm_encoder_init( &enc, is16bit, ( job->channelmode == MODE_STEREO ) ? 2 : 1 );
+  ima_adpcm_encoder_set_seek( &enc, job->adpcm_seek_table ? job->adpcm_seek : 0, job->adpcm_seek_table );
+
+  if( lseek( job->stream_fd, 0, SEEK_SET ) != 0 )
+  {
+    printSystemError( "rewind input file", job->input_path );
+    state = ERROR_NOT_OPEN;
+  }
+
+  while( remaining > 0 && state == 0 )
+  {
+    size_t from_file = ( remaining < (off_t) raw_len ) ? (size_t) remaining : raw_len;
+
+    if( readFully( job->stream_fd, raw, from_file ) != 0 )
+    {
+      printSystemError( "read input file", job->input_path );
+      state = ERROR_NOT_OPEN;
+      break;
+    }
+
+    // 16-bit PCM becomes host-endian samples while the chunk is still in cache.
+    if( is16bit )
+    {
+      pcm_ingest( raw, raw, from_file, 2, job->bigendian );
+    }
+
+    samples = from_file / sample_bytes;
+    len = ima_adpcm_encoder_feed( &enc, raw, samples, encoded );
+    if( decoded != 0 )
+    {
+      // Whole bytes only: an odd last sample waits for the finishing byte.
+      for( size_t at = 0; at + 1 < samples; at += IMA_ADPCM_VERIFY_SLICE )
+      {
+        size_t n = ( samples - at < IMA_ADPCM_VERIFY_SLICE ) ? ( samples - at ) & ~(size_t) 1
+                                                            : IMA_ADPCM_VERIFY_SLICE;
+
+        decode_ima_adpcm_stream( &decoder, encoded + at / 2, n, enc.channels, decoded );
+        ima_adpcm_measure( job->adpcm_error, raw + at * sample_bytes, decoded, n, is16bit );
+      }
+    }
+    state = visit( ctx, encoded, len, done );
+    done += len;
+    remaining -= (off_t) from_file;
+  }
+
+  if( state == 0 )
+  {
+    len = ima_adpcm_encoder_finish( &enc, encoded );
+    if( len != 0 && decoded != 0 )
+    {
+      decode_ima_adpcm_stream( &decoder, encoded, 1, enc.channels, decoded );
+      ima_adpcm_measure( job->adpcm_error, raw + ( samples - 1 ) * sample_bytes, decoded, 1, is16bit );
+    }
+    if( len != 0 )
+    {
+      state = visit( ctx, encoded, len, done );
+    }
+  }
+
+  free( raw );
+  free( encoded );
+  free( decoded );
+  return state;
+}
+
+
+/** Hand the whole payload to a visitor in runs, from memory or from the stream.
+ *
+ * Streamed input is read chunk by chunk with the pad bytes appended, or
+ * encoded on the way for ADPCM, so memory use stays within the stream
+ * budget.  Every run but the last is a multiple of STREAM_MIN_CHUNK bytes.
+ *
+ * @param job conversion whose payload is visited
+ * @param visit visitor
+ * @param ctx visitor state
+ * @retval int 0 on success, the visitor's or a read error otherwise
+ */
+static int visitPayload( r2h_job_t* job, payload_visit_t visit, void* ctx )
+{
+  const uint8_t* src = (const uint8_t*) job->rawdata_p;
+  size_t chunk_len = ( job->stream_fd >= 0 ) ? job->stream_chunk : EMIT_BUFFER_SIZE;
+  off_t remaining = job->table_size;
+  uint8_t* chunk = 0;
+  int state = 0;
+
+  if( job->stream_fd >= 0 && job->adpcm_enabled )
+  {
+    return visitAdpcmStream( job, visit, ctx );
+  }
+
+  if( job->stream_fd >= 0 )
+  {
+    chunk = malloc( chunk_len );
+    if( chunk == 0 )
+    {
+      return NO_MALLOC;
+    }
+
+    if( lseek( job->stream_fd, 0, SEEK_SET ) != 0 )
+    {
+      printSystemError( "rewind input file", job->input_path );
+      free( chunk );
+      return ERROR_NOT_OPEN;
+    }
+  }
+
+  while( remaining > 0 && state == 0 )
+  {
+    size_t len = ( remaining < (off_t) chunk_len ) ? (size_t) remaining : chunk_len;
+    off_t done = job->table_size - remaining;
+
+    if( chunk == 0 )
+    {
+      state = visit( ctx, src + done, len, (uint64_t) done );
+      remaining -= (off_t) len;
+      continue;
+    }
+
+    if( done >= job->stream_len )
+    {
+      memset( chunk, job->pad_value, len );
+    }
+    else
+    {
+      size_t from_file = ( done + (off_t) len > job->stream_len ) ? (size_t)( job->stream_len - done ) : len;
+
+      if( readFully( job->stream_fd, chunk, from_file ) != 0 )
+      {
+        printSystemError( "read input file", job->input_path );
+        state = ERROR_NOT_OPEN;
+        break;
+      }
+      memset( chunk + from_file, job->pad_value, len - from_file );
+    }
+
+    state = visit( ctx, chunk, len, (uint64_t) done );
+    remaining -= (off_t) len;
+  }
+
+  free( chunk );
+  return state;
+}
+
+
+static int visitNothing( void* ctx, const uint8_t* data, size_t len, uint64_t first )
+{
+  (void) ctx;
+  (void) data;
+  (void) len;
+  (void) first;
+  return 0;
+}
+
+
+/** Encode the streamed ADPCM once without output, to fill job->adpcm_seek_table
+ *  and job->adpcm_error when they are set.
+ *
+ * @param job conversion with an open input stream and ADPCM
+ * @retval int 0 on success, error code otherwise
+ */
+int scanAdpcmStream( r2h_job_t* job )
+{
+  return visitPayload( job, visitNothing, 0 );
+}
+
+
+static int visitEmitter( void* ctx, const uint8_t* data, size_t len, uint64_t first )
+{
+  (void) first;
+  return emitterFeed( ctx, data, len );
+}
+
+
+/** Number of formatting or encoding threads to use: job->worker_threads, or one per online CPU.
+ */
+unsigned resolveWorkerThreads( const r2h_job_t* job )
+{
+  long cpus;
+
+  if( job->worker_threads != 0 )
+  {
+    return job->worker_threads;
+  }
+
+  cpus = sysconf( _SC_NPROCESSORS_ONLN );
+  return ( cpus > 0 ) ? (unsigned) cpus : 1;
+}
+
+
+/** Reset a conversion to the default options with no payload.
+  *
+  * @param job conversion to initialise
+  */
+void initJob( r2h_job_t* job )
+{
+  memset( job, 0, sizeof( *job ) );
+  job->channelmode = MODE_NONE;
+  job->stream_fd = -1;
+  job->out_fd = -1;
+}
+
+
+/** Format the payload as the element list of an array into an open output file.
+ *
+ * In-memory payloads are formatted straight into the output mapping, or with
+ * pwrite when there is none, split across threads when large enough.  The
+ * input opened by openRawStream(), and output to a stream, go through a
+ * single emitter one chunk at a time so memory stays bounded.
+ *
+ * @param job conversion whose payload is written
+ * @param fd output descriptor
+ * @param map output mapping, or null to pwrite
+ * @param offset offset of the element list in the file
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @param fp stream to write in order instead, or null
+ * @retval int 0 on success, error code otherwise
+ */
+static int writeHexArray( r2h_job_t* job, int fd, char* map, off_t offset, uint8_t word_bytes, FILE* fp )
+{
+  hex_emitter_t em;
+  uint64_t count = (uint64_t) job->table_size / word_bytes;
+  unsigned threads = resolveWorkerThreads( job );
+  int state;
+
+  if( job->stream_fd >= 0 || fp != 0 )
+  {
+    if( fp != 0 )
+    {
+      state = emitterInit( &em, fp, count, word_bytes, job->bigendian );
+      if( state != 0 )
+      {
+        return state;
+      }
+    }
+    else if( map != 0 )
+    {
+      emitterInitMem( &em, map + offset, (size_t) emitTextLength( count, word_bytes ), count, 0,
+                      word_bytes, job->bigendian );
+    }
+    else
+    {
+      state = emitterInitAt( &em, fd, offset, count, 0, word_bytes, job->bigendian );
+      if( state != 0 )
+      {
+        return state;
+      }
+    }
+
+    state = visitPayload( job, visitEmitter, &em );
+    if( emitterFinish( &em ) != 0 )
+    {
+      state = ERROR_NOT_OPEN;
+    }
+
+    return state;
+  }
+
+  if( job->table_size < EMIT_PARALLEL_MIN )
+  {
+    threads = 1;
+  }
+
+  return emitParallel( fd, map, offset, (const uint8_t*) job->rawdata_p, count, word_bytes, job->bigendian, threads );
+}
+
+
+
+/** Write all of buf at offset, retrying short writes.
+ *
+ * @retval int 0 on success, -1 on error with errno set
+ */
+static int pwriteFully( int fd, const char* buf, size_t len, off_t offset )
+{
+  while( len > 0 )
+  {
+    ssize_t done = pwrite( fd, buf, len, offset );
+
+    if( done < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( done <= 0 )
+    {
+      return -1;
+    }
+    buf += done;
+    len -= (size_t) done;
+    offset += done;
+  }
+
+  return 0;
+}
+
+
+/** Write all of buf at the current position, retrying short writes, for
+ *  descriptors that cannot seek.
+ *
+ * @retval int 0 on success, -1 on error with errno set
+ */
+static int writeFully( int fd, const char* buf, size_t len )
+{
+  while( len > 0 )
+  {
+    ssize_t done = write( fd, buf, len );
+
+    if( done < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( done <= 0 )
+    {
+      return -1;
+    }
+    buf += done;
+    len -= (size_t) done;
+  }
+
+  return 0;
+}
+
+
+/** Refuse outputs that cannot fit in the space left on their filesystem.
+ *
+ * Blocks held by an existing file of the same name count as free, as it is
+ * about to be truncated.  Per-user quotas are caught by the reservation.
+ *
+ * @param path output path
+ * @param total exact output size in bytes
+ * @retval int 0 if the output fits or the space is unknown, -1 otherwise
+ */
+static int checkOutputSpace( const char* path, uint64_t total )
+{
+  const char* slash = strrchr( path, '/' );
+  char dir[1024] = ".";
+  struct statvfs vfs;
+  struct stat st;
+  uint64_t avail;
+
+  if( slash != 0 )
+  {
+    size_t dir_len = ( slash == path ) ? 1 : (size_t)( slash - path );
+
+    if( dir_len >= sizeof( dir ) )
+    {
+      return 0;
+    }
+    memcpy( dir, path, dir_len );
+    dir[ dir_len ] = '\0';
+  }
+
+  if( statvfs( dir, &vfs ) != 0 )
+  {
+    return 0;
+  }
+
+  avail = (uint64_t) vfs.f_bavail * vfs.f_frsize;
+  if( stat( path, &st ) == 0 && S_ISREG( st.st_mode ) )
+  {
+    avail += (uint64_t) st.st_blocks * 512;
+  }
+
+  if( total > avail )
+  {
+    fprintf( stderr, "Error: output '%s' needs %llu bytes but only %llu are available.\n",
+             path, (unsigned long long) total, (unsigned long long) avail );
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/** Give an output file its final size, allocating the blocks where supported.
+ *
+ * @retval int 0 on success, -1 on error with errno set
+ */
+static int reserveOutput( int fd, off_t total )
+{
+#if defined( __linux__ )
+  int err = posix_fallocate( fd, 0, total );
+
+  if( err == 0 )
+  {
+    return 0;
+  }
+  if( err != EINVAL && err != EOPNOTSUPP )
+  {
+    errno = err;
+    return -1;
+  }
+#endif
+
+  return ftruncate( fd, total );
+}
+
+
+/** Destination of a body written run by run: the mapping, pwrite through buf,
+ *  or a stream written in order.
+ */
+typedef struct
+{
+  int       fd;
+  char*     map;
+  off_t     offset;
+  uint64_t  pos;
+  char*     buf;
+  int       swap;               // word size to byte swap, 0 for none
+  FILE*     fp;                 // write in order here instead, for outputs that cannot seek
+} body_sink_t;
+
+
+/** Copy the next stretch of body text to its place in the output.
+ */
+static int putBody( body_sink_t* sink, const char* text, size_t len )
+{
+  if( sink->map != 0 )
+  {
+    if( text != sink->map + sink->offset + sink->pos )
+    {
+      memcpy( sink->map + sink->offset + sink->pos, text, len );
+    }
+  }
+  else if( sink->fp != 0 )
+  {
+    if( fwrite( text, 1, len, sink->fp ) != len )
+    {
+      return ERROR_NOT_OPEN;
+    }
+  }
+  else if( pwriteFully( sink->fd, text, len, sink->offset + (off_t) sink->pos ) != 0 )
+  {
+    return ERROR_NOT_OPEN;
+  }
+
+  sink->pos += len;
+  return 0;
+}
+
+
+static int visitBinary( void* ctx, const uint8_t* data, size_t len, uint64_t first )
+{
+  body_sink_t* sink = ctx;
+  char* dst = ( sink->map != 0 ) ? sink->map + sink->offset + sink->pos : sink->buf;
+
+  (void) first;
+  if( sink->swap > 1 )
+  {
+    // A streamed chunk is read again for every pass, so it is swapped where it is.
+    if( dst == 0 )
+    {
+      dst = (char*) data;
+    }
+    pcm_swap_words( dst, data, len, sink->swap );
+    return putBody( sink, dst, len );
+  }
+
+  return putBody( sink, (const char*) data, len );
+}
+
+
+/** Write the payload as raw bytes in target order, for the --incbin sidecar.
+ *
+ * Big-endian words are byte swapped so the target sees the same values as
+ * the hex array would give it.
+ *
+ * @param job conversion whose payload is written
+ * @param fd output descriptor, used when map and fp are null
+ * @param map mapping of the whole output file, or null
+ * @param offset where the data starts in the file
+ * @param fp stream to write in order instead, or null
+ * @retval int 0 on success, error code otherwise
+ */
+static int writeBinaryBody( r2h_job_t* job, int fd, char* map, off_t offset, FILE* fp )
+{
+  body_sink_t sink = { fd, map, offset, 0, 0, 0, fp };
+  int state;
+
+  if( job->wordmode != WORD_8 && job->bigendian && !job->adpcm_enabled )
+  {
+    sink.swap = 1 << job->wordmode;
+  }
+
+  // Streamed input swaps in its own chunk, which keeps within --max-memory.
+  if( map == 0 && sink.swap && job->stream_fd < 0 )
+  {
+    sink.buf = malloc( EMIT_BUFFER_SIZE );
+    if( sink.buf == 0 )
+    {
+      return NO_MALLOC;
+    }
+  }
+
+  state = visitPayload( job, visitBinary, &sink );
+  free( sink.buf );
+
+  return state;
+}
+
+
+static int visitStringLength( void* ctx, const uint8_t* data, size_t len, uint64_t first )
+{
+  *(uint64_t*) ctx += stringTextLength( data, len, first );
+  return 0;
+}
+
+
+/** Length of the string literal body, which depends on the payload bytes.
+ *
+ * @param job conversion whose payload is measured
+ * @param len receives the length
+ * @retval int 0 on success, error code otherwise
+ */
+static int stringBodyLength( r2h_job_t* job, uint64_t* len )
+{
+  *len = 0;
+  return visitPayload( job, visitStringLength, len );
+}
+
+
+static int visitString( void* ctx, const uint8_t* data, size_t len, uint64_t first )
+{
+  body_sink_t* sink = ctx;
+
+  // Sub-runs keep the text buffer small under --max-memory.
+  for( size_t done = 0; done < len; done += STRING_RUN )
+  {
+    size_t run = ( len - done < STRING_RUN ) ? len - done : STRING_RUN;
+    char* dst = ( sink->map != 0 ) ? sink->map + sink->offset + sink->pos : sink->buf;
+    char* end = formatStringText( dst, data + done, run, first + done );
+
+    if( putBody( sink, dst, (size_t)( end - dst ) ) != 0 )
+    {
+      return ERROR_NOT_OPEN;
+    }
+  }
+
+  return 0;
+}
+
+
+/** Write the payload as string literal lines, see formatStringText().
+ *
+ * @param job conversion whose payload is written
+ * @param fd output descriptor, used when map and fp are null
+ * @param map mapping of the whole output file, or null
+ * @param offset where the text starts in the file
+ * @param fp stream to write in order instead, or null
+ * @retval int 0 on success, error code otherwise
+ */
+static int writeStringBody( r2h_job_t* job, int fd, char* map, off_t offset, FILE* fp )
+{
+  body_sink_t sink = { fd, map, offset, 0, 0, 0, fp };
+  int state;
+
+  if( map == 0 )
+  {
+    sink.buf = malloc( STRING_TEXT_MAX( STRING_RUN ) );
+    if( sink.buf == 0 )
+    {
+      return NO_MALLOC;
+    }
+  }
+
+  state = visitPayload( job, visitString, &sink );
+  free( sink.buf );
+
+  return state;
+}
+
+
+/** Check whether two files hold the same bytes.
+ *
+ * @param a first path
+ * @param b second path
+ * @retval int 1 when identical, 0 when different or either cannot be read
+ */
+static int filesIdentical( const char* a, const char* b )
+{
+  struct stat st_a;
+  struct stat st_b;
+  uint8_t* buf;
+  int fd_a;
+  int fd_b;
+  int same = 0;
+
+  fd_a = open( a, O_RDONLY );
+  if( fd_a < 0 )
+  {
+    return 0;
+  }
+  fd_b = open( b, O_RDONLY );
+  if( fd_b < 0 )
+  {
+    close( fd_a );
+    return 0;
+  }
+
+  buf = malloc( 2 * COMPARE_CHUNK );
+  if( buf != 0 && fstat( fd_a, &st_a ) == 0 && fstat( fd_b, &st_b ) == 0 && st_a.st_size == st_b.st_size )
+  {
+    off_t left = st_a.st_size;
+
+    same = 1;
+    while( same && left > 0 )
+    {
+      size_t step = ( left > COMPARE_CHUNK ) ? COMPARE_CHUNK : (size_t) left;
+
+      if( readFully( fd_a, buf, step ) != 0 || readFully( fd_b, buf + COMPARE_CHUNK, step ) != 0
+          || memcmp( buf, buf + COMPARE_CHUNK, step ) != 0 )
+      {
+        same = 0;
+      }
+      left -= (off_t) step;
+    }
+  }
+
+  free( buf );
+  close( fd_a );
+  close( fd_b );
+
+  return same;
+}
+
+
+/** Move a freshly written temp file over its output unless the output already
+ *  holds the same text, in which case the output and its mtime are left alone.
+ *
+ * @param job conversion being written
+ * @param temp_path the new text
+ * @param path final output path
+ * @param what description used in error messages, e.g. "output header"
+ * @retval int WRITE_SUCCESS or ERROR_NOT_OPEN
+ */
+static int replaceIfChanged( r2h_job_t* job, const char* temp_path, const char* path, const char* what )
+{
+  char context[64];
+
+  if( filesIdentical( temp_path, path ) )
+  {
+    unlink( temp_path );
+    printProgress( job, "Unchanged: %s\n", path );
+    return WRITE_SUCCESS;
+  }
+
+  if( rename( temp_path, path ) != 0 )
+  {
+    snprintf( context, sizeof( context ), "replace %s", what );
+    printSystemError( context, path );
+    unlink( temp_path );
+    return ERROR_NOT_OPEN;
+  }
+
+  return WRITE_SUCCESS;
+}
+
+
+static void discardTemp( const r2h_job_t* job, const char* temp_path )
+{
+  if( job->incremental )
+  {
+    unlink( temp_path );
+  }
+}
+
+
+/** Write the body of an output file, see writeOutputText().
+ */
+static int writeBody( r2h_job_t* job, int fd, char* map, off_t offset, uint8_t body, FILE* fp )
+{
+  if( body == BODY_BINARY )
+  {
+    return writeBinaryBody( job, fd, map, offset, fp );
+  }
+  if( body == BODY_STRING )
+  {
+    return writeStringBody( job, fd, map, offset, fp );
+  }
+  if( body != BODY_NONE )
+  {
+    return writeHexArray( job, fd, map, offset, body, fp );
+  }
+
+  return 0;
+}
+
+
+/** Write one output of known size to job->out_fd or job->out_mem instead of a path.
+ *
+ * A seekable descriptor gets the text with pwrite from its current position,
+ * which is left after the text.  Descriptors that cannot seek, such as pipes,
+ * are written in order when the input is streamed; otherwise they, and
+ * memory output, are formatted into one heap buffer of the exact size.
+ *
+ * @see writeOutputText()
+ * @retval int WRITE_SUCCESS or ERROR_NOT_OPEN
+ */
+static int writeOutputTarget( r2h_job_t* job, const char* path, const char* what, uint64_t total,
+                              const char* head, size_t head_len, uint8_t body, uint64_t array_len,
+                              const char* tail, size_t tail_len )
+{
+  char context[64];
+  char* buf = 0;
+  off_t base = -1;
+  int state = 0;
+
+  if( job->out_target == OUT_MEMORY && job->out_mem != 0 )
+  {
+    fprintf( stderr, "Error: only one output fits in a memory conversion.\n" );
+    return ERROR_NOT_OPEN;
+  }
+
+  if( job->out_target == OUT_FD )
+  {
+    base = lseek( job->out_fd, 0, SEEK_CUR );
+  }
+
+  if( base >= 0 )
+  {
+    if( pwriteFully( job->out_fd, head, head_len, base ) != 0 )
+    {
+      state = ERROR_NOT_OPEN;
+    }
+    if( state == 0 )
+    {
+      state = writeBody( job, job->out_fd, 0, base + (off_t) head_len, body, 0 );
+    }
+    if( state == 0 && pwriteFully( job->out_fd, tail, tail_len, base + (off_t)( head_len + array_len ) ) != 0 )
+    {
+      state = ERROR_NOT_OPEN;
+    }
+    if( state == 0 && lseek( job->out_fd, base + (off_t) total, SEEK_SET ) < 0 )
+    {
+      state = ERROR_NOT_OPEN;
+    }
+  }
+  else if( job->out_target == OUT_FD && job->stream_fd >= 0 )
+  {
+    // Streamed input keeps its memory bound: write the text in order.
+    int dup_fd = dup( job->out_fd );
+    FILE* fp = ( dup_fd < 0 ) ? 0 : fdopen( dup_fd, "w" );
+
+    if( fp == 0 )
+    {
+      if( dup_fd >= 0 )
+      {
+        close( dup_fd );
+      }
+      state = ERROR_NOT_OPEN;
+    }
+    else
+    {
+      if( fwrite( head, 1, head_len, fp ) != head_len )
+      {
+        state = ERROR_NOT_OPEN;
+      }
+      if( state == 0 )
+      {
+        state = writeBody( job, -1, 0, 0, body, fp );
+      }
+      if( state == 0 && fwrite( tail, 1, tail_len, fp ) != tail_len )
+      {
+        state = ERROR_NOT_OPEN;
+      }
+      if( fclose( fp ) != 0 )
+      {
+        state = ERROR_NOT_OPEN;
+      }
+    }
+  }
+  else
+  {
+    buf = malloc( (size_t) total + 1 );
+    if( buf == 0 )
+    {
+      fprintf( stderr, "Error: failed to allocate %llu bytes for the %s.\n", (unsigned long long) total, what );
+      return ERROR_NOT_OPEN;
+    }
+
+    memcpy( buf, head, head_len );
+    state = writeBody( job, -1, buf, (off_t) head_len, body, 0 );
+    memcpy( buf + head_len + array_len, tail, tail_len );
+
+    if( state == 0 && job->out_target == OUT_MEMORY )
+    {
+      buf[ total ] = '\0';
+      job->out_mem = buf;
+      job->out_mem_len = (size_t) total;
+      return WRITE_SUCCESS;
+    }
+    if( state == 0 && writeFully( job->out_fd, buf, (size_t) total ) != 0 )
+    {
+      state = ERROR_NOT_OPEN;
+    }
+    free( buf );
+  }
+
+  if( state != 0 )
+  {
+    snprintf( context, sizeof( context ), "write %s", what );
+    printSystemError( context, path );
+    return ERROR_NOT_OPEN;
+  }
+
+  return WRITE_SUCCESS;
+}
+
+
+/** Write one output file of known size: head text, optional array, tail text.
+ *
+ * The exact size is known before anything is written, so it is reported and
+ * checked against the free space first, then the file is sized in one go,
+ * mapped, and everything is formatted straight into the mapping.  Without a
+ * mapping, or for streamed input, the text goes out with pwrite instead.
+ * In incremental mode the text goes to a temp file next to path first and
+ * only replaces path when it differs, see replaceIfChanged().  Jobs with an
+ * out_target other than OUT_PATH write there instead, see writeOutputTarget().
+ * Each output written is counted in job->out_files and job->out_bytes.
+ *
+ * @param job conversion whose payload is written
+ * @param path output path
+ * @param what description used in error messages, e.g. "output header"
+ * @param size_label description used in the size report, or null for none
+ * @param head text before the array
+ * @param head_len length of head
+ * @param body BODY_NONE, 1, 2, 4 or 8 for a hex array of that element width,
+ *             BODY_BINARY for the raw payload or BODY_STRING for string literals
+ * @param tail text after the array
+ * @param tail_len length of tail
+ * @retval int WRITE_SUCCESS or ERROR_NOT_OPEN
+ */
+static int writeOutputText( r2h_job_t* job, const char* path, const char* what, const char* size_label,
+                            const char* head, size_t head_len, uint8_t body,
+                            const char* tail, size_t tail_len )
+{
+  uint64_t array_len = 0;
+  uint64_t total;
+  char temp_path[1100];
+  char context[64];
+  char* map = 0;
+  int state = 0;
+  int fd;
+
+  if( body == BODY_BINARY )
+  {
+    array_len = (uint64_t) job->table_size;
+  }
+  else if( body == BODY_STRING )
+  {
+    if( stringBodyLength( job, &array_len ) != 0 )
+    {
+      return ERROR_NOT_OPEN;
+    }
+  }
+  else if( body != BODY_NONE )
+  {
+    array_len = emitTextLength( (uint64_t) job->table_size / body, body );
+  }
+  total = head_len + array_len + tail_len;
+
+  if( size_label != 0 )
+  {
+    printProgress( job, "Size of %s: %lli\n", size_label, ( long long ) total );
+  }
+
+  if( job->out_target != OUT_PATH )
+  {
+    state = writeOutputTarget( job, path, what, total, head, head_len, body, array_len, tail, tail_len );
+    if( state == WRITE_SUCCESS )
+    {
+      job->out_files++;
+      job->out_bytes += total;
+    }
+    return state;
+  }
+
+  if( checkOutputSpace( path, total ) != 0 )
+  {
+    return ERROR_NOT_OPEN;
+  }
+
+  if( job->incremental )
+  {
+    if( snprintf( temp_path, sizeof( temp_path ), "%s.%ld.tmp", path, (long) getpid() ) >= (int) sizeof( temp_path ) )
+    {
+      fprintf( stderr, "Error: output filename is too long for a temp file.\n" );
+      return ERROR_NOT_OPEN;
+    }
+    fd = open( temp_path, O_RDWR | O_CREAT | O_EXCL, 0666 );
+  }
+  else
+  {
+    fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+  }
+  if( fd < 0 )
+  {
+    snprintf( context, sizeof( context ), "open %s", what );
+    printSystemError( context, job->incremental ? temp_path : path );
+    return ERROR_NOT_OPEN;
+  }
+
+  if( total > 0 && reserveOutput( fd, (off_t) total ) != 0 )
+  {
+    snprintf( context, sizeof( context ), "reserve space for %s", what );
+    printSystemError( context, path );
+    close( fd );
+    discardTemp( job, temp_path );
+    return ERROR_NOT_OPEN;
+  }
+
+  if( total > 0 && job->stream_fd < 0 )
+  {
+    map = mmap( 0, (size_t) total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( map == MAP_FAILED )
+    {
+      map = 0;
+    }
+  }
+
+  if( map != 0 )
+  {
+    memcpy( map, head, head_len );
+    state = writeBody( job, fd, map, (off_t) head_len, body, 0 );
+    memcpy( map + head_len + array_len, tail, tail_len );
+
+    if( munmap( map, (size_t) total ) != 0 )
+    {
+      state = ERROR_NOT_OPEN;
+    }
+  }
+  else
+  {
+    if( pwriteFully( fd, head, head_len, 0 ) != 0 )
+    {
+      state = ERROR_NOT_OPEN;
+    }
+    if( state == 0 )
+    {
+      state = writeBody( job, fd, 0, (off_t) head_len, body, 0 );
+    }
+    if( state == 0 && pwriteFully( fd, tail, tail_len, (off_t)( head_len + array_len ) ) != 0 )
+    {
+      state = ERROR_NOT_OPEN;
+    }
+  }
+
+  if( state != 0 )
+  {
+    snprintf( context, sizeof( context ), "write %s", what );
+    printSystemError( context, path );
+    close( fd );
+    discardTemp( job, temp_path );
+    return ERROR_NOT_OPEN;
+  }
+
+  if( close( fd ) != 0 )
+  {
+    snprintf( context, sizeof( context ), "close %s", what );
+    printSystemError( context, path );
+    discardTemp( job, temp_path );
+    return ERROR_NOT_OPEN;
+  }
+
+  if( job->incremental && replaceIfChanged( job, temp_path, path, what ) != WRITE_SUCCESS )
+  {
+    return ERROR_NOT_OPEN;
+  }
+
+  job->out_files++;
+  job->out_bytes += total;
+  return WRITE_SUCCESS;
+}
+
+
+/** Growable in-memory text used to assemble the fixed parts of an output file.
+ */
+typedef struct
+{
+  FILE*   fp;
+  char*   text;
+  size_t  len;
+} text_buf_t;
+
+
+static int textOpen( text_buf_t* t )
+{
+  t->text = 0;
+  t->len = 0;
+  t->fp = open_memstream( &t->text, &t->len );
+
+  return ( t->fp == 0 ) ? -1 : 0;
+}
+
+
+static int textClose( text_buf_t* t )
+{
+  int bad = ( t->fp == 0 ) || ( ferror( t->fp ) != 0 );
+
+  if( t->fp != 0 && fclose( t->fp ) != 0 )
+  {
+    bad = 1;
+  }
+  t->fp = 0;
+
+  return bad ? -1 : 0;
+}
+
+
+static void textFree( text_buf_t* t )
+{
+  if( t->fp != 0 )
+  {
+    fclose( t->fp );
+    t->fp = 0;
+  }
+  free( t->text );
+  t->text = 0;
+}
+
+
+/** C type of an array element of the given width.
+ */
+static const char* wordTypeName( uint8_t word_bytes )
+{
+  switch( word_bytes )
+  {
+    case 2:
+      return "uint16_t";
+    case 4:
+      return "uint32_t";
+    case 8:
+      return "uint64_t";
+    default:
+      return "uint8_t";
+  }
+}
+
+
+/** Write a path as the body of an assembler string literal.
+ */
+static void printAsmString( FILE* fp, const char* text )
+{
+  for( ; *text != '\0'; text++ )
+  {
+    if( *text == '"' || *text == '\\' )
+    {
+      fputc( '\\', fp );
+    }
+    fputc( *text, fp );
+  }
+}
+
+
+/** Make a path absolute by resolving its directory, so the file itself need
+ *  not exist yet (a sidecar may still be in its temp file).
+ *
+ * @param path file path as given
+ * @param abs_path receives the absolute path
+ * @param abs_path_sz size of abs_path
+ * @retval int 0 on success, -1 when the directory cannot be resolved or the result is too long
+ */
+static int buildAbsolutePath( const char* path, char* abs_path, size_t abs_path_sz )
+{
+  const char* name = getFilenamePart( path );
+  char dir[PATH_MAX];
+  char resolved[PATH_MAX];
+  size_t dir_len = (size_t)( name - path );
+  size_t len;
+  int written;
+
+  if( dir_len >= sizeof( dir ) )
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memcpy( dir, path, dir_len );
+  dir[ dir_len ] = '\0';
+  if( realpath( ( dir_len != 0 ) ? dir : ".", resolved ) == 0 )
+  {
+    return -1;
+  }
+
+  len = strlen( resolved );
+  written = snprintf( abs_path, abs_path_sz, "%s%s%s", resolved,
+                      ( len != 0 && resolved[ len - 1 ] == '/' ) ? "" : "/", name );
+
+  if( written < 0 || (size_t) written >= abs_path_sz )
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/** Write the .S of --incbin output, plus the sidecar .bin when the payload
+ *  no longer matches the input bytes.
+ *
+ * The input file is included as is when it already holds the array in
+ * little-endian target order.  ADPCM output, padded input, big-endian
+ * words and stdin go through a sidecar .bin written next to the header.
+ * Paths in .incbin are absolute, so the .S assembles from any directory.
+ *
+ * @param job conversion whose payload is written
+ * @param output_file header path
+ * @param varname array name, also the assembler symbol
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @retval int WRITE_SUCCESS or ERROR_NOT_OPEN
+ */
+static int writeIncbinOutput( r2h_job_t* job, const char* output_file, const char* varname, uint8_t word_bytes )
+{
+  char asm_file[512] = {0};
+  char bin_file[512] = {0};
+  char data_file[PATH_MAX];
+  const char* include_file = job->input_path;
+  text_buf_t text;
+  int state;
+
+  if( job->adpcm_enabled || ( word_bytes > 1 && job->bigendian ) || job->table_size != job->input_size
+      || !job->input_named )
+  {
+    if( buildSidecarPath( output_file, bin_file, sizeof( bin_file ) ) != 0 )
+    {
+      fprintf( stderr, "Error: output filename is too long to derive the data file path.\n" );
+      return ERROR_NOT_OPEN;
+    }
+
+    printProgress( job, "BF: %s\n", bin_file );
+    state = writeOutputText( job, bin_file, "output data", "output data file", 0, 0, BODY_BINARY, 0, 0 );
+    if( state != WRITE_SUCCESS )
+    {
+      return state;
+    }
+    include_file = bin_file;
+  }
+
+  if( buildAbsolutePath( include_file, data_file, sizeof( data_file ) ) != 0 )
+  {
+    printSystemError( "resolve the directory of", include_file );
+    return ERROR_NOT_OPEN;
+  }
+
+  if( buildIncbinPath( output_file, asm_file, sizeof( asm_file ) ) != 0 )
+  {
+    fprintf( stderr, "Error: output filename is too long to derive the assembly path.\n" );
+    return ERROR_NOT_OPEN;
+  }
+
+  printProgress( job, "SF: %s\n", asm_file );
+
+  if( textOpen( &text ) != 0 )
+  {
+    printSystemError( "assemble output assembly", asm_file );
+    return ERROR_NOT_OPEN;
+  }
+
+  if( job->generated_with[0] != '\0' )
+  {
+    fprintf( text.fp, "/* Generated by raw2header %s with: %s */\n\n", RAW2HEADER_VERSION, job->generated_with );
+  }
+  if( word_bytes > 1 )
+  {
+    fprintf( text.fp, "#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__\n" );
+    fprintf( text.fp, "#error \"%s holds little-endian %s words\"\n", varname, wordTypeName( word_bytes ) );
+    fprintf( text.fp, "#endif\n\n" );
+  }
+  fprintf( text.fp, "  .section .rodata.%s,\"a\",%%progbits\n", varname );
+  fprintf( text.fp, "  .global %s\n", varname );
+  fprintf( text.fp, "  .type %s, %%object\n", varname );
+  fprintf( text.fp, "  .balign %u\n", ( word_bytes > 4 ) ? (unsigned) word_bytes : 4u );
+  fprintf( text.fp, "%s:\n", varname );
+  fprintf( text.fp, "  .incbin \"" );
+  printAsmString( text.fp, data_file );
+  fprintf( text.fp, "\"\n" );
+  fprintf( text.fp, "  .size %s, . - %s\n\n", varname, varname );
+  fprintf( text.fp, "  .section .note.GNU-stack,\"\",%%progbits\n" );
+
+  if( textClose( &text ) != 0 )
+  {
+    printSystemError( "assemble output assembly", asm_file );
+    textFree( &text );
+    return ERROR_NOT_OPEN;
+  }
+
+  state = writeOutputText( job, asm_file, "output assembly", "output assembly file",
+                           text.text, text.len, BODY_NONE, 0, 0 );
+  textFree( &text );
+
+  return state;
+}
+
+
+/** Print the start of an array definition, up to the first element.
+ *
+ * In embed mode the elements come from #embed of the sidecar when the
+ * compiler can find it, with the hex list kept as the fallback.
+ */
+static void printArrayOpen( const r2h_job_t* job, FILE* fp, const char* type, const char* varname,
+                            const char* name, const char* embed_file )
+{
+  if( job->embed_enabled )
+  {
+    fprintf( fp, "#if defined( __has_embed )\n" );
+    fprintf( fp, "#if __has_embed( \"%s\" ) == __STDC_EMBED_FOUND__\n", getFilenamePart( embed_file ) );
+    fprintf( fp, "#define %s_EMBED\n", name );
+    fprintf( fp, "#endif\n" );
+    fprintf( fp, "#endif\n\n" );
+  }
+
+  if( job->string_enabled )
+  {
+    // The array size leaves out the terminating NUL of the literal, which
+    // newer compilers warn about unless the array is marked as no string.
+    fprintf( fp, "#if defined( __has_attribute )\n" );
+    fprintf( fp, "#if __has_attribute( nonstring )\n" );
+    fprintf( fp, "#define %s_NONSTRING __attribute__(( nonstring ))\n", name );
+    fprintf( fp, "#endif\n" );
+    fprintf( fp, "#endif\n" );
+    fprintf( fp, "#ifndef %s_NONSTRING\n", name );
+    fprintf( fp, "#define %s_NONSTRING\n", name );
+    fprintf( fp, "#endif\n\n" );
+    fprintf( fp, "const %s %s[ %s_SZ ] %s_NONSTRING =\n", type, varname, name, name );
+    return;
+  }
+
+  fprintf( fp, "const %s %s[ %s_SZ ] =\n{\n", type, varname, name );
+
+  if( job->embed_enabled )
+  {
+    fprintf( fp, "#ifdef %s_EMBED\n", name );
+    fprintf( fp, "#embed \"%s\"\n", getFilenamePart( embed_file ) );
+    fprintf( fp, "#else\n" );
+  }
+}
+
+
+/** Print the end of an array definition opened by printArrayOpen().
+ */
+static void printArrayClose( const r2h_job_t* job, FILE* fp )
+{
+  if( job->string_enabled )
+  {
+    fprintf( fp, "\";\n" );
+    return;
+  }
+
+  fprintf( fp, "\n" );
+  if( job->embed_enabled )
+  {
+    fprintf( fp, "#endif\n" );
+  }
+  fprintf( fp, "};\n" );
+}
+
+
+/** Print the ADPCM seek table that follows the array, if there is one.
+ *
+ * Entry k holds { predictor, step index } per channel for decoding from byte
+ * k * NAME_SEEK_INTERVAL * channels / 2 of the array.
+ */
+static void printSeekTable( const r2h_job_t* job, FILE* fp, const char* varname, const char* name )
+{
+  int channels = ( job->channelmode == MODE_STEREO ) ? 2 : 1;
+
+  if( job->adpcm_seek_table == 0 )
+  {
+    return;
+  }
+
+  fprintf( fp, "\n/* Decoder state every %s_SEEK_INTERVAL frames: { predictor, step index } per channel.\n", name );
+  fprintf( fp, "   Entry k resumes decoding at byte k * %s_SEEK_INTERVAL * %d / 2. */\n", name, channels );
+  fprintf( fp, "const int16_t %s_seek[ %s_SEEK_COUNT ][ %d ][ 2 ] =\n{\n", varname, name, channels );
+  for( size_t k = 0; k < job->adpcm_seek_count; k++ )
+  {
+    const ima_adpcm_snapshot_t* point = &job->adpcm_seek_table[k];
+
+    fprintf( fp, "  { { %d, %u }", point->predictor[0], (unsigned) point->index[0] );
+    if( channels == 2 )
+    {
+      fprintf( fp, ", { %d, %u }", point->predictor[1], (unsigned) point->index[1] );
+    }
+    fprintf( fp, " }%s\n", ( k + 1 < job->adpcm_seek_count ) ? "," : "" );
+  }
+  fprintf( fp, "};\n" );
+}
+
+
+/** Write the relocatable object of --emit-object output.
+ *
+ * The payload is written in target order, as for the --incbin sidecar,
+ * between the ELF header and the tables laid out by buildElfObject().
+ *
+ * @param job conversion whose payload is written
+ * @param output_file header path, the object goes next to it with a .o extension
+ * @param varname array name, also the object symbol
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @retval int WRITE_SUCCESS or ERROR_NOT_OPEN
+ */
+static int writeObjectOutput( r2h_job_t* job, const char* output_file, const char* varname, uint8_t word_bytes )
+{
+  const elf_target_t* target = findElfTarget( job->elf_target );
+  char obj_file[512] = {0};
+  elf_object_t obj;
+  int state;
+
+  if( target == 0 )
+  {
+    fprintf( stderr, "Error: no default object target for this host, use --emit-object=TARGET.\n" );
+    return ERROR_NOT_OPEN;
+  }
+  if( target->elf_class == ELF_CLASS_32 && (uint64_t) job->table_size > UINT32_MAX )
+  {
+    fprintf( stderr, "Error: payload is too large for a 32-bit object.\n" );
+    return ERROR_NOT_OPEN;
+  }
+  if( buildObjectPath( output_file, obj_file, sizeof( obj_file ) ) != 0 )
+  {
+    fprintf( stderr, "Error: output filename is too long to derive the object path.\n" );
+    return ERROR_NOT_OPEN;
+  }
+
+  printProgress( job, "OBJ: %s (%s)\n", obj_file, target->name );
+
+  if( buildElfObject( target, job->elf_flags_set ? job->elf_flags : target->flags,
+                      ( job->object_section != 0 ) ? job->object_section : ".rodata",
+                      varname, (uint64_t) job->table_size, word_bytes, &obj ) != 0 )
+  {
+    printSystemError( "assemble output object", obj_file );
+    return ERROR_NOT_OPEN;
+  }
+
+  state = writeOutputText( job, obj_file, "output object", "output object file",
+                           obj.head, obj.head_len, BODY_BINARY, obj.tail, obj.tail_len );
+  freeElfObject( &obj );
+
+  return state;
+}
+
+
+/** Write the header (and in source-pair mode the paired .c, in incbin mode the
+ *  .S and any sidecar .bin, in embed mode the .bin for #embed, in object mode
+ *  the .o) for the payload.
+ *
+ * @param job conversion whose payload is written
+ * @param output_file header path
+ * @param varname array name
+ * @param word_bytes element width in bytes, 1, 2, 4 or 8
+ * @retval int WRITE_SUCCESS or ERROR_NOT_OPEN
+ */
+static int writeArrayOutput( r2h_job_t* job, const char* output_file, const char* varname, uint8_t word_bytes )
+{
+  const char* type = wordTypeName( word_bytes );
+  uint8_t body = job->string_enabled ? BODY_STRING : word_bytes;
+  char* st_p;
+  char outp_header_name[255] = {0};
+  char source_file[512] = {0};
+  char embed_file[512] = {0};
+  text_buf_t head;
+  text_buf_t tail;
+  int state;
+
+  strncpy( outp_header_name, varname, 254 );
+  outp_header_name[254] = '\0';
+
+  st_p = (char*) outp_header_name;
+  while( *st_p != 0 )
+  {
+    *st_p = toupper( *st_p );
+    st_p++;
+  }
+
+  if( job->embed_enabled )
+  {
+    if( buildSidecarPath( output_file, embed_file, sizeof( embed_file ) ) != 0 )
+    {
+      fprintf( stderr, "Error: output filename is too long to derive the data file path.\n" );
+      return ERROR_NOT_OPEN;
+    }
+
+    printProgress( job, "BF: %s\n", embed_file );
+    state = writeOutputText( job, embed_file, "output data", "output data file", 0, 0, BODY_BINARY, 0, 0 );
+    if( state != WRITE_SUCCESS )
+    {
+      return state;
+    }
+  }
+
+  printProgress( job, "OF: %s\n", output_file );
+
+  if( textOpen( &head ) != 0 )
+  {
+    printSystemError( "assemble output header", output_file );
+    return ERROR_NOT_OPEN;
+  }
+  if( textOpen( &tail ) != 0 )
+  {
+    printSystemError( "assemble output header", output_file );
+    textFree( &head );
+    return ERROR_NOT_OPEN;
+  }
+
+  fprintf( head.fp, "#ifndef _%s_H\n", outp_header_name );
+  fprintf( head.fp, "#define _%s_H\n\n", outp_header_name );
+  if( word_bytes > 1 )
+  {
+    fprintf( head.fp, "#define %s_%s\n", outp_header_name, ( job->bigendian == 1 ) ? "BIG_ENDIAN" : "LITTLE_ENDIAN" );
+  }
+  fprintf( head.fp, "#include <stdint.h>\n\n" );
+  if( job->generated_with[0] != '\0' )
+  {
+    fprintf( head.fp, "/* Generated by raw2header %s with: %s */\n\n", RAW2HEADER_VERSION, job->generated_with );
+  }
+  if( job->channelmode != MODE_NONE )
+  {
+    fprintf( head.fp, "#define %s_PB_FMT Mode_%s%s\n", outp_header_name,
+             ( job->channelmode == MODE_MONO ) ? "mono" : "stereo", job->adpcm_enabled ? "_ADPCM" : "" );
+  }
+  if( job->adpcm_seek_table != 0 )
+  {
+    fprintf( head.fp, "#define %s_SEEK_INTERVAL %u\n", outp_header_name, (unsigned) job->adpcm_seek );
+    fprintf( head.fp, "#define %s_SEEK_COUNT %zu\n", outp_header_name, job->adpcm_seek_count );
+  }
+  if( job->adpcm_enabled && job->adpcm_block != 0 )
+  {
+    int channels = ( job->channelmode == MODE_STEREO ) ? 2 : 1;
+
+    fprintf( head.fp, "#define %s_ADPCM_BLOCK_SAMPLES %u\n", outp_header_name, (unsigned) job->adpcm_block );
+    fprintf( head.fp, "#define %s_ADPCM_BLOCK_BYTES %zu\n", outp_header_name,
+             ima_adpcm_block_bytes( job->adpcm_block, channels ) );
+    fprintf( head.fp, "#define %s_ADPCM_SAMPLES %llu\n", outp_header_name,
+             (unsigned long long) job->adpcm_frames );
+  }
+  fprintf( head.fp, "#define %s_SZ %lli\n\n", outp_header_name, ( long long )( job->table_size / word_bytes ) );
+
+  if( !job->sourcepair_enabled && !job->incbin_enabled && !job->object_enabled )
+  {
+    printArrayOpen( job, head.fp, type, varname, outp_header_name, embed_file );
+    printArrayClose( job, tail.fp );
+    printSeekTable( job, tail.fp, varname, outp_header_name );
+    fprintf( tail.fp, "\n" );
+    fprintf( tail.fp, "#endif // End of _%s_H\n", outp_header_name );
+
+    if( textClose( &head ) != 0 || textClose( &tail ) != 0 )
+    {
+      printSystemError( "assemble output file", output_file );
+      textFree( &head );
+      textFree( &tail );
+      return ERROR_NOT_OPEN;
+    }
+
+    state = writeOutputText( job, output_file, "output file", "output file",
+                             head.text, head.len, body, tail.text, tail.len );
+    textFree( &head );
+    textFree( &tail );
+    return state;
+  }
+
+  fprintf( head.fp, "extern const %s %s[ %s_SZ ];\n\n", type, varname, outp_header_name );
+  if( job->adpcm_seek_table != 0 )
+  {
+    fprintf( head.fp, "extern const int16_t %s_seek[ %s_SEEK_COUNT ][ %d ][ 2 ];\n\n", varname, outp_header_name,
+             ( job->channelmode == MODE_STEREO ) ? 2 : 1 );
+  }
+  if( job->object_enabled )
+  {
+    fprintf( head.fp, "extern const uintptr_t %s_size;\n\n", varname );
+  }
+  fprintf( head.fp, "#endif // End of _%s_H\n", outp_header_name );
+
+  if( textClose( &head ) != 0 )
+  {
+    printSystemError( "assemble output header", output_file );
+    textFree( &head );
+    textFree( &tail );
+    return ERROR_NOT_OPEN;
+  }
+
+  state = writeOutputText( job, output_file, "output header", 0, head.text, head.len, BODY_NONE, 0, 0 );
+  textFree( &head );
+  if( state != WRITE_SUCCESS || job->incbin_enabled || job->object_enabled )
+  {
+    textFree( &tail );
+    if( state == WRITE_SUCCESS && job->incbin_enabled )
+    {
+      state = writeIncbinOutput( job, output_file, varname, word_bytes );
+    }
+    else if( state == WRITE_SUCCESS )
+    {
+      state = writeObjectOutput( job, output_file, varname, word_bytes );
+    }
+    return state;
+  }
+
+  if( buildSourcePath( output_file, source_file, sizeof( source_file ) ) != 0 )
+  {
+    fprintf( stderr, "Error: output filename is too long to derive source pair path.\n" );
+    textFree( &tail );
+    return ERROR_NOT_OPEN;
+  }
+
+  printProgress( job, "CF: %s\n", source_file );
+
+  if( textOpen( &head ) != 0 )
+  {
+    printSystemError( "assemble output source", source_file );
+    textFree( &tail );
+    return ERROR_NOT_OPEN;
+  }
+
+  fprintf( head.fp, "#include \"%s\"\n\n", getFilenamePart( output_file ) );
+  printArrayOpen( job, head.fp, type, varname, outp_header_name, embed_file );
+  printArrayClose( job, tail.fp );
+  printSeekTable( job, tail.fp, varname, outp_header_name );
+
+  if( textClose( &head ) != 0 || textClose( &tail ) != 0 )
+  {
+    printSystemError( "assemble output source", source_file );
+    textFree( &head );
+    textFree( &tail );
+    return ERROR_NOT_OPEN;
+  }
+
+  state = writeOutputText( job, source_file, "output source", "output source file",
+                           head.text, head.len, body, tail.text, tail.len );
+  textFree( &head );
+  textFree( &tail );
+  return state;
+}
+
+
+/** Write a file given the filename passed containing the specified varname as a header.
+ *
+ * @param job conversion whose payload is written
+ * @param char* output_file
+ * @retval int status
+ */
+int writeFile( r2h_job_t* job, const char* output_file, const char* varname )
+{
+  return writeArrayOutput( job, output_file, varname, 1 );
+}
+
+
+/** Write a file given the filename passed containing the specified varname as a header
+ *  as a 16 bit array
+ *
+ * @param job conversion whose payload is written
+ * @param char* output_file
+ * @retval int status
+ */
+int writeFile16( r2h_job_t* job, const char* output_file, const char* varname )
+{
+  return writeArrayOutput( job, output_file, varname, 2 );
+}
+
+
+/** Write a file given the filename passed containing the specified varname as a header
+ *  as a 32 bit array
+ *
+ * @param job conversion whose payload is written
+ * @param char* output_file
+ * @retval int status
+ */
+int writeFile32( r2h_job_t* job, const char* output_file, const char* varname )
+{
+  return writeArrayOutput( job, output_file, varname, 4 );
+}
+
+
+/** Write a file given the filename passed containing the specified varname as a header
+ *  as a 64 bit array
+ *
+ * @param job conversion whose payload is written
+ * @param char* output_file
+ * @retval int status
+ */
+int writeFile64( r2h_job_t* job, const char* output_file, const char* varname )
+{
+  return writeArrayOutput( job, output_file, varname, 8 );
+}
+
+
+/** Write the target-side ADPCM decoder header next to an output header.
+ *
+ * Manifest workers converting into one directory share the file, so the
+ * writes are serialised; in incremental mode the later ones leave it alone.
+ *
+ * @param job conversion the decoder belongs to
+ * @param output_file normalized output header path
+ * @retval int WRITE_SUCCESS or ERROR_NOT_OPEN
+ */
+int writeAdpcmDecoder( r2h_job_t* job, const char* output_file )
+{
+  static pthread_mutex_t decoder_lock = PTHREAD_MUTEX_INITIALIZER;
+  char decoder_file[512] = {0};
+  const char* text;
+  size_t len;
+  int state;
+
+  if( buildDecoderPath( output_file, decoder_file, sizeof( decoder_file ) ) != 0 )
+  {
+    fprintf( stderr, "Error: output filename is too long to derive the decoder path.\n" );
+    return ERROR_NOT_OPEN;
+  }
+
+  text = adpcmDecoderText( &len );
+  printProgress( job, "DF: %s\n", decoder_file );
+  pthread_mutex_lock( &decoder_lock );
+  state = writeOutputText( job, decoder_file, "ADPCM decoder", 0, text, len, BODY_NONE, 0, 0 );
+  pthread_mutex_unlock( &decoder_lock );
+
+  return state;
+}
 
-  if( dot != 0 && ( slash == 0 || dot > slash ) )
-  {
-    base_len = (size_t)( dot - header_path );
-  }
 
-  if( base_len + 3 >= source_path_sz )
+/** Bytes getRaw() reserves after the input: room for --pad to complete the
+  * last word, so padding never has to grow the buffer.
+  */
+static size_t planHeadroom( const r2h_job_t* job )
+{
+  if( !job->pad_enabled || job->adpcm_enabled )
   {
-    return -1;
+    return 0;
   }
-
-  memcpy( source_path, header_path, base_len );
-  source_path[ base_len ] = '\0';
-  strcat( source_path, ".c" );
-
-  return 0;
+  return ( (size_t) 1 << job->wordmode ) - 1;
 }
 
 
-/** Get the size of the named file
+/** Map the input private and writable with room bytes of zeroes after it.
   *
-  * @param file_to_size
-  * @retval off_t file size.  -1 if invalid in any way
+  * The headroom is an anonymous mapping with the file mapped over its start,
+  * so neither part is copied until a page is written.
   *
+  * @retval void* the mapping, or MAP_FAILED
   */
-off_t getFileSize( char* file_to_size )
+static void* mapWithHeadroom( int fd, size_t size, size_t room )
 {
-  long int fsize;
-  FILE* rawfile_p;
+  void* base;
+  void* map;
 
-  rawfile_p = fopen( file_to_size, "rb" );
-  if( rawfile_p == NULL )
+  if( room == 0 )
   {
-    printSystemError( "open input file", file_to_size );
-    return FILE_NOT_FOUND;
+    return mmap( 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
   }
 
-  if( fseek( rawfile_p, 0L, SEEK_END ) != 0 )
-  {
-    printSystemError( "seek input file", file_to_size );
-    fclose( rawfile_p );
-    return ERROR_NOT_OPEN;
-  }
-  fsize = ftell( rawfile_p );
-  if( fsize < 0 )
+  base = mmap( 0, size + room, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( base == MAP_FAILED )
   {
-    printSystemError( "tell input file size", file_to_size );
-    fclose( rawfile_p );
-    return ERROR_NOT_OPEN;
+    return MAP_FAILED;
   }
 
-  if( fclose( rawfile_p ) != 0 )
+  map = mmap( base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 );
+  if( map == MAP_FAILED )
   {
-    printSystemError( "close input file", file_to_size );
-    return ERROR_NOT_OPEN;
+    munmap( base, size + room );
   }
-
-  return fsize;
+  return map;
 }
 
 
-/** Write a file given the filename passed containing the specified varname as a header.
- *
- * @param char* output_file
- * @retval int status
- */
-int writeFile( char* output_file, char* varname )
+/** Read a descriptor that cannot be mapped up to its end into one heap buffer.
+  *
+  * The buffer doubles as it fills and keeps room bytes spare after the data,
+  * as getRaw() would have planned.
+  *
+  * @param job conversion to load the payload into
+  * @param fd descriptor to read
+  * @param input_name name used in messages
+  * @param room headroom to keep after the data
+  * @retval int status code
+  */
+static int readToEnd( r2h_job_t* job, int fd, const char* input_name, size_t room )
 {
-  char* st_p;
-  char outp_header_name[255] = {0};
-  FILE* headerfile_p;
-  FILE* sourcefile_p = 0;
-
-  strncpy( outp_header_name, varname, 254 );
-  outp_header_name[254] = '\0';
-
-  st_p = (char*) outp_header_name;
-  while( *st_p != 0 )
-  {
-    *st_p = toupper( *st_p );
-    st_p++;
-  }
+  size_t cap = READ_GROW_MIN;
+  size_t len = 0;
+  int8_t* buf = malloc( cap );
 
-  printf( "OF: %s\n", output_file );
-
-  headerfile_p = fopen( output_file, "w" );
-  if( headerfile_p == 0 )
+  for( ;; )
   {
-    printSystemError( "open output header", output_file );
-    return ERROR_NOT_OPEN;
-  }
+    ssize_t got;
 
-  fprintf( headerfile_p, "#ifndef _%s_H\n", outp_header_name );
-  fprintf( headerfile_p, "#define _%s_H\n\n", outp_header_name );
-  fprintf( headerfile_p, "#include <stdint.h>\n\n" );
-  if( g_generated_with[0] != '\0' )
-  {
-    fprintf( headerfile_p, "/* Generated by raw2header V3.01.0 with: %s */\n\n", g_generated_with );
-  }
-  if( channelmode != MODE_NONE )
-  {
-    if( adpcm_enabled )
+    if( buf == 0 )
     {
-      fprintf( headerfile_p, "#define %s_PB_FMT Mode_%s_ADPCM\n", outp_header_name,
-               ( channelmode == MODE_MONO ) ? "mono" : "stereo" );
+      fprintf( stderr, "Error: failed to allocate %zu bytes.\n", cap );
+      return NO_MALLOC;
     }
-    else
+    if( cap - len <= room )
     {
-      fprintf( headerfile_p, "#define %s_PB_FMT Mode_%s\n", outp_header_name,
-               ( channelmode == MODE_MONO ) ? "mono" : "stereo" );
-    }
-  }
-  fprintf( headerfile_p, "#define %s_SZ %lli\n\n", outp_header_name, ( long long )table_size );
-
-  if( sourcepair_enabled )
-  {
-    char source_file[512] = {0};
-    const char* header_include = getFilenamePart( output_file );
-
-    fprintf( headerfile_p, "extern const uint8_t %s[ %s_SZ ];\n\n", varname, outp_header_name );
-    fprintf( headerfile_p, "#endif // End of _%s_H\n", outp_header_name );
+      int8_t* grown = realloc( buf, cap * 2 );
 
-    if( ferror( headerfile_p ) != 0 )
-    {
-      printSystemError( "write output header", output_file );
-      fclose( headerfile_p );
-      return ERROR_NOT_OPEN;
+      if( grown == 0 )
+      {
+        free( buf );
+      }
+      buf = grown;
+      cap *= 2;
+      continue;
     }
-    if( fclose( headerfile_p ) != 0 )
+
+    got = read( fd, buf + len, cap - room - len );
+    if( got < 0 && errno == EINTR )
     {
-      printSystemError( "close output header", output_file );
-      return ERROR_NOT_OPEN;
+      continue;
     }
-
-    if( buildSourcePath( output_file, source_file, sizeof( source_file ) ) != 0 )
+    if( got < 0 )
     {
-      fprintf( stderr, "Error: output filename is too long to derive source pair path.\n" );
+      printSystemError( "read input file", input_name );
+      free( buf );
       return ERROR_NOT_OPEN;
     }
-
-    printf( "CF: %s\n", source_file );
-    sourcefile_p = fopen( source_file, "w" );
-    if( sourcefile_p == 0 )
+    if( got == 0 )
     {
-      printSystemError( "open output source", source_file );
-      return ERROR_NOT_OPEN;
+      break;
     }
+    len += (size_t) got;
+  }
 
-    fprintf( sourcefile_p, "#include \"%s\"\n\n", header_include );
-    fprintf( sourcefile_p, "const uint8_t %s[ %s_SZ ] =\n{\n", varname, outp_header_name );
-
-    for( long int element = 0; element < table_size; element++ )
-    {
-      if( element % NUM_COLUMNS == 0 )
-      {
-        fprintf( sourcefile_p, " " );
-      }
+  if( len == 0 )
+  {
+    fprintf( stderr, "Error: empty file.\n" );
+    free( buf );
+    return EMPTY_FILE;
+  }
+  printProgress( job, "Size of input file: %zu\n", len );
 
-      fprintf( sourcefile_p, " 0x%02X", (uint8_t) rawdata_p[ element ] );
+  job->rawdata_p = buf;
+  job->table_size = (off_t) len;
+  job->input_size = job->table_size;
 
-      if( element < ( table_size - 1 ) )
-      {
-        fprintf( sourcefile_p, "," );
-      }
+  return READ_SUCCESS;
+}
 
-      if( element % NUM_COLUMNS == NUM_COLUMNS - 1 )
-      {
-        fprintf( sourcefile_p, "\n" );
-      }
-    }
-    fprintf( sourcefile_p, "\n};\n" );
 
-    printf( "Size of output source file: %li\n", ftell( sourcefile_p ) );
-    if( ferror( sourcefile_p ) != 0 )
-    {
-      printSystemError( "write output source", source_file );
-      fclose( sourcefile_p );
-      return ERROR_NOT_OPEN;
-    }
-    if( fclose( sourcefile_p ) != 0 )
-    {
-      printSystemError( "close output source", source_file );
-      return ERROR_NOT_OPEN;
-    }
+/** Read in the file to be converted to the header
+  *
+  * Opens the file and loads it with getRawFd(); "-" reads stdin.  Call
+  * releaseRaw() to drop it.
+  *
+  * @param job conversion to load the payload into
+  * @param char* input filename to read
+  * @retval int status code
+  */
+int getRaw( r2h_job_t* job, const char* input_file )
+{
+  int state;
+  int fd;
 
-    return WRITE_SUCCESS;
+  if( input_file == 0 || strlen( input_file ) < 1 )
+  {
+    fprintf( stderr, "Error: invalid input filename.\n" );
+    return INVALID_FN;
   }
+  printProgress( job, "IF: %s.  ", input_file );
 
-  fprintf( headerfile_p, "const uint8_t %s[ %s_SZ ] =\n{\n", varname, outp_header_name );
-
-  for( long int element = 0; element < table_size; element++ )
+  if( strcmp( input_file, "-" ) == 0 )
   {
-    if( element % NUM_COLUMNS == 0 )
-    {
-      fprintf( headerfile_p, " " );
-    }
-
-    fprintf( headerfile_p, " 0x%02X", (uint8_t) rawdata_p[ element ] );
-
-    if( element < ( table_size - 1 ) )
-    {
-      fprintf( headerfile_p, "," );
-    }
-
-    if( element % NUM_COLUMNS == NUM_COLUMNS - 1 )
-    {
-      fprintf( headerfile_p, "\n" );
-    }
+    return getRawFd( job, STDIN_FILENO, "stdin" );
   }
-  fprintf( headerfile_p, "\n};\n\n" );
-  fprintf( headerfile_p, "#endif // End of _%s_H\n", outp_header_name );
 
-  printf( "Size of output file: %li\n", ftell( headerfile_p ) );
-  if( ferror( headerfile_p ) != 0 )
+  fd = open( input_file, O_RDONLY );
+  if( fd < 0 )
   {
-    printSystemError( "write output file", output_file );
-    fclose( headerfile_p );
+    printSystemError( "open input file", input_file );
     return ERROR_NOT_OPEN;
   }
 
-  if( fclose( headerfile_p ) != 0 )
+  state = getRawFd( job, fd, input_file );
+  job->input_named = 1;
+  if( close( fd ) != 0 && state == READ_SUCCESS )
   {
-    printSystemError( "close output file", output_file );
+    printSystemError( "close input file", input_file );
+    releaseRaw( job );
     return ERROR_NOT_OPEN;
   }
 
-  return WRITE_SUCCESS;
+  return state;
 }
 
 
-/** Write a file given the filename passed containing the specified varname as a header
- *  as a 16 bit array
- *
- * @param char* output_file
- * @retval int status
- */
-int writeFile16( char* output_file, char* varname )
+/** Load the payload from an open descriptor, which stays open.
+  *
+  * The payload buffer is planned once here: a regular file read from its
+  * start is mapped private and writable, with headroom after it for --pad,
+  * so the emitters work straight from the page cache and in-place transforms
+  * (padding, byte swaps, ADPCM) only copy the pages they touch.  Falls back
+  * to one heap buffer of the same size when the file cannot be mapped, and
+  * reads pipes and other descriptors up to their end.  Call releaseRaw() to
+  * drop it.
+  *
+  * @param job conversion to load the payload into
+  * @param fd descriptor to read
+  * @param input_name name used in messages
+  * @retval int status code
+  */
+int getRawFd( r2h_job_t* job, int fd, const char* input_name )
 {
-  char* st_p;
-  char outp_header_name[255] = {0};
-  FILE* headerfile_p;
-  FILE* sourcefile_p = 0;
-
-  strncpy( outp_header_name, varname, 254 );
-  outp_header_name[254] = '\0';
+  struct stat st;
+  size_t room = planHeadroom( job );
+  void* map;
 
-  st_p = (char*) outp_header_name;
-  while( *st_p != 0 )
+  if( fstat( fd, &st ) != 0 )
   {
-    *st_p = toupper( *st_p );
-    st_p++;
+    printSystemError( "stat input file", input_name );
+    return ERROR_NOT_OPEN;
   }
 
-  printf( "OF: %s\n", output_file );
+  job->input_path = input_name;
+  job->rawdata_room = room;
 
-  headerfile_p = fopen( output_file, "w" );
-  if( headerfile_p == 0 )
+  if( !S_ISREG( st.st_mode ) || lseek( fd, 0, SEEK_CUR ) != 0 )
   {
-    printSystemError( "open output header", output_file );
-    return ERROR_NOT_OPEN;
+    return readToEnd( job, fd, input_name, room );
   }
 
-  fprintf( headerfile_p, "#ifndef _%s_H\n", outp_header_name );
-  fprintf( headerfile_p, "#define _%s_H\n\n", outp_header_name );
-  fprintf( headerfile_p, "#define %s_", outp_header_name );
-  if( bigendian == 1 )
+  job->table_size = st.st_size;
+  if( job->table_size <= 0 )
   {
-    fprintf( headerfile_p, "BIG_ENDIAN\n" );
+    fprintf( stderr, "Error: empty file.\n" );
+    return EMPTY_FILE;
   }
   else
   {
-    fprintf( headerfile_p, "LITTLE_ENDIAN\n" );
+    printProgress( job, "Size of input file: %lli\n", ( long long )job->table_size );
   }
-  fprintf( headerfile_p, "#include <stdint.h>\n\n" );
-  if( g_generated_with[0] != '\0' )
+  job->input_size = job->table_size;
+
+  map = mapWithHeadroom( fd, (size_t) job->table_size, room );
+  if( map != MAP_FAILED )
   {
-    fprintf( headerfile_p, "/* Generated by raw2header V3.01.0 with: %s */\n\n", g_generated_with );
+#ifdef MADV_SEQUENTIAL
+    madvise( map, (size_t) job->table_size, MADV_SEQUENTIAL );
+#endif
+    job->rawdata_p = map;
+    job->rawdata_map_len = (size_t) job->table_size + room;
+    return READ_SUCCESS;
   }
-  if( channelmode != MODE_NONE )
+
+  job->rawdata_p = malloc( (size_t) job->table_size + room );
+  if( job->rawdata_p == 0 )
   {
-    if( adpcm_enabled )
-    {
-      fprintf( headerfile_p, "#define %s_PB_FMT Mode_%s_ADPCM\n", outp_header_name,
-               ( channelmode == MODE_MONO ) ? "mono" : "stereo" );
-    }
-    else
-    {
-      fprintf( headerfile_p, "#define %s_PB_FMT Mode_%s\n", outp_header_name,
-               ( channelmode == MODE_MONO ) ? "mono" : "stereo" );
-    }
+    fprintf( stderr, "Error: failed to allocate %lli bytes.\n", ( long long )job->table_size );
+    return NO_MALLOC;
   }
-  fprintf( headerfile_p, "#define %s_SZ %lli\n\n", outp_header_name, ( long long )( table_size / 2 ) );
 
-  if( sourcepair_enabled )
+  if( readFully( fd, (uint8_t*) job->rawdata_p, (size_t) job->table_size ) != 0 )
   {
-    char source_file[512] = {0};
-    const char* header_include = getFilenamePart( output_file );
-
-    fprintf( headerfile_p, "extern const uint16_t %s[ %s_SZ ];\n\n", varname, outp_header_name );
-    fprintf( headerfile_p, "#endif // End of _%s_H\n", outp_header_name );
+    printSystemError( "read input file", input_name );
+    free( job->rawdata_p );
+    job->rawdata_p = 0;
+    return ERROR_NOT_OPEN;
+  }
 
-    if( ferror( headerfile_p ) != 0 )
-    {
-      printSystemError( "write output header", output_file );
-      fclose( headerfile_p );
-      return ERROR_NOT_OPEN;
-    }
-    if( fclose( headerfile_p ) != 0 )
-    {
-      printSystemError( "close output header", output_file );
-      return ERROR_NOT_OPEN;
-    }
+  return READ_SUCCESS;
+}
 
-    if( buildSourcePath( output_file, source_file, sizeof( source_file ) ) != 0 )
-    {
-      fprintf( stderr, "Error: output filename is too long to derive source pair path.\n" );
-      return ERROR_NOT_OPEN;
-    }
 
-    printf( "CF: %s\n", source_file );
-    sourcefile_p = fopen( source_file, "w" );
-    if( sourcefile_p == 0 )
-    {
-      printSystemError( "open output source", source_file );
-      return ERROR_NOT_OPEN;
-    }
+/** Load the payload from memory the caller keeps, copying it once into a
+  * buffer with the same headroom getRaw() plans.
+  *
+  * @param job conversion to load the payload into
+  * @param data input bytes
+  * @param len number of input bytes
+  * @retval int status code
+  */
+int loadRaw( r2h_job_t* job, const void* data, size_t len )
+{
+  size_t room = planHeadroom( job );
 
-    fprintf( sourcefile_p, "#include \"%s\"\n\n", header_include );
-    fprintf( sourcefile_p, "const uint16_t %s[ %s_SZ ] =\n{\n", varname, outp_header_name );
+  if( data == 0 || len == 0 )
+  {
+    fprintf( stderr, "Error: empty file.\n" );
+    return EMPTY_FILE;
+  }
 
-    for( long int element = 0; element < table_size; element += 2 )
-    {
-      if( element % NUM_COLUMNS == 0 )
-      {
-        fprintf( sourcefile_p, " " );
-      }
+  job->rawdata_p = malloc( len + room );
+  if( job->rawdata_p == 0 )
+  {
+    fprintf( stderr, "Error: failed to allocate %zu bytes.\n", len );
+    return NO_MALLOC;
+  }
 
-      if( bigendian == 1 )
-      {
-        fprintf( sourcefile_p, " 0x%02X%02X", (uint8_t) rawdata_p[ element ], (uint8_t) rawdata_p[ element + 1 ] );
-      }
-      else
-      {
-        fprintf( sourcefile_p, " 0x%02X%02X", (uint8_t) rawdata_p[ element + 1 ], (uint8_t) rawdata_p[ element ] );
-      }
+  memcpy( job->rawdata_p, data, len );
+  job->table_size = (off_t) len;
+  job->input_size = job->table_size;
+  job->rawdata_room = room;
 
-      if( element < ( table_size - 2 ) )
-      {
-        fprintf( sourcefile_p, "," );
-      }
+  return READ_SUCCESS;
+}
 
-      if( ( element / 2 ) % NUM_COLUMNS == NUM_COLUMNS - 1 )
-      {
-        fprintf( sourcefile_p, "\n" );
-      }
-    }
-    fprintf( sourcefile_p, "\n};\n" );
 
-    printf( "Size of output source file: %li\n", ftell( sourcefile_p ) );
-    if( ferror( sourcefile_p ) != 0 )
-    {
-      printSystemError( "write output source", source_file );
-      fclose( sourcefile_p );
-      return ERROR_NOT_OPEN;
-    }
-    if( fclose( sourcefile_p ) != 0 )
-    {
-      printSystemError( "close output source", source_file );
-      return ERROR_NOT_OPEN;
-    }
+/** Make room for extra bytes after job->table_size in job->rawdata_p.
+  *
+  * The buffer getRaw() planned is already writable and has its headroom, so
+  * this only grows a heap buffer that is too small; a mapping that is too
+  * small is copied to the heap once.
+  *
+  * @param extra number of bytes needed past job->table_size
+  * @retval int 0 on success, NO_MALLOC on allocation failure
+  */
+int makeRawWritable( r2h_job_t* job, size_t extra )
+{
+  int8_t* copy;
 
-    return WRITE_SUCCESS;
+  if( extra <= job->rawdata_room )
+  {
+    return 0;
   }
 
-  fprintf( headerfile_p, "const uint16_t %s[ %s_SZ ] =\n{\n", varname, outp_header_name );
-
-  for( long int element = 0; element < table_size; element += 2 )
+  if( job->rawdata_map_len == 0 )
   {
-    if( element % NUM_COLUMNS == 0 )
+    copy = realloc( job->rawdata_p, (size_t) job->table_size + extra );
+    if( copy == 0 )
     {
-      fprintf( headerfile_p, " " );
-    }
-
-    if( bigendian == 1 )
-    {
-      fprintf( headerfile_p, " 0x%02X%02X", (uint8_t) rawdata_p[ element ], (uint8_t) rawdata_p[ element + 1 ] );
-    }
-    else
-    {
-      fprintf( headerfile_p, " 0x%02X%02X", (uint8_t) rawdata_p[ element + 1 ], (uint8_t) rawdata_p[ element ] );
-    }
-
-    if( element < ( table_size - 2 ) )
-    {
-      fprintf( headerfile_p, "," );
-    }
-
-    if( ( element / 2 ) % NUM_COLUMNS == NUM_COLUMNS - 1 )
-    {
-      fprintf( headerfile_p, "\n" );
+      return NO_MALLOC;
     }
+    job->rawdata_p = copy;
+    job->rawdata_room = extra;
+    return 0;
   }
-  fprintf( headerfile_p, "\n};\n\n" );
-  fprintf( headerfile_p, "#endif // End of _%s_H\n", outp_header_name );
 
-  printf( "Size of output file: %li\n", ftell( headerfile_p ) );
-  if( ferror( headerfile_p ) != 0 )
+  copy = malloc( (size_t) job->table_size + extra );
+  if( copy == 0 )
   {
-    printSystemError( "write output file", output_file );
-    fclose( headerfile_p );
-    return ERROR_NOT_OPEN;
+    return NO_MALLOC;
   }
 
-  if( fclose( headerfile_p ) != 0 )
-  {
-    printSystemError( "close output file", output_file );
-    return ERROR_NOT_OPEN;
-  }
+  memcpy( copy, job->rawdata_p, (size_t) job->table_size );
+  munmap( job->rawdata_p, job->rawdata_map_len );
+  job->rawdata_map_len = 0;
+  job->rawdata_p = copy;
+  job->rawdata_room = extra;
 
-  return WRITE_SUCCESS;
+  return 0;
 }
 
 
-/** Read in the file to be converted to the header
+/** Open the input for bounded-memory streaming instead of loading it.
   *
-  * @param char* input filename to read
+  * job->table_size is set from the file size so headers are identical to the
+  * in-memory path; the payload is read in chunks while it is written.  The
+  * chunk size is whatever remains of max_memory after the emitter buffer and
+  * lookup tables.
+  *
+  * @param job conversion to load the payload into
+  * @param char* input filename to read, "-" for stdin redirected from a file
+  * @param budget peak memory budget in bytes
   * @retval int status code
   */
-int getRaw( char* input_file )
+int openRawStream( r2h_job_t* job, const char* input_file, size_t budget )
 {
-  size_t count = 0;
-  FILE* rawfile_p;
+  struct stat st;
+  int fd;
 
   if( input_file == 0 || strlen( input_file ) < 1 )
   {
     fprintf( stderr, "Error: invalid input filename.\n" );
     return INVALID_FN;
   }
-  printf( "IF: %s.  ", input_file );
 
-  table_size = getFileSize( input_file );
+  if( budget < STREAM_OVERHEAD + STREAM_MIN_CHUNK )
+  {
+    fprintf( stderr, "Error: --max-memory must be at least %u bytes.\n",
+             (unsigned)( STREAM_OVERHEAD + STREAM_MIN_CHUNK ) );
+    return ARGUMENTS_ERROR;
+  }
+  printProgress( job, "IF: %s.  ", input_file );
 
-  if( table_size == FILE_NOT_FOUND )
+  // Streaming rewinds the input, so stdin has to be a file, and its own descriptor.
+  fd = ( strcmp( input_file, "-" ) == 0 ) ? dup( STDIN_FILENO ) : open( input_file, O_RDONLY );
+  if( fd < 0 )
   {
+    printSystemError( "open input file", input_file );
     return ERROR_NOT_OPEN;
   }
 
-  if( table_size <= 0 )
+  if( fstat( fd, &st ) != 0 )
   {
-    fprintf( stderr, "Error: empty file.\n" );
-    return EMPTY_FILE;
+    printSystemError( "stat input file", input_file );
+    close( fd );
+    return ERROR_NOT_OPEN;
   }
-  else
+
+  if( !S_ISREG( st.st_mode ) )
   {
-    printf( "Size of input file: %lli\n", ( long long )table_size );
+    fprintf( stderr, "Error: --max-memory needs a regular input file, '%s' is not one.\n", input_file );
+    close( fd );
+    return ERROR_NOT_OPEN;
   }
 
-  rawdata_p = malloc( table_size );
-
-  if( rawdata_p == 0 )
+  job->table_size = st.st_size;
+  if( job->table_size <= 0 )
   {
-    fprintf( stderr, "Error: failed to allocate %lli bytes.\n", ( long long )table_size );
-    return NO_MALLOC;
+    fprintf( stderr, "Error: empty file.\n" );
+    close( fd );
+    return EMPTY_FILE;
   }
-  rawfile_p = fopen( input_file, "rb" );
-  if( rawfile_p == NULL )
+  printProgress( job, "Size of input file: %lli\n", ( long long )job->table_size );
+  job->input_path = input_file;
+  job->input_named = ( strcmp( input_file, "-" ) != 0 );
+  job->input_size = job->table_size;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+
+  job->stream_fd = fd;
+  job->stream_len = job->table_size;
+  job->stream_chunk = ( budget - STREAM_OVERHEAD ) & ~(size_t)( STREAM_MIN_CHUNK - 1 );
+  if( (off_t) job->stream_chunk > job->stream_len + STREAM_PAD_MAX )
   {
-    printSystemError( "open input file", input_file );
-    free( rawdata_p );
-    rawdata_p = 0;
-    return ERROR_NOT_OPEN;
+    // Small inputs only need room for themselves and the pad bytes.
+    job->stream_chunk = (size_t) job->stream_len + STREAM_PAD_MAX;
   }
 
-  count = fread( (void*) rawdata_p, 1, (size_t) table_size, rawfile_p );
-  if( count != (size_t) table_size )
+  return READ_SUCCESS;
+}
+
+
+/** Close the input opened by openRawStream().
+  */
+void closeRawStream( r2h_job_t* job )
+{
+  if( job->stream_fd >= 0 )
   {
-    printSystemError( "read input file", input_file );
-    fclose( rawfile_p );
-    free( rawdata_p );
-    rawdata_p = 0;
-    return ERROR_NOT_OPEN;
+    close( job->stream_fd );
+    job->stream_fd = -1;
   }
+}
+
 
-  if( fclose( rawfile_p ) != 0 )
+/** Release job->rawdata_p, whether it is mapped or on the heap.
+  */
+void releaseRaw( r2h_job_t* job )
+{
+  if( job->rawdata_map_len != 0 )
   {
-    printSystemError( "close input file", input_file );
-    free( rawdata_p );
-    rawdata_p = 0;
-    return ERROR_NOT_OPEN;
+    munmap( job->rawdata_p, job->rawdata_map_len );
+    job->rawdata_map_len = 0;
+  }
+  else
+  {
+    free( job->rawdata_p );
   }
 
-  return READ_SUCCESS;
+  job->rawdata_p = 0;
+  job->rawdata_room = 0;
 }
 
 
@@ -536,3 +2285,24 @@ void printSystemError( const char* context, const char* path )
     fprintf( stderr, "Error: failed to %s: %s\n", context, strerror( errno ) );
   }
 }
+
+
+/**
+ * Prints a progress message to stdout unless the conversion is quiet, or to
+ * stderr when the conversion writes its output to stdout.
+ * @param job Conversion the message belongs to.
+ * @param format printf style format.
+ */
+void printProgress( const r2h_job_t* job, const char* format, ... )
+{
+  va_list args;
+
+  if( job->quiet )
+  {
+    return;
+  }
+
+  va_start( args, format );
+  vfprintf( ( job->out_target == OUT_FD && job->out_fd == STDOUT_FILENO ) ? stderr : stdout, format, args );
+  va_end( args );
+}
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include "adpcm.h"
+
+#define RAW2HEADER_VERSION  "V3.02.0"
 
 // Error Codes
 #define INVALID_FN          -99
@@ -14,26 +17,115 @@
 #define READ_SUCCESS        -93
 #define FILE_NOT_FOUND      -92
 
+// Streaming budget: emitter buffer, hex tables and stack slack, plus the
+// smallest input chunk worth reading.
+#define STREAM_OVERHEAD     ( 576 * 1024 )
+#define STREAM_MIN_CHUNK    4096
+
+// Word modes: log2 of the array element width in bytes
+#define WORD_8              0
+#define WORD_16             1
+#define WORD_32             2
+#define WORD_64             3
+
+// Largest --adpcm-block, in frames per block
+#define ADPCM_BLOCK_MAX     32761
+// Smallest --adpcm-seek, in frames between seek points
+#define ADPCM_SEEK_MIN      64
+
+// Output targets: files named by path, one open descriptor, or a heap buffer
+#define OUT_PATH            0
+#define OUT_FD              1
+#define OUT_MEMORY          2
+
 // Channel mode constants
 #define MODE_NONE           0
 #define MODE_MONO           1
 #define MODE_STEREO         2
 
-extern int8_t* rawdata_p;
-extern off_t table_size;
-extern uint8_t wordmode;
-extern uint8_t bigendian;
-extern uint8_t channelmode;
-extern uint8_t pad_enabled;
-extern uint8_t pad_value;
-extern uint8_t adpcm_enabled;
-extern uint8_t sourcepair_enabled;
-extern char g_generated_with[256];
-
-off_t getFileSize( char* file_to_size );
-int getRaw( char* input_file );
-int writeFile( char* output_file, char* varname );
-int writeFile16( char* output_file, char* varname );
+/** State of one conversion: the options that drive it and the payload.
+ *
+ * Every conversion owns one of these, so several can run side by side in
+ * one process.  Initialise with initJob() and tear down with releaseRaw()
+ * and closeRawStream().
+ */
+typedef struct
+{
+  // Payload
+  int8_t*   rawdata_p;
+  off_t     table_size;
+  uint64_t  adpcm_frames;       // PCM frames encoded, for block ADPCM
+  ima_adpcm_snapshot_t* adpcm_seek_table;
+  size_t    adpcm_seek_count;
+  ima_adpcm_error_t* adpcm_error;  // round-trip totals, filled by scanAdpcmStream()
+
+  // Options
+  uint8_t   wordmode;           // WORD_8 .. WORD_64
+  uint8_t   bigendian;
+  uint8_t   channelmode;
+  uint8_t   pad_enabled;
+  uint8_t   pad_value;
+  uint8_t   adpcm_enabled;
+  uint32_t  adpcm_block;        // frames per ADPCM block, 0 for one stream
+  uint32_t  adpcm_seek;         // frames between ADPCM seek points, 0 for none
+  uint8_t   adpcm_decoder;      // also write ima_adpcm_decode.h
+  uint8_t   verify_enabled;     // decode the ADPCM and report its error
+  double    verify_min_snr;     // fail below this SNR in dB, 0 to only report
+  uint8_t   sourcepair_enabled;
+  uint8_t   incbin_enabled;
+  uint8_t   embed_enabled;
+  uint8_t   string_enabled;
+  uint8_t   object_enabled;
+  uint8_t   elf_flags_set;
+  uint32_t  elf_flags;
+  const char* elf_target;
+  const char* object_section;
+  uint8_t   quiet;
+  uint8_t   incremental;
+  char      generated_with[256];
+  size_t    max_memory;
+  unsigned  worker_threads;
+
+  // Input backing, see getRaw() and openRawStream()
+  const char* input_path;
+  uint8_t   input_named;        // input_path is a file other outputs can refer to
+  off_t     input_size;
+  size_t    rawdata_map_len;
+  size_t    rawdata_room;       // writable bytes after table_size
+  int       stream_fd;
+  off_t     stream_len;
+  size_t    stream_chunk;
+
+  // Output target, see writeOutputText()
+  uint8_t   out_target;         // OUT_PATH, OUT_FD or OUT_MEMORY
+  int       out_fd;
+  char*     out_mem;            // OUT_MEMORY result, owned by the caller
+  size_t    out_mem_len;
+  unsigned  out_files;          // outputs written, see writeOutputText()
+  uint64_t  out_bytes;
+} r2h_job_t;
+
+void initJob( r2h_job_t* job );
+unsigned resolveWorkerThreads( const r2h_job_t* job );
+int getRaw( r2h_job_t* job, const char* input_file );
+int getRawFd( r2h_job_t* job, int fd, const char* input_name );
+int loadRaw( r2h_job_t* job, const void* data, size_t len );
+int makeRawWritable( r2h_job_t* job, size_t extra );
+void releaseRaw( r2h_job_t* job );
+int openRawStream( r2h_job_t* job, const char* input_file, size_t budget );
+void closeRawStream( r2h_job_t* job );
+int scanAdpcmStream( r2h_job_t* job );
+int buildSourcePath( const char* header_path, char* source_path, size_t source_path_sz );
+int buildIncbinPath( const char* header_path, char* asm_path, size_t asm_path_sz );
+int buildObjectPath( const char* header_path, char* obj_path, size_t obj_path_sz );
+int buildSidecarPath( const char* header_path, char* bin_path, size_t bin_path_sz );
+int buildDecoderPath( const char* header_path, char* decoder_path, size_t decoder_path_sz );
+int writeFile( r2h_job_t* job, const char* output_file, const char* varname );
+int writeFile16( r2h_job_t* job, const char* output_file, const char* varname );
+int writeFile32( r2h_job_t* job, const char* output_file, const char* varname );
+int writeFile64( r2h_job_t* job, const char* output_file, const char* varname );
+int writeAdpcmDecoder( r2h_job_t* job, const char* output_file );
 void printSystemError( const char* context, const char* path );
+void printProgress( const r2h_job_t* job, const char* format, ... ) __attribute__(( format( printf, 2, 3 ) ));
 
 #endif
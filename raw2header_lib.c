@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raw2header_io.h"
+#include "raw2header_cli.h"
+#include "raw2header_convert.h"
+#include "raw2header_lib.h"
+
+// Most flags accepted by r2h_converter_set_flags(), as on a manifest line.
+#define LIB_MAX_FLAGS       32
+
+/** Options every conversion on the converter starts from.
+ */
+struct r2h_converter
+{
+  r2h_job_t options;
+};
+
+
+/** Refuse options a conversion without named files cannot honour.
+ *
+ * @param job configured conversion
+ * @retval int 0 when usable, -1 after reporting the problem
+ */
+static int checkLibraryOptions( const r2h_job_t* job )
+{
+  if( checkSingleOutput( job, "an in-process conversion" ) != 0 )
+  {
+    return -1;
+  }
+
+  if( job->max_memory != 0 )
+  {
+    fprintf( stderr, "Error: --max-memory needs a named input file.\n" );
+    return -1;
+  }
+
+  return checkJobOptions( job );
+}
+
+
+/** Run one conversion of a payload the caller's job has loaded.
+ *
+ * @param job conversion with its payload loaded and its output target set
+ * @param state what the load returned
+ * @param output_name name used in messages
+ * @param varname array name
+ * @retval int 0 on success, -1 on failure
+ */
+static int convertLoadedJob( r2h_job_t* job, int state, const char* output_name, const char* varname )
+{
+  if( state != READ_SUCCESS )
+  {
+    fprintf( stderr, "Error: failed to load input for %s.\n", output_name );
+    releaseRaw( job );
+    return -1;
+  }
+
+  if( convertPayload( job, output_name, varname ) != EXIT_SUCCESS )
+  {
+    free( job->out_mem );
+    job->out_mem = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+r2h_converter_t* r2h_converter_new( void )
+{
+  r2h_converter_t* cv = malloc( sizeof( *cv ) );
+
+  if( cv == 0 )
+  {
+    return 0;
+  }
+
+  initJob( &cv->options );
+  cv->options.quiet = 1;
+
+  return cv;
+}
+
+
+void r2h_converter_free( r2h_converter_t* cv )
+{
+  free( cv );
+}
+
+
+int r2h_converter_set_flags( r2h_converter_t* cv, int count, char** flags )
+{
+  char* argv[ LIB_MAX_FLAGS + 1 ];
+  r2h_job_t job;
+
+  if( cv == 0 || count < 0 || count > LIB_MAX_FLAGS || ( count > 0 && flags == 0 ) )
+  {
+    return -1;
+  }
+
+  argv[0] = "raw2header";
+  if( count > 0 )
+  {
+    memcpy( argv + 1, flags, (size_t) count * sizeof( *flags ) );
+  }
+
+  initJob( &job );
+  if( parseArgs( &job, count + 1, argv, 0, 0, 0, 0, 0 ) != 0 )
+  {
+    fprintf( stderr, "Error: invalid flags for an in-process conversion.\n" );
+    return -1;
+  }
+  if( checkLibraryOptions( &job ) != 0 )
+  {
+    return -1;
+  }
+
+  job.quiet = 1;
+  buildGeneratedWith( &job, count, flags );
+  cv->options = job;
+
+  return 0;
+}
+
+
+int r2h_convert_buffer( const r2h_converter_t* cv, const void* input, size_t input_len, const char* varname,
+                        char** output, size_t* output_len )
+{
+  r2h_job_t job;
+
+  if( cv == 0 || varname == 0 || output == 0 || output_len == 0 )
+  {
+    return -1;
+  }
+
+  job = cv->options;
+  job.out_target = OUT_MEMORY;
+  if( convertLoadedJob( &job, loadRaw( &job, input, input_len ), "<memory>", varname ) != 0 )
+  {
+    return -1;
+  }
+
+  *output = job.out_mem;
+  *output_len = job.out_mem_len;
+
+  return 0;
+}
+
+
+int r2h_convert_fd( const r2h_converter_t* cv, int input_fd, int output_fd, const char* varname )
+{
+  char input_name[32];
+  char output_name[32];
+  r2h_job_t job;
+
+  if( cv == 0 || varname == 0 || input_fd < 0 || output_fd < 0 )
+  {
+    return -1;
+  }
+
+  snprintf( input_name, sizeof( input_name ), "<fd %d>", input_fd );
+  snprintf( output_name, sizeof( output_name ), "<fd %d>", output_fd );
+  job = cv->options;
+  job.out_target = OUT_FD;
+  job.out_fd = output_fd;
+
+  return convertLoadedJob( &job, getRawFd( &job, input_fd, input_name ), output_name, varname );
+}
@@ -0,0 +1,73 @@
+#ifndef RAW2HEADER_LIB_H
+#define RAW2HEADER_LIB_H
+
+#include <stddef.h>
+
+/** In-process raw2header conversions.
+ *
+ * A converter holds the options of a conversion, given with the same flags as
+ * the command line.  Conversions only read the converter, so one converter
+ * can run any number of them at once from different threads.  Errors are
+ * reported on stderr, as by the command line tool; progress is not printed.
+ *
+ * Only conversions with a single output are available here: --source-pair,
+ * --incbin, --embed, --emit-object, --adpcm-decoder, --incremental,
+ * --max-memory and --manifest need named files and are refused.
+ */
+typedef struct r2h_converter r2h_converter_t;
+
+/**
+ * Creates a converter with the default options (8-bit uint8_t array).
+ *
+ * @return the converter, or NULL when memory runs out
+ */
+r2h_converter_t* r2h_converter_new( void );
+
+/**
+ * Releases a converter.  No conversion may be running on it.
+ *
+ * @param cv converter, or NULL
+ */
+void r2h_converter_free( r2h_converter_t* cv );
+
+/**
+ * Replaces the options of a converter, e.g. { "-ab16", "--stereo", "--verify" }.
+ * The flags are also recorded in the "Generated by" comment of the output.
+ *
+ * @param cv converter
+ * @param count number of flags
+ * @param flags command line switches, without program name, input, output or varname
+ * @return 0 on success, -1 on an invalid or refused flag (the options are then unchanged)
+ */
+int r2h_converter_set_flags( r2h_converter_t* cv, int count, char** flags );
+
+/**
+ * Converts an input held in memory into header text in a new buffer.
+ *
+ * @param cv configured converter
+ * @param input raw input bytes, left unchanged
+ * @param input_len number of input bytes
+ * @param varname array name
+ * @param output Output parameter: NUL-terminated header text, release with free()
+ * @param output_len Output parameter: length of the text without the NUL
+ * @return 0 on success, -1 on failure
+ */
+int r2h_convert_buffer( const r2h_converter_t* cv, const void* input, size_t input_len, const char* varname,
+                        char** output, size_t* output_len );
+
+/**
+ * Converts everything readable from input_fd and writes the header text to
+ * output_fd.  Neither descriptor is closed.  A regular input file is mapped
+ * when read from its start; pipes and sockets are read to their end.  The
+ * text is written at the current position of a seekable output, which is
+ * left after it.
+ *
+ * @param cv configured converter
+ * @param input_fd descriptor to read the raw input from
+ * @param output_fd descriptor to write the header to
+ * @param varname array name
+ * @return 0 on success, -1 on failure
+ */
+int r2h_convert_fd( const r2h_converter_t* cv, int input_fd, int output_fd, const char* varname );
+
+#endif // RAW2HEADER_LIB_H
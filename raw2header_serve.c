@@ -0,0 +1,629 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "raw2header_io.h"
+#include "raw2header_batch.h"
+#include "raw2header_serve.h"
+
+// Most pool threads, whatever --threads asks for.
+#define SERVE_MAX_WORKERS   64
+// Bytes before the text of a request or reply: its length, then its id.
+#define SERVE_HEADER_LEN    8
+
+/** One client: a socket, or stdin and stdout.
+ */
+typedef struct serve_client
+{
+  struct serve_client* next;    // next connected socket client, guarded by the queue lock
+  int             in_fd;
+  int             out_fd;
+  int             owned;        // close in_fd and free the client when released
+  unsigned        refs;         // the reader plus every request not yet answered
+  pthread_mutex_t lock;         // guards refs and keeps replies whole on out_fd
+  pthread_cond_t  done;
+} serve_client_t;
+
+/** A request waiting for a pool thread.
+ */
+typedef struct serve_request
+{
+  struct serve_request* next;
+  serve_client_t* client;
+  uint32_t        id;
+  char*           text;
+} serve_request_t;
+
+/** Work queue shared by the reader and the pool threads.
+ */
+typedef struct
+{
+  const r2h_job_t*  base;
+  serve_request_t*  head;
+  serve_request_t*  tail;
+  int               closing;
+  serve_client_t*   clients;    // socket clients whose reader is still running
+  unsigned          readers;
+  pthread_mutex_t   lock;
+  pthread_cond_t    ready;
+  pthread_cond_t    readers_done;
+} serve_queue_t;
+
+/** What a socket reader thread needs.
+ */
+typedef struct
+{
+  serve_queue_t*  queue;
+  serve_client_t* client;
+} serve_reader_t;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+
+static void stopServing( int sig )
+{
+  (void) sig;
+  serve_stop = 1;
+}
+
+
+static void putBE32( uint8_t* p, uint32_t v )
+{
+  p[0] = (uint8_t)( v >> 24 );
+  p[1] = (uint8_t)( v >> 16 );
+  p[2] = (uint8_t)( v >> 8 );
+  p[3] = (uint8_t) v;
+}
+
+
+static uint32_t getBE32( const uint8_t* p )
+{
+  return ( (uint32_t) p[0] << 24 ) | ( (uint32_t) p[1] << 16 ) | ( (uint32_t) p[2] << 8 ) | p[3];
+}
+
+
+/** Read exactly len bytes, retrying short reads.
+ *
+ * @retval int 1 on success, 0 on end of input before the first byte, -1 otherwise
+ */
+static int readMessage( int fd, uint8_t* dst, size_t len )
+{
+  size_t done = 0;
+
+  while( done < len )
+  {
+    ssize_t got = read( fd, dst + done, len - done );
+
+    if( got < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( got <= 0 )
+    {
+      return ( got == 0 && done == 0 ) ? 0 : -1;
+    }
+    done += (size_t) got;
+  }
+
+  return 1;
+}
+
+
+/** Send one reply, whole, to the client that asked.
+ */
+static void sendReply( serve_client_t* client, uint32_t id, const char* text )
+{
+  size_t len = strlen( text );
+  uint8_t msg[ SERVE_HEADER_LEN + 64 ];
+  size_t done = 0;
+
+  putBE32( msg, (uint32_t) len );
+  putBE32( msg + 4, id );
+  memcpy( msg + SERVE_HEADER_LEN, text, len );
+  len += SERVE_HEADER_LEN;
+
+  pthread_mutex_lock( &client->lock );
+  while( done < len )
+  {
+    ssize_t put = write( client->out_fd, msg + done, len - done );
+
+    if( put < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    if( put <= 0 )
+    {
+      // The client went away; its other requests still run.
+      break;
+    }
+    done += (size_t) put;
+  }
+  pthread_mutex_unlock( &client->lock );
+}
+
+
+/** Drop one reference to a client, closing it after its last reply.
+ */
+static void releaseClient( serve_client_t* client )
+{
+  // A client that is not owned can be freed by its waiter as soon as the lock drops.
+  const int owned = client->owned;
+  int last;
+
+  pthread_mutex_lock( &client->lock );
+  last = ( --client->refs == 0 );
+  if( last && !owned )
+  {
+    pthread_cond_broadcast( &client->done );
+  }
+  pthread_mutex_unlock( &client->lock );
+
+  if( last && owned )
+  {
+    close( client->in_fd );
+    pthread_mutex_destroy( &client->lock );
+    pthread_cond_destroy( &client->done );
+    free( client );
+  }
+}
+
+
+/** Run one request as a conversion and answer it.
+ *
+ * The reply is "ok", "error" or "invalid", then the number of outputs
+ * written and their total size in bytes.
+ */
+static void answerRequest( serve_queue_t* queue, serve_request_t* req )
+{
+  char* argv[ MANIFEST_MAX_ARGS ];
+  char reply[64];
+  r2h_job_t job;
+  int argc = splitManifestLine( req->text, argv );
+  int state = ( argc < 0 ) ? ARGUMENTS_ERROR : convertArgs( queue->base, argc, argv, &job );
+
+  if( state == ARGUMENTS_ERROR )
+  {
+    fprintf( stderr, "Error: request %u: invalid flags or arguments.\n", (unsigned) req->id );
+    snprintf( reply, sizeof( reply ), "invalid 0 0" );
+  }
+  else
+  {
+    snprintf( reply, sizeof( reply ), "%s %u %llu", ( state == EXIT_SUCCESS ) ? "ok" : "error",
+              job.out_files, (unsigned long long) job.out_bytes );
+  }
+
+  sendReply( req->client, req->id, reply );
+}
+
+
+/** Pool thread body: answer requests until the queue closes and runs dry.
+ */
+static void* serveWorker( void* arg )
+{
+  serve_queue_t* queue = arg;
+
+  for( ;; )
+  {
+    serve_request_t* req;
+
+    pthread_mutex_lock( &queue->lock );
+    while( queue->head == 0 && !queue->closing )
+    {
+      pthread_cond_wait( &queue->ready, &queue->lock );
+    }
+    req = queue->head;
+    if( req != 0 )
+    {
+      queue->head = req->next;
+      if( queue->head == 0 )
+      {
+        queue->tail = 0;
+      }
+    }
+    pthread_mutex_unlock( &queue->lock );
+
+    if( req == 0 )
+    {
+      return 0;
+    }
+
+    answerRequest( queue, req );
+    releaseClient( req->client );
+    free( req->text );
+    free( req );
+  }
+}
+
+
+/** Read a client's requests onto the queue until it stops sending.
+ *
+ * A request is a 4-byte big-endian text length, a 4-byte big-endian id the
+ * reply echoes, and the text: one manifest line, [flags] <input_file>
+ * <output_file> <varname>.  The caller still holds its own reference to
+ * the client afterwards.
+ */
+static void readRequests( serve_queue_t* queue, serve_client_t* client )
+{
+  for( ;; )
+  {
+    uint8_t header[ SERVE_HEADER_LEN ];
+    serve_request_t* req;
+    uint32_t len;
+
+    if( readMessage( client->in_fd, header, sizeof( header ) ) != 1 )
+    {
+      break;
+    }
+    len = getBE32( header );
+    if( len > SERVE_MAX_REQUEST )
+    {
+      fprintf( stderr, "Error: request %u is %u bytes, the limit is %u.\n", (unsigned) getBE32( header + 4 ),
+               (unsigned) len, (unsigned) SERVE_MAX_REQUEST );
+      sendReply( client, getBE32( header + 4 ), "invalid 0 0" );
+      break;
+    }
+
+    req = calloc( 1, sizeof( *req ) );
+    if( req != 0 )
+    {
+      req->text = malloc( (size_t) len + 1 );
+    }
+    if( req == 0 || req->text == 0 )
+    {
+      fprintf( stderr, "Error: failed to allocate a request.\n" );
+      free( req );
+      break;
+    }
+    if( readMessage( client->in_fd, (uint8_t*) req->text, len ) != 1 && len != 0 )
+    {
+      free( req->text );
+      free( req );
+      break;
+    }
+    req->text[ len ] = '\0';
+    req->id = getBE32( header + 4 );
+    req->client = client;
+
+    pthread_mutex_lock( &client->lock );
+    client->refs++;
+    pthread_mutex_unlock( &client->lock );
+
+    pthread_mutex_lock( &queue->lock );
+    if( queue->tail != 0 )
+    {
+      queue->tail->next = req;
+    }
+    else
+    {
+      queue->head = req;
+    }
+    queue->tail = req;
+    pthread_cond_signal( &queue->ready );
+    pthread_mutex_unlock( &queue->lock );
+  }
+}
+
+
+/** Count a socket client's reader as running, so shutdown can stop and wait for it.
+ */
+static void addReader( serve_queue_t* queue, serve_client_t* client )
+{
+  pthread_mutex_lock( &queue->lock );
+  client->next = queue->clients;
+  queue->clients = client;
+  queue->readers++;
+  pthread_mutex_unlock( &queue->lock );
+}
+
+
+/** Take a finished reader's client off the list, before its descriptor can close.
+ */
+static void dropReader( serve_queue_t* queue, serve_client_t* client )
+{
+  serve_client_t** link = &queue->clients;
+
+  pthread_mutex_lock( &queue->lock );
+  while( *link != client )
+  {
+    link = &( *link )->next;
+  }
+  *link = client->next;
+  if( --queue->readers == 0 )
+  {
+    pthread_cond_broadcast( &queue->readers_done );
+  }
+  pthread_mutex_unlock( &queue->lock );
+}
+
+
+static void* serveReader( void* arg )
+{
+  serve_reader_t* reader = arg;
+  serve_queue_t* queue = reader->queue;
+  serve_client_t* client = reader->client;
+
+  free( reader );
+  readRequests( queue, client );
+  dropReader( queue, client );
+  releaseClient( client );
+
+  return 0;
+}
+
+
+/** Start a thread with SIGINT and SIGTERM blocked, so they always reach the
+ *  thread waiting in accept().
+ */
+static int startThread( pthread_t* thread, const pthread_attr_t* attr, void* ( *body )( void* ), void* arg )
+{
+  sigset_t block, old;
+  int state;
+
+  sigemptyset( &block );
+  sigaddset( &block, SIGINT );
+  sigaddset( &block, SIGTERM );
+  pthread_sigmask( SIG_BLOCK, &block, &old );
+  state = pthread_create( thread, attr, body, arg );
+  pthread_sigmask( SIG_SETMASK, &old, 0 );
+
+  return state;
+}
+
+
+static serve_client_t* newClient( int in_fd, int out_fd, int owned )
+{
+  serve_client_t* client = calloc( 1, sizeof( *client ) );
+
+  if( client == 0 )
+  {
+    return 0;
+  }
+
+  client->in_fd = in_fd;
+  client->out_fd = out_fd;
+  client->owned = owned;
+  client->refs = 1;
+  pthread_mutex_init( &client->lock, 0 );
+  pthread_cond_init( &client->done, 0 );
+
+  return client;
+}
+
+
+/** Serve requests from stdin, answering on stdout, until stdin ends and
+ *  every request is answered.
+ *
+ * Anything else the conversions print to stdout goes to stderr instead, so
+ * the replies stay intact.
+ */
+static int serveStdio( serve_queue_t* queue )
+{
+  serve_client_t* client;
+  int out_fd;
+
+  fflush( stdout );
+  out_fd = dup( STDOUT_FILENO );
+  if( out_fd < 0 || dup2( STDERR_FILENO, STDOUT_FILENO ) < 0 )
+  {
+    printSystemError( "redirect stdout", 0 );
+    return -1;
+  }
+
+  client = newClient( STDIN_FILENO, out_fd, 0 );
+  if( client == 0 )
+  {
+    fprintf( stderr, "Error: failed to allocate a client.\n" );
+    close( out_fd );
+    return -1;
+  }
+
+  readRequests( queue, client );
+  releaseClient( client );
+
+  pthread_mutex_lock( &client->lock );
+  while( client->refs != 0 )
+  {
+    pthread_cond_wait( &client->done, &client->lock );
+  }
+  pthread_mutex_unlock( &client->lock );
+
+  pthread_mutex_destroy( &client->lock );
+  pthread_cond_destroy( &client->done );
+  free( client );
+  close( out_fd );
+
+  return 0;
+}
+
+
+/** Serve requests from clients of a Unix socket until SIGINT or SIGTERM.
+ *
+ * Each client gets a reader thread; all share the pool.  A stale socket left
+ * at socket_path is replaced, and the socket is removed on the way out.  On
+ * the way out, clients still connected stop being read and every reader is
+ * waited for, so requests already read are answered before the pool stops.
+ */
+static int serveSocket( serve_queue_t* queue, const char* socket_path )
+{
+  struct sockaddr_un addr;
+  struct sigaction sa;
+  struct stat st;
+  int state = 0;
+  int fd;
+
+  if( strlen( socket_path ) >= sizeof( addr.sun_path ) )
+  {
+    fprintf( stderr, "Error: socket path '%s' is too long.\n", socket_path );
+    return -1;
+  }
+
+  fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if( fd < 0 )
+  {
+    printSystemError( "create socket", socket_path );
+    return -1;
+  }
+
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  strcpy( addr.sun_path, socket_path );
+  if( lstat( socket_path, &st ) == 0 && S_ISSOCK( st.st_mode ) )
+  {
+    unlink( socket_path );
+  }
+  if( bind( fd, (struct sockaddr*) &addr, sizeof( addr ) ) != 0 || listen( fd, SOMAXCONN ) != 0 )
+  {
+    printSystemError( "listen on socket", socket_path );
+    close( fd );
+    return -1;
+  }
+
+  // No SA_RESTART, so a signal breaks accept() out of its wait.
+  memset( &sa, 0, sizeof( sa ) );
+  sa.sa_handler = stopServing;
+  sigemptyset( &sa.sa_mask );
+  sigaction( SIGINT, &sa, 0 );
+  sigaction( SIGTERM, &sa, 0 );
+
+  printProgress( queue->base, "Serving on %s\n", socket_path );
+  fflush( stdout );
+
+  while( !serve_stop )
+  {
+    serve_reader_t* reader;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int client_fd = accept( fd, 0, 0 );
+
+    if( client_fd < 0 )
+    {
+      if( errno != EINTR && errno != ECONNABORTED )
+      {
+        printSystemError( "accept on socket", socket_path );
+        state = -1;
+        break;
+      }
+      continue;
+    }
+
+    reader = malloc( sizeof( *reader ) );
+    if( reader != 0 )
+    {
+      reader->queue = queue;
+      reader->client = newClient( client_fd, client_fd, 1 );
+    }
+    if( reader == 0 || reader->client == 0 )
+    {
+      fprintf( stderr, "Error: failed to allocate a client.\n" );
+      free( reader );
+      close( client_fd );
+      continue;
+    }
+
+    addReader( queue, reader->client );
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    if( startThread( &thread, &attr, serveReader, reader ) != 0 )
+    {
+      fprintf( stderr, "Error: failed to start a client thread.\n" );
+      dropReader( queue, reader->client );
+      releaseClient( reader->client );
+      free( reader );
+    }
+    pthread_attr_destroy( &attr );
+  }
+
+  close( fd );
+  unlink( socket_path );
+
+  // End every client's input; a reader holds its client until it is off the list.
+  pthread_mutex_lock( &queue->lock );
+  for( serve_client_t* client = queue->clients; client != 0; client = client->next )
+  {
+    shutdown( client->in_fd, SHUT_RD );
+  }
+  while( queue->readers != 0 )
+  {
+    pthread_cond_wait( &queue->readers_done, &queue->lock );
+  }
+  pthread_mutex_unlock( &queue->lock );
+
+  return state;
+}
+
+
+/** Keep one process alive and run conversion requests on a pool of threads.
+ *
+ * Requests use the manifest line syntax and run like manifest lines, see
+ * readRequests() for the framing and answerRequest() for the replies.
+ *
+ * @param base command line options: worker_threads sizes the pool (0 for one
+ *             per online CPU) and incremental applies to every request
+ * @param socket_path Unix socket to listen on, or "-" for stdin and stdout
+ * @retval int EXIT_SUCCESS, or EXIT_FAILURE when serving could not start or broke off
+ */
+int runServer( const r2h_job_t* base, const char* socket_path )
+{
+  unsigned threads = resolveWorkerThreads( base );
+  pthread_t workers[ SERVE_MAX_WORKERS ];
+  serve_queue_t queue;
+  unsigned started = 0;
+  int state;
+
+  if( threads > SERVE_MAX_WORKERS )
+  {
+    threads = SERVE_MAX_WORKERS;
+  }
+
+  // Replies to clients that went away must not kill the server.
+  signal( SIGPIPE, SIG_IGN );
+
+  memset( &queue, 0, sizeof( queue ) );
+  queue.base = base;
+  pthread_mutex_init( &queue.lock, 0 );
+  pthread_cond_init( &queue.ready, 0 );
+  pthread_cond_init( &queue.readers_done, 0 );
+
+  for( started = 0; started < threads; started++ )
+  {
+    if( startThread( &workers[ started ], 0, serveWorker, &queue ) != 0 )
+    {
+      break;
+    }
+  }
+  if( started == 0 )
+  {
+    fprintf( stderr, "Error: failed to start any server thread.\n" );
+    return EXIT_FAILURE;
+  }
+
+  if( strcmp( socket_path, "-" ) == 0 )
+  {
+    state = serveStdio( &queue );
+  }
+  else
+  {
+    state = serveSocket( &queue, socket_path );
+  }
+
+  pthread_mutex_lock( &queue.lock );
+  queue.closing = 1;
+  pthread_cond_broadcast( &queue.ready );
+  pthread_mutex_unlock( &queue.lock );
+  for( unsigned t = 0; t < started; t++ )
+  {
+    pthread_join( workers[t], 0 );
+  }
+  pthread_mutex_destroy( &queue.lock );
+  pthread_cond_destroy( &queue.ready );
+  pthread_cond_destroy( &queue.readers_done );
+
+  return ( state == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,11 @@
+#ifndef RAW2HEADER_SERVE_H
+#define RAW2HEADER_SERVE_H
+
+#include "raw2header_io.h"
+
+// Largest request text accepted, in bytes.
+#define SERVE_MAX_REQUEST   ( 64 * 1024 )
+
+int runServer( const r2h_job_t* base, const char* socket_path );
+
+#endif
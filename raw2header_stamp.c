@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "raw2header_io.h"
+#include "raw2header_stamp.h"
+
+// XXH64 primes
+#define PRIME64_1           0x9E3779B185EBCA87ULL
+#define PRIME64_2           0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3           0x165667B19E3779F9ULL
+#define PRIME64_4           0x85EBCA77C2B2AE63ULL
+#define PRIME64_5           0x27D4EB2F165667C5ULL
+
+// Bumped whenever the stamp layout changes, so old stamps stop matching.
+#define STAMP_FORMAT        1
+
+
+static inline uint64_t rotl64( uint64_t x, int r )
+{
+  return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+static inline uint64_t read64( const uint8_t* p )
+{
+  uint64_t v;
+
+  memcpy( &v, p, sizeof( v ) );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64( v );
+#endif
+  return v;
+}
+
+static inline uint32_t read32( const uint8_t* p )
+{
+  uint32_t v;
+
+  memcpy( &v, p, sizeof( v ) );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32( v );
+#endif
+  return v;
+}
+
+static inline uint64_t xxhRound( uint64_t acc, uint64_t input )
+{
+  acc += input * PRIME64_2;
+  acc = rotl64( acc, 31 );
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t xxhMerge( uint64_t acc, uint64_t val )
+{
+  acc ^= xxhRound( 0, val );
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+
+/** XXH64 of a block of memory.
+ *
+ * @param data bytes to hash
+ * @param len number of bytes
+ * @param seed hash seed, used to chain blocks together
+ * @retval uint64_t hash
+ */
+static uint64_t hash64( const uint8_t* data, size_t len, uint64_t seed )
+{
+  const uint8_t* p = data;
+  const uint8_t* end = data + len;
+  uint64_t h;
+
+  if( len >= 32 )
+  {
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+
+    do
+    {
+      v1 = xxhRound( v1, read64( p ) );
+      v2 = xxhRound( v2, read64( p + 8 ) );
+      v3 = xxhRound( v3, read64( p + 16 ) );
+      v4 = xxhRound( v4, read64( p + 24 ) );
+      p += 32;
+    } while( p + 32 <= end );
+
+    h = rotl64( v1, 1 ) + rotl64( v2, 7 ) + rotl64( v3, 12 ) + rotl64( v4, 18 );
+    h = xxhMerge( h, v1 );
+    h = xxhMerge( h, v2 );
+    h = xxhMerge( h, v3 );
+    h = xxhMerge( h, v4 );
+  }
+  else
+  {
+    h = seed + PRIME64_5;
+  }
+
+  h += (uint64_t) len;
+
+  while( p + 8 <= end )
+  {
+    h ^= xxhRound( 0, read64( p ) );
+    h = rotl64( h, 27 ) * PRIME64_1 + PRIME64_4;
+    p += 8;
+  }
+  if( p + 4 <= end )
+  {
+    h ^= (uint64_t) read32( p ) * PRIME64_1;
+    h = rotl64( h, 23 ) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  while( p < end )
+  {
+    h ^= (uint64_t)( *p ) * PRIME64_5;
+    h = rotl64( h, 11 ) * PRIME64_1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+
+/** Hash a NUL terminated string, terminator included so fields cannot run together.
+ */
+static uint64_t hashText( const char* text, uint64_t seed )
+{
+  return hash64( (const uint8_t*) text, strlen( text ) + 1, seed );
+}
+
+
+/** Compute the stamp of a conversion.
+ *
+ * The stamp covers the tool version, every option that shapes the output,
+ * the recorded switches, the output path and array name, and the input bytes.
+ * The input is read in STAMP_CHUNK blocks so memory use stays bounded.
+ *
+ * @param job configured conversion
+ * @param input_file path of the raw input
+ * @param output_file normalized output header path
+ * @param varname array name
+ * @param stamp receives the stamp
+ * @retval int 0 on success, ERROR_NOT_OPEN or NO_MALLOC on failure
+ */
+int computeStamp( const r2h_job_t* job, const char* input_file, const char* output_file,
+                  const char* varname, uint64_t* stamp )
+{
+  const uint8_t options[] =
+  {
+    STAMP_FORMAT, job->wordmode, job->bigendian, job->channelmode, job->pad_enabled,
+    job->pad_value, job->adpcm_enabled, job->sourcepair_enabled, job->incbin_enabled,
+    job->embed_enabled, job->string_enabled, job->object_enabled, job->elf_flags_set,
+    (uint8_t) job->elf_flags, (uint8_t)( job->elf_flags >> 8 ), (uint8_t)( job->elf_flags >> 16 ),
+    (uint8_t)( job->elf_flags >> 24 ), (uint8_t) job->adpcm_block, (uint8_t)( job->adpcm_block >> 8 ),
+    (uint8_t) job->adpcm_seek, (uint8_t)( job->adpcm_seek >> 8 ), (uint8_t)( job->adpcm_seek >> 16 ),
+    (uint8_t)( job->adpcm_seek >> 24 ), job->adpcm_decoder, job->verify_enabled
+  };
+  uint8_t* chunk;
+  uint64_t h;
+  int fd;
+
+  h = hashText( RAW2HEADER_VERSION, 0 );
+  h = hash64( options, sizeof( options ), h );
+  h = hashText( job->generated_with, h );
+  h = hashText( output_file, h );
+  h = hashText( varname, h );
+  h = hashText( ( job->elf_target != 0 ) ? job->elf_target : "", h );
+  h = hashText( ( job->object_section != 0 ) ? job->object_section : "", h );
+
+  fd = open( input_file, O_RDONLY );
+  if( fd < 0 )
+  {
+    printSystemError( "open input file", input_file );
+    return ERROR_NOT_OPEN;
+  }
+
+  chunk = malloc( STAMP_CHUNK );
+  if( chunk == 0 )
+  {
+    close( fd );
+    return NO_MALLOC;
+  }
+
+  for( ;; )
+  {
+    ssize_t got = read( fd, chunk, STAMP_CHUNK );
+
+    if( got < 0 )
+    {
+      if( errno == EINTR )
+      {
+        continue;
+      }
+      printSystemError( "read input file", input_file );
+      free( chunk );
+      close( fd );
+      return ERROR_NOT_OPEN;
+    }
+    if( got == 0 )
+    {
+      break;
+    }
+    h = hash64( chunk, (size_t) got, h );
+  }
+
+  free( chunk );
+  close( fd );
+  *stamp = h;
+
+  return 0;
+}
+
+
+/** Check whether a stamp file holds the given stamp.
+ *
+ * @param stamp_file path of the stamp file
+ * @param stamp expected stamp
+ * @retval int 1 when it matches, 0 when it differs or cannot be read
+ */
+int stampMatches( const char* stamp_file, uint64_t stamp )
+{
+  char text[32] = {0};
+  char expected[32];
+  FILE* fp;
+
+  fp = fopen( stamp_file, "r" );
+  if( fp == 0 )
+  {
+    return 0;
+  }
+  if( fgets( text, sizeof( text ), fp ) == 0 )
+  {
+    text[0] = '\0';
+  }
+  fclose( fp );
+
+  snprintf( expected, sizeof( expected ), "%016llx\n", (unsigned long long) stamp );
+
+  return strcmp( text, expected ) == 0;
+}
+
+
+/** Record a stamp once its outputs have been written.
+ *
+ * @param stamp_file path of the stamp file
+ * @param stamp stamp to record
+ * @retval int 0 on success, ERROR_NOT_OPEN on failure
+ */
+int writeStamp( const char* stamp_file, uint64_t stamp )
+{
+  FILE* fp;
+  int state;
+
+  fp = fopen( stamp_file, "w" );
+  if( fp == 0 )
+  {
+    printSystemError( "open stamp file", stamp_file );
+    return ERROR_NOT_OPEN;
+  }
+
+  state = ( fprintf( fp, "%016llx\n", (unsigned long long) stamp ) < 0 );
+  if( fclose( fp ) != 0 || state != 0 )
+  {
+    printSystemError( "write stamp file", stamp_file );
+    return ERROR_NOT_OPEN;
+  }
+
+  return 0;
+}
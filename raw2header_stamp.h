@@ -0,0 +1,16 @@
+#ifndef RAW2HEADER_STAMP_H
+#define RAW2HEADER_STAMP_H
+
+#include <stdint.h>
+#include "raw2header_io.h"
+
+// Appended to the output header path to name the stamp file.
+#define STAMP_SUFFIX        ".stamp"
+#define STAMP_CHUNK         ( 1024 * 1024 )
+
+int computeStamp( const r2h_job_t* job, const char* input_file, const char* output_file,
+                  const char* varname, uint64_t* stamp );
+int stampMatches( const char* stamp_file, uint64_t stamp );
+int writeStamp( const char* stamp_file, uint64_t stamp );
+
+#endif
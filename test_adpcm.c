@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <math.h>
 #include "adpcm.h"
+#include "pcm_ingest.h"
 
 // Forward declarations for ADPCM tables (used in decoder)
 extern const int indexTable[16];
@@ -286,11 +287,555 @@ static int test_stereo_input( void )
   return 0;
 }
 
+// Decode one channel of a block ADPCM block (header plus 4-byte channel groups)
+static void decode_ima_adpcm_block( const uint8_t* block, size_t frames, int channels,
+                                    int channel, int16_t* pcm_out )
+{
+  const uint8_t* header = block + channel * 4;
+  int predictor = (int16_t)( header[0] | ( header[1] << 8 ) );
+  int index = header[2];
+  size_t f;
+
+  pcm_out[0] = (int16_t)predictor;
+  for( f = 1; f < frames; f++ ) {
+    size_t k = ( f - 1 ) % 8;
+    const uint8_t* word = block + channels * 4 + ( ( f - 1 ) / 8 * channels + channel ) * 4;
+    uint8_t nibble = ( k & 1 ) ? ( word[k >> 1] >> 4 ) : ( word[k >> 1] & 0x0F );
+    int step = stepTable[index];
+    int diff = step >> 3;
+
+    if( nibble & 4 ) diff += step;
+    if( nibble & 2 ) diff += step >> 1;
+    if( nibble & 1 ) diff += step >> 2;
+    if( nibble & 8 ) predictor -= diff;
+    else predictor += diff;
+
+    if( predictor > 32767 ) predictor = 32767;
+    if( predictor < -32768 ) predictor = -32768;
+
+    pcm_out[f] = (int16_t)predictor;
+
+    index += indexTable[nibble];
+    if( index < 0 ) index = 0;
+    if( index > 88 ) index = 88;
+  }
+}
+
+// Test 9: Verify block mode layout, thread independence and reconstruction
+static int test_blocks( void )
+{
+  printf( "Test 9: Block ADPCM encoding\n" );
+
+  enum { FRAMES = 3000, BLOCK = 505 };
+  static int16_t stereo_samples[FRAMES * 2];
+  static int16_t decoded[BLOCK];
+  for( int i = 0; i < FRAMES; i++ ) {
+    stereo_samples[i * 2] = (int16_t)(12000 * sin( 2.0 * 3.14159 * i / 90.0 ));
+    stereo_samples[i * 2 + 1] = (int16_t)(-8000 * sin( 2.0 * 3.14159 * i / 41.0 ));
+  }
+
+  size_t one_size = 0, four_size = 0;
+  uint8_t* one = encode_ima_adpcm_blocks( stereo_samples, FRAMES * 2, 1, 2, BLOCK, 1, &one_size );
+  uint8_t* four = encode_ima_adpcm_blocks( stereo_samples, FRAMES * 2, 1, 2, BLOCK, 4, &four_size );
+
+  // 5 full blocks of 8 + 63 * 8 bytes, then 475 frames in 8 + 60 * 8 bytes
+  size_t expected_size = 5 * ima_adpcm_block_bytes( BLOCK, 2 ) + ima_adpcm_block_bytes( FRAMES % BLOCK, 2 );
+  if( !one || !four || one_size != expected_size || four_size != one_size
+      || ima_adpcm_block_bytes( BLOCK, 2 ) != 512 ) {
+    printf( "  FAIL: Expected %zu bytes, got %zu and %zu\n", expected_size, one_size, four_size );
+    free( one );
+    free( four );
+    return 1;
+  }
+
+  if( memcmp( one, four, one_size ) != 0 ) {
+    printf( "  FAIL: Output depends on the thread count\n" );
+    free( one );
+    free( four );
+    return 1;
+  }
+
+  double sum_squared_error = 0.0;
+  for( size_t b = 0; b * BLOCK < FRAMES; b++ ) {
+    size_t frames = ( FRAMES - b * BLOCK < BLOCK ) ? FRAMES - b * BLOCK : BLOCK;
+    const uint8_t* block = one + b * 512;
+
+    for( int ch = 0; ch < 2; ch++ ) {
+      int16_t first = stereo_samples[b * BLOCK * 2 + ch];
+      if( block[ch * 4] != (uint8_t)first || block[ch * 4 + 1] != (uint8_t)( (uint16_t)first >> 8 )
+          || block[ch * 4 + 2] > 88 || block[ch * 4 + 3] != 0 ) {
+        printf( "  FAIL: Bad header in block %zu channel %d\n", b, ch );
+        free( one );
+        free( four );
+        return 1;
+      }
+
+      decode_ima_adpcm_block( block, frames, 2, ch, decoded );
+      for( size_t f = 0; f < frames; f++ ) {
+        double diff = stereo_samples[( b * BLOCK + f ) * 2 + ch] - decoded[f];
+        sum_squared_error += diff * diff;
+      }
+    }
+  }
+  double rms_error = sqrt( sum_squared_error / ( FRAMES * 2 ) );
+
+  printf( "  RMS reconstruction error: %.2f\n", rms_error );
+  free( one );
+  free( four );
+
+  if( rms_error > 1000.0 ) {
+    printf( "  FAIL: RMS error too high (%.2f)\n", rms_error );
+    return 1;
+  }
+
+  printf( "  PASS: Blocks encoded to %zu bytes\n", one_size );
+  return 0;
+}
+
+// Test 10: Verify the SIMD block encoder matches the scalar reference
+static int test_simd_blocks( void )
+{
+  printf( "Test 10: SIMD block encoder matches scalar\n" );
+
+  enum { SAMPLES = 40000 };
+  static int16_t samples[SAMPLES];
+  uint32_t noise = 1;
+  int failed = 0;
+
+  for( int i = 0; i < SAMPLES; i++ ) {
+    noise = noise * 1664525u + 1013904223u;
+    samples[i] = (int16_t)( 20000 * sin( i * 0.013 ) ) + (int16_t)( ( noise >> 20 ) - 2048 );
+  }
+  samples[1000] = 32767;
+  samples[1001] = -32768;
+
+  unsigned lanes = ima_adpcm_simd_lanes( 1 );
+  for( int is16bit = 0; is16bit < 2; is16bit++ ) {
+    for( int channels = 1; channels <= 2; channels++ ) {
+      size_t scalar_size = 0, simd_size = 0;
+
+      ima_adpcm_simd_lanes( 0 );
+      uint8_t* scalar = encode_ima_adpcm_blocks( samples, SAMPLES, is16bit, channels, 505, 1, &scalar_size );
+      ima_adpcm_simd_lanes( 1 );
+      uint8_t* simd = encode_ima_adpcm_blocks( samples, SAMPLES, is16bit, channels, 505, 2, &simd_size );
+
+      if( !scalar || !simd || scalar_size != simd_size || memcmp( scalar, simd, scalar_size ) != 0 ) {
+        printf( "  FAIL: %s %s output differs from scalar\n", is16bit ? "16-bit" : "8-bit",
+                ( channels == 2 ) ? "stereo" : "mono" );
+        failed = 1;
+      }
+      free( scalar );
+      free( simd );
+    }
+  }
+
+  if( failed ) return 1;
+
+  printf( "  PASS: %u-lane encoder is bit-exact\n", lanes );
+  return 0;
+}
+
+// Reference quantizer: the original branching encoder, kept to pin the output
+static uint8_t reference_nibble( int sample, int* predictor, int* index )
+{
+  int step = stepTable[*index];
+  int diff = sample - *predictor;
+  int sign = ( diff < 0 ) ? 8 : 0;
+  int delta = 0;
+  int diffq;
+
+  if( sign ) diff = -diff;
+  if( diff >= step ) { delta = 4; diff -= step; }
+  if( diff >= ( step >> 1 ) ) { delta |= 2; diff -= step >> 1; }
+  if( diff >= ( step >> 2 ) ) delta |= 1;
+
+  diffq = step >> 3;
+  if( delta & 4 ) diffq += step;
+  if( delta & 2 ) diffq += step >> 1;
+  if( delta & 1 ) diffq += step >> 2;
+
+  *predictor += sign ? -diffq : diffq;
+  if( *predictor > 32767 ) *predictor = 32767;
+  if( *predictor < -32768 ) *predictor = -32768;
+
+  *index += indexTable[sign | delta];
+  if( *index < 0 ) *index = 0;
+  if( *index > 88 ) *index = 88;
+
+  return (uint8_t)( sign | delta );
+}
+
+// Test 11: Verify every stream specialization is bit-exact with the reference
+static int test_bit_exact( void )
+{
+  printf( "Test 11: Stream encoder bit-exact with reference\n" );
+
+  enum { SAMPLES = 20001 };
+  static int16_t pcm16[SAMPLES];
+  static uint8_t pcm8[SAMPLES];
+  static uint8_t expected[( SAMPLES + 1 ) / 2];
+  uint32_t noise = 3;
+  int failed = 0;
+
+  for( int i = 0; i < SAMPLES; i++ ) {
+    noise = noise * 1664525u + 1013904223u;
+    pcm16[i] = ( i % 5000 < 2500 ) ? (int16_t)( noise >> 16 ) : (int16_t)( 9000 * sin( i * 0.05 ) );
+    pcm8[i] = (uint8_t)( noise >> 24 );
+  }
+
+  for( int is16bit = 0; is16bit < 2; is16bit++ ) {
+    for( int channels = 1; channels <= 2; channels++ ) {
+      size_t samples = SAMPLES - ( channels == 2 );
+      int predictor[2] = { 0, 0 };
+      int index[2] = { 0, 0 };
+      size_t out_size = 0;
+
+      memset( expected, 0, sizeof( expected ) );
+      for( size_t i = 0; i < samples; i++ ) {
+        int ch = ( channels == 2 ) ? (int)( i & 1 ) : 0;
+        int sample = is16bit ? pcm16[i] : ( pcm8[i] - 128 ) << 8;
+        uint8_t nibble = reference_nibble( sample, &predictor[ch], &index[ch] );
+        expected[i / 2] |= (uint8_t)( ( i & 1 ) ? nibble << 4 : nibble );
+      }
+
+      uint8_t* output = encode_ima_adpcm( is16bit ? (const void*)pcm16 : (const void*)pcm8,
+                                          samples, is16bit, channels, &out_size );
+      if( !output || out_size != ( samples + 1 ) / 2 || memcmp( output, expected, out_size ) != 0 ) {
+        printf( "  FAIL: %s %s output differs from reference\n", is16bit ? "16-bit" : "8-bit",
+                ( channels == 2 ) ? "stereo" : "mono" );
+        failed = 1;
+      }
+      free( output );
+    }
+  }
+
+  if( failed ) return 1;
+
+  printf( "  PASS: All four specializations match\n" );
+  return 0;
+}
+
+// Test 12: Verify feeding the incremental encoder in pieces matches one call
+static int test_incremental( void )
+{
+  printf( "Test 12: Incremental encoder across chunk boundaries\n" );
+
+  enum { SAMPLES = 10002 };
+  static int16_t samples[SAMPLES];
+  static uint8_t chunked[SAMPLES / 2 + 1];
+  static const size_t chunk_sizes[] = { 1, 2, 3, 7, 64, 1001 };
+  uint32_t noise = 5;
+  int failed = 0;
+
+  for( int i = 0; i < SAMPLES; i++ ) {
+    noise = noise * 1664525u + 1013904223u;
+    samples[i] = (int16_t)( 15000 * sin( i * 0.02 ) ) + (int16_t)( ( noise >> 21 ) - 1024 );
+  }
+
+  for( int channels = 1; channels <= 2; channels++ ) {
+    for( size_t c = 0; c < sizeof( chunk_sizes ) / sizeof( chunk_sizes[0] ); c++ ) {
+      // Mono also runs with an odd total so finish() has a nibble to flush.
+      size_t total = SAMPLES - ( channels == 1 );
+      size_t whole_size = 0, o = 0;
+      ima_adpcm_encoder_t enc;
+
+      uint8_t* whole = encode_ima_adpcm( samples, total, 1, channels, &whole_size );
+      ima_adpcm_encoder_init( &enc, 1, channels );
+      for( size_t i = 0; i < total; i += chunk_sizes[c] ) {
+        size_t n = ( total - i < chunk_sizes[c] ) ? total - i : chunk_sizes[c];
+        o += ima_adpcm_encoder_feed( &enc, samples + i, n, chunked + o );
+      }
+      o += ima_adpcm_encoder_finish( &enc, chunked + o );
+
+      if( !whole || o != whole_size || memcmp( whole, chunked, o ) != 0 ) {
+        printf( "  FAIL: %s in %zu-sample chunks differs from one call\n",
+                ( channels == 2 ) ? "stereo" : "mono", chunk_sizes[c] );
+        failed = 1;
+      }
+      free( whole );
+    }
+  }
+
+  if( failed ) return 1;
+
+  printf( "  PASS: Chunked output matches\n" );
+  return 0;
+}
+
+// Decode mono ADPCM (low nibble first, as encoded) from a seek point's state
+static void decode_ima_adpcm_from( const uint8_t* adpcm_data, const ima_adpcm_snapshot_t* state,
+                                   size_t num_samples, int16_t* pcm_out )
+{
+  int predictor = state->predictor[0];
+  int index = state->index[0];
+
+  for( size_t i = 0; i < num_samples; i++ ) {
+    uint8_t nibble = ( i & 1 ) ? ( adpcm_data[i / 2] >> 4 ) : ( adpcm_data[i / 2] & 0x0F );
+    int step = stepTable[index];
+    int diff = step >> 3;
+
+    if( nibble & 4 ) diff += step;
+    if( nibble & 2 ) diff += step >> 1;
+    if( nibble & 1 ) diff += step >> 2;
+    if( nibble & 8 ) predictor -= diff;
+    else predictor += diff;
+
+    if( predictor > 32767 ) predictor = 32767;
+    if( predictor < -32768 ) predictor = -32768;
+
+    pcm_out[i] = (int16_t)predictor;
+
+    index += indexTable[nibble];
+    if( index < 0 ) index = 0;
+    if( index > 88 ) index = 88;
+  }
+}
+
+// Test 13: Verify seek points leave the stream unchanged and resume decoding exactly
+static int test_seek_points( void )
+{
+  printf( "Test 13: Seek point snapshots\n" );
+
+  enum { SAMPLES = 4096, INTERVAL = 256 };
+  static int16_t samples[SAMPLES];
+  static int16_t full[SAMPLES];
+  static int16_t resumed[SAMPLES];
+  ima_adpcm_snapshot_t table[SAMPLES / INTERVAL];
+  size_t plain_size = 0, seek_size = 0;
+
+  for( int i = 0; i < SAMPLES; i++ ) {
+    samples[i] = (int16_t)( 14000 * sin( i * 0.031 ) + 4000 * sin( i * 0.37 ) );
+  }
+
+  size_t count = ima_adpcm_seek_count( SAMPLES, 1, INTERVAL );
+  uint8_t* plain = encode_ima_adpcm( samples, SAMPLES, 1, 1, &plain_size );
+  uint8_t* seek = encode_ima_adpcm_seek( samples, SAMPLES, 1, 1, INTERVAL, table, &seek_size );
+
+  if( count != SAMPLES / INTERVAL || !plain || !seek || plain_size != seek_size
+      || memcmp( plain, seek, plain_size ) != 0 ) {
+    printf( "  FAIL: Seek recording changed the stream\n" );
+    free( plain );
+    free( seek );
+    return 1;
+  }
+
+  // Decode everything with the seek-table decoder from state 0, then from each point.
+  ima_adpcm_snapshot_t start = { { 0, 0 }, { 0, 0 } };
+  decode_ima_adpcm_from( plain, &start, SAMPLES, full );
+  for( size_t k = 1; k < count; k++ ) {
+    size_t first = k * INTERVAL;
+    decode_ima_adpcm_from( plain + first / 2, &table[k], SAMPLES - first, resumed );
+    if( memcmp( resumed, full + first, ( SAMPLES - first ) * sizeof( int16_t ) ) != 0 ) {
+      printf( "  FAIL: Decoding from seek point %zu differs\n", k );
+      free( plain );
+      free( seek );
+      return 1;
+    }
+  }
+
+  printf( "  PASS: %zu seek points resume exactly\n", count );
+  free( plain );
+  free( seek );
+  return 0;
+}
+
+// Test 14: Verify the host decoder against the reference decoder and its SIMD paths against scalar
+static int test_host_decoder( void )
+{
+  printf( "Test 14: Host decoder and round-trip measurement\n" );
+
+  enum { SAMPLES = 40001, BLOCK = 505 };
+  static int16_t samples[SAMPLES];
+  static int16_t expect[SAMPLES];
+  static int16_t scalar_out[SAMPLES];
+  static int16_t simd_out[SAMPLES];
+  ima_adpcm_snapshot_t start = { { 0, 0 }, { 0, 0 } };
+  ima_adpcm_error_t scalar_err = { 0, 0, 0, 0 }, simd_err = { 0, 0, 0, 0 };
+  size_t size = 0, used = 0;
+  uint32_t noise = 7;
+  int failed = 0;
+
+  for( int i = 0; i < SAMPLES; i++ ) {
+    noise = noise * 1664525u + 1013904223u;
+    samples[i] = (int16_t)( 18000 * sin( i * 0.021 ) ) + (int16_t)( ( noise >> 21 ) - 1024 );
+  }
+
+  // Mono stream with an odd sample count, decoded in two pieces.
+  uint8_t* stream = encode_ima_adpcm( samples, SAMPLES, 1, 1, &size );
+  decode_ima_adpcm_from( stream, &start, SAMPLES, expect );
+  used = decode_ima_adpcm_stream( &start, stream, 10000, 1, scalar_out );
+  used += decode_ima_adpcm_stream( &start, stream + used, SAMPLES - 10000, 1, scalar_out + 10000 );
+  if( used != size || memcmp( scalar_out, expect, sizeof( expect ) ) != 0 ) {
+    printf( "  FAIL: Stream decode differs from the reference\n" );
+    failed = 1;
+  }
+  free( stream );
+
+  // Stereo blocks: the lane decoder must match the scalar one.
+  uint8_t* blocks = encode_ima_adpcm_blocks( samples, SAMPLES - 1, 1, 2, BLOCK, 1, &size );
+  ima_adpcm_simd_lanes( 0 );
+  int scalar_rc = decode_ima_adpcm_blocks( blocks, size, SAMPLES - 1, 2, BLOCK, scalar_out );
+  ima_adpcm_verify( samples, SAMPLES - 1, 1, 2, BLOCK, blocks, size, &scalar_err );
+  unsigned lanes = ima_adpcm_simd_lanes( 1 );
+  int simd_rc = decode_ima_adpcm_blocks( blocks, size, SAMPLES - 1, 2, BLOCK, simd_out );
+  ima_adpcm_verify( samples, SAMPLES - 1, 1, 2, BLOCK, blocks, size, &simd_err );
+
+  if( scalar_rc != 0 || simd_rc != 0 || memcmp( scalar_out, simd_out, ( SAMPLES - 1 ) * sizeof( int16_t ) ) != 0 ) {
+    printf( "  FAIL: Block decode differs between scalar and %u lanes\n", lanes );
+    failed = 1;
+  }
+  if( scalar_err.signal != simd_err.signal || scalar_err.noise != simd_err.noise
+      || scalar_err.peak != simd_err.peak || scalar_err.samples != SAMPLES - 1
+      || scalar_err.noise == 0 || scalar_err.signal / scalar_err.noise < 100 ) {
+    printf( "  FAIL: Round-trip totals differ or SNR is below 20 dB\n" );
+    failed = 1;
+  }
+  if( decode_ima_adpcm_blocks( blocks, size - 1, SAMPLES - 1, 2, BLOCK, simd_out ) != -1 ) {
+    printf( "  FAIL: Truncated blocks accepted\n" );
+    failed = 1;
+  }
+  free( blocks );
+
+  if( failed ) return 1;
+
+  printf( "  PASS: Decoder bit-exact, %.1f dB SNR, peak error %u\n",
+          10.0 * log10( (double) scalar_err.signal / (double) scalar_err.noise ), (unsigned) scalar_err.peak );
+  return 0;
+}
+
+// Test 15: Verify in-place encoding against the allocating encoder
+static int test_in_place( void )
+{
+  printf( "Test 15: In-place stream encoding\n" );
+
+  enum { SAMPLES = 50001, INTERVAL = 1000 };
+  static int16_t samples[SAMPLES];
+  static int16_t work[SAMPLES];
+  static uint8_t work8[SAMPLES];
+  ima_adpcm_snapshot_t table[SAMPLES / INTERVAL + 1];
+  ima_adpcm_snapshot_t expect_table[SAMPLES / INTERVAL + 1];
+  ima_adpcm_error_t err = { 0, 0, 0, 0 }, expect_err = { 0, 0, 0, 0 };
+  size_t size = 0, expect_size = 0;
+  int failed = 0;
+
+  for( int i = 0; i < SAMPLES; i++ ) {
+    samples[i] = (int16_t)( 20000 * sin( i * 0.013 ) + 6000 * sin( i * 0.41 ) );
+    work8[i] = (uint8_t)( ( samples[i] >> 8 ) + 128 );
+  }
+
+  // Mono 16-bit with an odd sample count, measured on the way.
+  uint8_t* expect = encode_ima_adpcm( samples, SAMPLES, 1, 1, &expect_size );
+  ima_adpcm_verify( samples, SAMPLES, 1, 1, 0, expect, expect_size, &expect_err );
+  memcpy( work, samples, sizeof( work ) );
+  if( encode_ima_adpcm_in_place( work, SAMPLES, 1, 0, 1, 0, NULL, &err, &size ) != 0
+      || size != expect_size || memcmp( work, expect, size ) != 0 ) {
+    printf( "  FAIL: 16-bit mono output differs from encode_ima_adpcm\n" );
+    failed = 1;
+  }
+  if( err.samples != expect_err.samples || err.signal != expect_err.signal
+      || err.noise != expect_err.noise || err.peak != expect_err.peak ) {
+    printf( "  FAIL: In-place round-trip totals differ from ima_adpcm_verify\n" );
+    failed = 1;
+  }
+  free( expect );
+
+  // Stereo 16-bit with seek points.
+  expect = encode_ima_adpcm_seek( samples, SAMPLES - 1, 1, 2, INTERVAL, expect_table, &expect_size );
+  memcpy( work, samples, sizeof( work ) );
+  if( encode_ima_adpcm_in_place( work, SAMPLES - 1, 1, 0, 2, INTERVAL, table, NULL, &size ) != 0
+      || size != expect_size || memcmp( work, expect, size ) != 0
+      || memcmp( table, expect_table, ima_adpcm_seek_count( SAMPLES - 1, 2, INTERVAL ) * sizeof( table[0] ) ) != 0 ) {
+    printf( "  FAIL: 16-bit stereo seek output differs from encode_ima_adpcm_seek\n" );
+    failed = 1;
+  }
+  free( expect );
+
+  // 8-bit mono, where output and input cursors are closest.
+  expect = encode_ima_adpcm( work8, SAMPLES, 0, 1, &expect_size );
+  if( encode_ima_adpcm_in_place( work8, SAMPLES, 0, 0, 1, 0, NULL, NULL, &size ) != 0
+      || size != expect_size || memcmp( work8, expect, size ) != 0 ) {
+    printf( "  FAIL: 8-bit mono output differs from encode_ima_adpcm\n" );
+    failed = 1;
+  }
+  free( expect );
+
+  if( failed ) return 1;
+
+  printf( "  PASS: In-place output matches, %zu bytes\n", size );
+  return 0;
+}
+
+// Test 16: Verify the vector byte swaps against scalar and big-endian in-place encoding
+static int test_ingest( void )
+{
+  printf( "Test 16: Endian-aware ingest\n" );
+
+  enum { BYTES = 1000, SAMPLES = 40001 };
+  static uint8_t src[BYTES + 8], simd[BYTES + 8], scalar[BYTES + 8], inplace[BYTES + 8];
+  static int16_t samples[SAMPLES];
+  static uint8_t be[SAMPLES * 2];
+  static const size_t words[] = { 2, 4, 8 };
+  ima_adpcm_error_t err = { 0, 0, 0, 0 }, expect_err = { 0, 0, 0, 0 };
+  size_t size = 0, expect_size = 0;
+  unsigned vector = pcm_ingest_simd( 1 );
+  int failed = 0;
+
+  for( int i = 0; i < BYTES + 8; i++ ) {
+    src[i] = (uint8_t)( i * 151 + 7 );
+  }
+
+  // Every word size, length and start alignment, copied and in place.
+  for( size_t w = 0; w < sizeof( words ) / sizeof( words[0] ) && !failed; w++ ) {
+    for( size_t len = 0; len <= BYTES && !failed; len += ( len < 160 ) ? 1 : 97 ) {
+      for( size_t at = 0; at < 8 && !failed; at += 3 ) {
+        pcm_ingest_simd( 0 );
+        pcm_swap_words( scalar, src + at, len, words[w] );
+        pcm_ingest_simd( 1 );
+        pcm_swap_words( simd, src + at, len, words[w] );
+        memcpy( inplace + at, src + at, len );
+        pcm_swap_words( inplace + at, inplace + at, len, words[w] );
+        if( memcmp( simd, scalar, len ) != 0 || memcmp( inplace + at, scalar, len ) != 0 ) {
+          printf( "  FAIL: %zu-byte words, %zu bytes at +%zu differ from scalar\n", words[w], len, at );
+          failed = 1;
+        }
+        for( size_t i = 0; i + words[w] <= len && !failed; i++ ) {
+          size_t word = i - i % words[w];
+          if( scalar[i] != src[at + word + words[w] - 1 - i % words[w]] ) {
+            printf( "  FAIL: %zu-byte word at %zu not reversed\n", words[w], word );
+            failed = 1;
+          }
+        }
+      }
+    }
+  }
+
+  // Big-endian 16-bit PCM encodes, and measures, like the same samples in host order.
+  for( int i = 0; i < SAMPLES; i++ ) {
+    samples[i] = (int16_t)( 18000 * sin( i * 0.021 ) + 5000 * sin( i * 0.37 ) );
+    be[2 * i] = (uint8_t)( (uint16_t) samples[i] >> 8 );
+    be[2 * i + 1] = (uint8_t)( samples[i] & 0xFF );
+  }
+  uint8_t* expect = encode_ima_adpcm( samples, SAMPLES, 1, 1, &expect_size );
+  ima_adpcm_verify( samples, SAMPLES, 1, 1, 0, expect, expect_size, &expect_err );
+  if( encode_ima_adpcm_in_place( be, SAMPLES, 1, 1, 1, 0, NULL, &err, &size ) != 0
+      || size != expect_size || memcmp( be, expect, size ) != 0
+      || err.noise != expect_err.noise || err.peak != expect_err.peak ) {
+    printf( "  FAIL: Big-endian in-place output differs from host-order encoding\n" );
+    failed = 1;
+  }
+  free( expect );
+
+  if( failed ) return 1;
+
+  printf( "  PASS: Swaps match scalar (%u-byte vectors), big-endian encoding matches\n", vector );
+  return 0;
+}
+
 int main( void )
 {
   printf( "=== IMA ADPCM Encoder Test Suite ===\n\n" );
   
-  int total_tests = 8;
+  int total_tests = 16;
   int passed_tests = 0;
   
   passed_tests += !test_output_size();
@@ -301,6 +846,14 @@ int main( void )
   passed_tests += !test_null_input();
   passed_tests += !test_zero_size();
   passed_tests += !test_stereo_input();
+  passed_tests += !test_blocks();
+  passed_tests += !test_simd_blocks();
+  passed_tests += !test_bit_exact();
+  passed_tests += !test_incremental();
+  passed_tests += !test_seek_points();
+  passed_tests += !test_host_decoder();
+  passed_tests += !test_in_place();
+  passed_tests += !test_ingest();
   
   printf( "\n=== Test Results ===\n" );
   printf( "Passed: %d/%d\n", passed_tests, total_tests );
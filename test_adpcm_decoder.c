@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "adpcm.h"
+// Written by raw2header --adpcm-decoder at build time
+#include "ima_adpcm_decode.h"
+
+// Encoder tables, for the reference decoder
+extern const int indexTable[16];
+extern const int stepTable[89];
+
+#define TEST_FRAMES   5000
+
+// Reference decode of one nibble, written out the long way.
+static int16_t reference_nibble( unsigned nibble, int* predictor, int* index )
+{
+  int step = stepTable[*index];
+  int diff = step >> 3;
+
+  if( nibble & 4 ) diff += step;
+  if( nibble & 2 ) diff += step >> 1;
+  if( nibble & 1 ) diff += step >> 2;
+  if( nibble & 8 ) *predictor -= diff;
+  else *predictor += diff;
+
+  if( *predictor > 32767 ) *predictor = 32767;
+  if( *predictor < -32768 ) *predictor = -32768;
+
+  *index += indexTable[nibble];
+  if( *index < 0 ) *index = 0;
+  if( *index > 88 ) *index = 88;
+
+  return (int16_t) *predictor;
+}
+
+// Reference decode of a whole stream: one nibble per sample, low nibble first.
+static void reference_stream( const uint8_t* adpcm, size_t samples, int channels, int16_t* out )
+{
+  int predictor[2] = { 0, 0 };
+  int index[2] = { 0, 0 };
+
+  for( size_t i = 0; i < samples; i++ )
+  {
+    unsigned nibble = ( i & 1 ) ? ( adpcm[i / 2] >> 4 ) : ( adpcm[i / 2] & 0x0F );
+    int ch = (int)( i % (size_t) channels );
+
+    out[i] = reference_nibble( nibble, &predictor[ch], &index[ch] );
+  }
+}
+
+// Fill interleaved 16-bit PCM with a different tone per channel.
+static void make_tone( int16_t* pcm, size_t frames, int channels )
+{
+  for( size_t f = 0; f < frames; f++ )
+  {
+    for( int ch = 0; ch < channels; ch++ )
+    {
+      pcm[f * channels + ch] = (int16_t)( 12000 * sin( f * ( 0.02 + 0.05 * ch ) )
+                                          + 6000 * sin( f * 0.31 ) );
+    }
+  }
+}
+
+// Signal to noise ratio of decoded against original, in dB.
+static double snr_db( const int16_t* pcm, const int16_t* decoded, size_t n )
+{
+  double signal = 0.0, noise = 0.0;
+
+  for( size_t i = 0; i < n; i++ )
+  {
+    double e = (double) pcm[i] - decoded[i];
+    signal += (double) pcm[i] * pcm[i];
+    noise += e * e;
+  }
+  return 10.0 * log10( signal / ( noise + 1.0 ) );
+}
+
+// Test 1: Streams decode bit-exactly, in one call and in uneven pieces
+static int test_streams( void )
+{
+  static int16_t pcm[TEST_FRAMES * 2];
+  static int16_t expect[TEST_FRAMES * 2];
+  static int16_t got[TEST_FRAMES * 2];
+
+  printf( "Test 1: Mono and stereo streams\n" );
+
+  for( int channels = 1; channels <= 2; channels++ )
+  {
+    // An odd mono length checks the trailing half byte.
+    size_t samples = TEST_FRAMES * channels - ( channels == 1 );
+    size_t size = 0;
+    uint8_t* adpcm;
+    ima_adpcm_decoder_t dec;
+    const uint8_t* src;
+    size_t done = 0;
+
+    make_tone( pcm, TEST_FRAMES, channels );
+    adpcm = encode_ima_adpcm( pcm, samples, 1, channels, &size );
+    if( !adpcm )
+    {
+      printf( "  FAIL: Encoding %d channel(s) failed\n", channels );
+      return 1;
+    }
+    reference_stream( adpcm, samples, channels, expect );
+
+    ima_adpcm_decode_init( &dec );
+    src = adpcm;
+    for( size_t piece = 2; done < samples; piece = piece * 3 % 250 + 2 )
+    {
+      size_t n = ( samples - done < piece ) ? samples - done : piece;
+
+      if( channels == 1 )
+        src = ima_adpcm_decode_mono( &dec, src, got + done, n );
+      else
+        src = ima_adpcm_decode_stereo( &dec, src, got + done, n / 2 );
+      done += n;
+    }
+
+    if( src != adpcm + size || memcmp( got, expect, samples * sizeof( int16_t ) ) != 0 )
+    {
+      printf( "  FAIL: %d channel decode differs from the reference\n", channels );
+      free( adpcm );
+      return 1;
+    }
+    if( snr_db( pcm, got, samples ) < 20.0 )
+    {
+      printf( "  FAIL: %d channel SNR too low (%.1f dB)\n", channels, snr_db( pcm, got, samples ) );
+      free( adpcm );
+      return 1;
+    }
+    printf( "  %d channel(s): %.1f dB SNR\n", channels, snr_db( pcm, got, samples ) );
+    free( adpcm );
+  }
+
+  printf( "  PASS: Streams match the reference decoder\n" );
+  return 0;
+}
+
+// Test 2: Blocks decode to the same samples as the stream reference per block
+static int test_blocks( void )
+{
+  static int16_t pcm[TEST_FRAMES * 2];
+  static int16_t got[TEST_FRAMES * 2];
+  const size_t block_samples = 505;
+
+  printf( "Test 2: Block decode\n" );
+
+  for( int channels = 1; channels <= 2; channels++ )
+  {
+    size_t size = 0;
+    uint8_t* adpcm;
+    const uint8_t* src;
+    size_t f;
+
+    make_tone( pcm, TEST_FRAMES, channels );
+    adpcm = encode_ima_adpcm_blocks( pcm, TEST_FRAMES * channels, 1, channels, block_samples, 1, &size );
+    if( !adpcm )
+    {
+      printf( "  FAIL: Block encoding failed\n" );
+      return 1;
+    }
+
+    src = adpcm;
+    for( f = 0; f < TEST_FRAMES; f += block_samples )
+    {
+      size_t n = ( TEST_FRAMES - f < block_samples ) ? TEST_FRAMES - f : block_samples;
+
+      src = ima_adpcm_decode_block( src, got + f * channels, n, channels );
+    }
+
+    if( src != adpcm + size )
+    {
+      printf( "  FAIL: %d channel blocks consumed %zu of %zu bytes\n", channels,
+              (size_t)( src - adpcm ), size );
+      free( adpcm );
+      return 1;
+    }
+    if( snr_db( pcm, got, TEST_FRAMES * channels ) < 20.0 )
+    {
+      printf( "  FAIL: %d channel block SNR too low\n", channels );
+      free( adpcm );
+      return 1;
+    }
+    for( f = 0; f < TEST_FRAMES; f += block_samples )
+    {
+      for( int ch = 0; ch < channels; ch++ )
+      {
+        if( got[f * channels + ch] != pcm[f * channels + ch] )
+        {
+          printf( "  FAIL: Block at frame %zu does not start on its first sample\n", f );
+          free( adpcm );
+          return 1;
+        }
+      }
+    }
+    printf( "  %d channel(s): %.1f dB SNR\n", channels, snr_db( pcm, got, TEST_FRAMES * channels ) );
+    free( adpcm );
+  }
+
+  printf( "  PASS: Blocks decode in place\n" );
+  return 0;
+}
+
+// Test 3: Decoding from any seek point matches decoding from the start
+static int test_seek( void )
+{
+  static int16_t pcm[TEST_FRAMES * 2];
+  static int16_t full[TEST_FRAMES * 2];
+  static int16_t got[TEST_FRAMES * 2];
+  const size_t interval = 128;
+  const int channels = 2;
+  ima_adpcm_snapshot_t table[TEST_FRAMES / 128 + 1];
+  size_t count = ima_adpcm_seek_count( TEST_FRAMES, channels, interval );
+  size_t size = 0;
+  uint8_t* adpcm;
+
+  printf( "Test 3: Seek table resume\n" );
+
+  make_tone( pcm, TEST_FRAMES, channels );
+  adpcm = encode_ima_adpcm_seek( pcm, TEST_FRAMES * channels, 1, channels, interval, table, &size );
+  if( !adpcm )
+  {
+    printf( "  FAIL: Seek encoding failed\n" );
+    return 1;
+  }
+  reference_stream( adpcm, TEST_FRAMES * channels, channels, full );
+
+  for( size_t k = 0; k < count; k++ )
+  {
+    // Same layout as the generated name_seek[ COUNT ][ C ][ 2 ] table.
+    int16_t entry[2][2];
+    ima_adpcm_decoder_t dec;
+    size_t first = k * interval;
+
+    for( int ch = 0; ch < channels; ch++ )
+    {
+      entry[ch][0] = table[k].predictor[ch];
+      entry[ch][1] = table[k].index[ch];
+    }
+    ima_adpcm_decode_seek( &dec, (const int16_t (*)[2]) entry, channels );
+    ima_adpcm_decode_stereo( &dec, adpcm + first * channels / 2, got, TEST_FRAMES - first );
+    if( memcmp( got, full + first * channels, ( TEST_FRAMES - first ) * channels * sizeof( int16_t ) ) != 0 )
+    {
+      printf( "  FAIL: Resuming at seek point %zu differs\n", k );
+      free( adpcm );
+      return 1;
+    }
+  }
+
+  printf( "  PASS: %zu seek points resume exactly\n", count );
+  free( adpcm );
+  return 0;
+}
+
+int main( void )
+{
+  printf( "=== Generated IMA ADPCM Decoder Test Suite ===\n\n" );
+
+  int total_tests = 3;
+  int passed_tests = 0;
+
+  passed_tests += !test_streams();
+  passed_tests += !test_blocks();
+  passed_tests += !test_seek();
+
+  printf( "\n=== Test Results ===\n" );
+  printf( "Passed: %d/%d\n", passed_tests, total_tests );
+
+  return ( passed_tests == total_tests ) ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Assembles --incbin output from a directory other than the one it was made in.
+
+The .S is generated with relative paths, then compiled and linked from
+another directory the way a build system would, and the linked array is
+checked against the input: once including the input file directly and once
+through the .bin sidecar that stdin input writes.
+
+Usage: test_incbin.py <raw2header> <C compiler> <scratch dir>
+"""
+
+import os
+import shutil
+import subprocess
+import sys
+
+
+MAIN = """#include <stdio.h>
+#include "%s"
+
+int main( void )
+{
+  unsigned long sum = 0;
+
+  for( unsigned long i = 0; i < %s_SZ; i++ )
+    sum = sum * 31 + %s[i];
+  printf( "%%lu %%lu\\n", (unsigned long) %s_SZ, sum );
+  return 0;
+}
+"""
+
+
+def checksum(data):
+    total = 0
+    for b in data:
+        total = (total * 31 + b) & 0xFFFFFFFFFFFFFFFF
+    return total
+
+
+def main():
+    tool, cc, scratch = sys.argv[1], sys.argv[2], os.path.abspath(sys.argv[3])
+    shutil.rmtree(scratch, ignore_errors=True)
+    gen = os.path.join(scratch, "gen")
+    build = os.path.join(scratch, "build")
+    os.makedirs(os.path.join(gen, "sub"))
+    os.makedirs(build)
+
+    data = bytes((i * 59 + (i >> 3)) & 0xFF for i in range(10000))
+    with open(os.path.join(gen, "in.bin"), "wb") as f:
+        f.write(data)
+
+    cases = [("direct", ["--incbin", "in.bin", "sub/direct.h", "direct"], None),
+             ("sidecar", ["--incbin", "-", "sub/sidecar.h", "sidecar"], data)]
+    for name, args, stdin in cases:
+        result = subprocess.run([tool] + args, cwd=gen, input=stdin,
+                                stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+        if result.returncode != 0:
+            print("FAIL: %s conversion: %s" % (name, result.stderr.decode()))
+            return 1
+
+        # Assemble from the header's directory and link from a third one.
+        header_dir = os.path.join(gen, "sub")
+        with open(os.path.join(build, name + "_main.c"), "w") as f:
+            f.write(MAIN % (name + ".h", name.upper(), name, name.upper()))
+        steps = [(header_dir, [cc, "-c", name + ".S", "-o", os.path.join(build, name + ".o")]),
+                 (build, [cc, "-I", header_dir, name + "_main.c", name + ".o", "-o", name])]
+        for cwd, command in steps:
+            result = subprocess.run(command, cwd=cwd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+            if result.returncode != 0:
+                print("FAIL: %s: %s" % (" ".join(command), result.stderr.decode()))
+                return 1
+
+        out = subprocess.run([os.path.join(build, name)], stdout=subprocess.PIPE, check=True).stdout
+        if out.decode().split() != [str(len(data)), str(checksum(data))]:
+            print("FAIL: %s array does not hold the input: %r" % (name, out))
+            return 1
+
+    print("PASS: --incbin output assembles and links from other directories")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "raw2header_lib.h"
+
+#define SHARED_LEN          ( 1024 * 1024 )
+#define SHARED_THREADS      4
+
+typedef struct
+{
+  const r2h_converter_t* cv;
+  const uint8_t* input;
+  char* text;
+  size_t len;
+  int state;
+} shared_run_t;
+
+
+static void* convertShared( void* arg )
+{
+  shared_run_t* run = arg;
+
+  run->state = r2h_convert_buffer( run->cv, run->input, SHARED_LEN, "shared", &run->text, &run->len );
+  return 0;
+}
+
+
+/** Read a descriptor from offset 0 to its end into a NUL-terminated buffer.
+ */
+static char* readBack( int fd, size_t* len )
+{
+  size_t cap = 4096;
+  char* buf = malloc( cap );
+  ssize_t got;
+
+  *len = 0;
+  while( buf != 0 && ( got = pread( fd, buf + *len, cap - *len - 1, (off_t) *len ) ) > 0 )
+  {
+    *len += (size_t) got;
+    if( cap - *len == 1 )
+    {
+      char* grown = realloc( buf, cap * 2 );
+
+      if( grown == 0 )
+      {
+        free( buf );
+      }
+      buf = grown;
+      cap *= 2;
+    }
+  }
+  if( buf != 0 )
+  {
+    buf[ *len ] = '\0';
+  }
+
+  return buf;
+}
+
+
+int main( void )
+{
+  const uint8_t tiny[3] = { 0x11, 0x22, 0x33 };
+  char* flags_b16[] = { "-b16", "--pad=0x55" };
+  char* flags_incbin[] = { "--incbin" };
+  char tmp_path[] = "/tmp/raw2header_lib_test_XXXXXX";
+  shared_run_t runs[ SHARED_THREADS ];
+  pthread_t threads[ SHARED_THREADS ];
+  r2h_converter_t* cv = r2h_converter_new();
+  uint8_t* shared_input;
+  char* text = 0;
+  char* fd_text;
+  size_t len = 0;
+  size_t fd_len;
+  int pipe_fds[2];
+  int out_fd;
+
+  if( cv == 0 )
+  {
+    fprintf( stderr, "FAIL: r2h_converter_new failed\n" );
+    return 1;
+  }
+
+  // Memory to memory, 8-bit default.
+  if( r2h_convert_buffer( cv, tiny, sizeof( tiny ), "tiny", &text, &len ) != 0
+      || len != strlen( text ) || strstr( text, "#define TINY_SZ 3" ) == 0
+      || strstr( text, "  0x11, 0x22, 0x33\n" ) == 0 )
+  {
+    fprintf( stderr, "FAIL: 8-bit buffer conversion\n" );
+    return 1;
+  }
+  free( text );
+
+  // Flags as on the command line: padded big-endian words.
+  if( r2h_converter_set_flags( cv, 2, flags_b16 ) != 0
+      || r2h_convert_buffer( cv, tiny, sizeof( tiny ), "tiny", &text, &len ) != 0
+      || strstr( text, "with: -b16 --pad=0x55 */" ) == 0 || strstr( text, "  0x1122, 0x3355\n" ) == 0 )
+  {
+    fprintf( stderr, "FAIL: -b16 --pad buffer conversion\n" );
+    return 1;
+  }
+
+  // Descriptor to descriptor, from a pipe into a file, matches the buffer conversion.
+  out_fd = mkstemp( tmp_path );
+  if( out_fd < 0 || pipe( pipe_fds ) != 0 || write( pipe_fds[1], tiny, sizeof( tiny ) ) != sizeof( tiny ) )
+  {
+    fprintf( stderr, "FAIL: could not set up descriptors\n" );
+    return 1;
+  }
+  close( pipe_fds[1] );
+  unlink( tmp_path );
+
+  if( r2h_convert_fd( cv, pipe_fds[0], out_fd, "tiny" ) != 0 )
+  {
+    fprintf( stderr, "FAIL: fd conversion\n" );
+    return 1;
+  }
+  close( pipe_fds[0] );
+
+  fd_text = readBack( out_fd, &fd_len );
+  if( fd_text == 0 || fd_len != len || memcmp( fd_text, text, len ) != 0
+      || lseek( out_fd, 0, SEEK_CUR ) != (off_t) len )
+  {
+    fprintf( stderr, "FAIL: fd output differs from buffer output\n" );
+    return 1;
+  }
+  free( fd_text );
+  free( text );
+  close( out_fd );
+
+  // Options that write several files are refused and leave the converter as it was.
+  if( r2h_converter_set_flags( cv, 1, flags_incbin ) == 0
+      || r2h_convert_buffer( cv, tiny, sizeof( tiny ), "tiny", &text, &len ) != 0
+      || strstr( text, "TINY_BIG_ENDIAN" ) == 0 )
+  {
+    fprintf( stderr, "FAIL: --incbin accepted for an in-process conversion\n" );
+    return 1;
+  }
+  free( text );
+
+  // One converter, several threads at once, large enough to use the parallel formatter.
+  shared_input = malloc( SHARED_LEN );
+  if( shared_input == 0 || r2h_converter_set_flags( cv, 0, 0 ) != 0 )
+  {
+    fprintf( stderr, "FAIL: could not set up the shared input\n" );
+    return 1;
+  }
+  for( size_t i = 0; i < SHARED_LEN; i++ )
+  {
+    shared_input[i] = (uint8_t)( i * 131 + ( i >> 9 ) );
+  }
+
+  for( int t = 0; t < SHARED_THREADS; t++ )
+  {
+    runs[t] = (shared_run_t) { cv, shared_input, 0, 0, -1 };
+    if( pthread_create( &threads[t], 0, convertShared, &runs[t] ) != 0 )
+    {
+      fprintf( stderr, "FAIL: pthread_create failed\n" );
+      return 1;
+    }
+  }
+  for( int t = 0; t < SHARED_THREADS; t++ )
+  {
+    pthread_join( threads[t], 0 );
+  }
+  for( int t = 0; t < SHARED_THREADS; t++ )
+  {
+    if( runs[t].state != 0 || runs[t].len != runs[0].len || memcmp( runs[t].text, runs[0].text, runs[0].len ) != 0 )
+    {
+      fprintf( stderr, "FAIL: concurrent conversion %d differs\n", t );
+      return 1;
+    }
+  }
+  for( int t = 0; t < SHARED_THREADS; t++ )
+  {
+    free( runs[t].text );
+  }
+
+  free( shared_input );
+  r2h_converter_free( cv );
+
+  printf( "PASS: in-process buffer and descriptor conversions\n" );
+  return 0;
+}
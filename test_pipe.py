@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Runs raw2header as a pipeline stage with "-" for stdin and stdout.
+
+Every output has to match the file-to-file conversion byte for byte, with
+all progress on stderr, including streamed (--max-memory) output to a pipe.
+
+Usage: test_pipe.py <raw2header> <scratch dir>
+"""
+
+import os
+import struct
+import subprocess
+import sys
+
+
+def run(tool, args, stdin=None):
+    result = subprocess.run([tool] + args, input=stdin, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    return result.returncode, result.stdout, result.stderr
+
+
+def main():
+    tool, scratch = sys.argv[1], sys.argv[2]
+    os.makedirs(scratch, exist_ok=True)
+
+    raw = os.path.join(scratch, "pipe_in.raw")
+    ref = os.path.join(scratch, "pipe_ref.h")
+    data = bytes((i * 73 + (i >> 5)) & 0xFF for i in range(300001))
+    with open(raw, "wb") as f:
+        f.write(data)
+
+    for flags in ([], ["-b16", "--pad=0x55"], ["--string"], ["-a", "-m"], ["--max-memory=1M", "-32", "--pad=1"]):
+        code, _, _ = run(tool, flags + [raw, ref, "piped"])
+        with open(ref, "rb") as f:
+            expect = f.read()
+        if code != 0:
+            print("FAIL: file conversion with %r" % flags)
+            return 1
+
+        cases = [("file to stdout", flags + [raw, "-", "piped"], None)]
+        if "--max-memory=1M" not in flags:
+            cases.append(("stdin to stdout", flags + ["-", "-", "piped"], data))
+        for name, args, stdin in cases:
+            code, out, err = run(tool, args, stdin)
+            if code != 0 or out != expect:
+                print("FAIL: %s with %r differs from the file conversion" % (name, flags))
+                return 1
+            if b"Header file completed successfully" not in err:
+                print("FAIL: %s with %r did not report progress on stderr" % (name, flags))
+                return 1
+
+    # Streaming needs to rewind, which a pipe cannot do.
+    code, out, err = run(tool, ["--max-memory=1M", "-", "-", "piped"], data)
+    if code == 0 or out != b"":
+        print("FAIL: --max-memory accepted a piped stdin")
+        return 1
+
+    # Several outputs cannot share stdout.
+    code, out, _ = run(tool, ["-c", raw, "-", "piped"])
+    if code == 0 or out != b"":
+        print("FAIL: --source-pair accepted stdout")
+        return 1
+
+    # --incbin from stdin has no file to include, so it writes and includes the sidecar.
+    out = os.path.join(scratch, "pipe_incbin.h")
+    code, _, _ = run(tool, ["--incbin", "-", out, "piped"], data)
+    with open(os.path.join(scratch, "pipe_incbin.S")) as f:
+        asm = f.read()
+    with open(os.path.join(scratch, "pipe_incbin.bin"), "rb") as f:
+        sidecar = f.read()
+    if code != 0 or '.incbin "%s"' % os.path.realpath(os.path.join(scratch, "pipe_incbin.bin")) not in asm \
+            or sidecar != data:
+        print("FAIL: --incbin from stdin does not include its sidecar")
+        return 1
+
+    # Manifest lines and served requests share stdin and stdout, so "-" is refused.
+    manifest = os.path.join(scratch, "pipe_manifest.txt")
+    with open(manifest, "w") as f:
+        f.write("%s - a\n- %s b\n" % (raw, ref))
+    code, out, err = run(tool, ["--threads=2", "--manifest", manifest])
+    if code == 0 or b"#define" in out or err.count(b"not available in manifest or serve requests") != 2:
+        print("FAIL: manifest lines accepted stdin or stdout")
+        return 1
+
+    text = ("- %s name" % ref).encode()
+    request = struct.pack(">II", len(text), 5) + text + struct.pack(">II", 0, 6)
+    code, out, _ = run(tool, ["--serve"], request)
+    if code != 0 or out != struct.pack(">II", 11, 5) + b"invalid 0 0" + struct.pack(">II", 11, 6) + b"invalid 0 0":
+        print("FAIL: served request read stdin: %r" % out)
+        return 1
+
+    print("PASS: stdin/stdout conversions match the file conversions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Stand-in client for raw2header --serve.
+
+Sends a batch of conversion requests over stdin/stdout and over a Unix
+socket, checks the replies, and compares every output with what the command
+line tool writes for the same flags.
+
+Usage: test_serve.py <raw2header> <scratch dir>
+"""
+
+import os
+import signal
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+
+def frame(request_id, text):
+    data = text.encode()
+    return struct.pack(">II", len(data), request_id) + data
+
+
+def read_replies(stream_read, count):
+    replies = {}
+    for _ in range(count):
+        header = stream_read(8)
+        if len(header) != 8:
+            raise RuntimeError("short reply header")
+        length, request_id = struct.unpack(">II", header)
+        replies[request_id] = stream_read(length).decode()
+    return replies
+
+
+def read_exact(read):
+    def reader(n):
+        data = b""
+        while len(data) < n:
+            chunk = read(n - len(data))
+            if not chunk:
+                break
+            data += chunk
+        return data
+    return reader
+
+
+def main():
+    tool, scratch = sys.argv[1], sys.argv[2]
+    os.makedirs(scratch, exist_ok=True)
+
+    pcm = os.path.join(scratch, "serve_in.raw")
+    with open(pcm, "wb") as f:
+        f.write(bytes((i * 37 + (i >> 7)) & 0xFF for i in range(200001)))
+
+    flag_sets = ["", "-b16 --pad=0x55", "-32 --pad=1", "--string", "-a -m", "-c -64 --pad=0"]
+    requests = {}
+    for n in range(24):
+        flags = flag_sets[n % len(flag_sets)]
+        out = os.path.join(scratch, "serve_out_%d.h" % n)
+        requests[n + 1] = (flags, out, "%s %s %s asset_%d" % (flags, pcm, out, n))
+    requests[100] = ("", None, "--no-such-flag in.raw out.h name")
+    requests[101] = ("", None, "-16 %s %s odd" % (pcm, os.path.join(scratch, "serve_odd.h")))
+
+    # stdin/stdout: all requests in one go, replies in any order.
+    server = subprocess.Popen([tool, "--serve", "--threads=4"], stdin=subprocess.PIPE,
+                              stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    server.stdin.write(b"".join(frame(i, r[2]) for i, r in requests.items()))
+    server.stdin.close()
+    replies = read_replies(read_exact(server.stdout.read), len(requests))
+    if server.wait() != 0 or server.stdout.read() != b"":
+        print("FAIL: server did not stop cleanly after stdin closed")
+        return 1
+
+    if replies[100] != "invalid 0 0" or not replies[101].startswith("error "):
+        print("FAIL: bad request replies: %r %r" % (replies[100], replies[101]))
+        return 1
+
+    for request_id, (flags, out, _) in requests.items():
+        if out is None:
+            continue
+        status, files, size = replies[request_id].split()
+        expect_files = 2 if "-c" in flags.split() else 1
+        if status != "ok" or int(files) != expect_files or int(size) < os.path.getsize(out):
+            print("FAIL: reply %r for %r" % (replies[request_id], flags))
+            return 1
+
+        ref = os.path.join(scratch, "serve_ref.h")
+        subprocess.run([tool] + flags.split() + [pcm, ref, "asset_%d" % (request_id - 1)],
+                       check=True, stdout=subprocess.DEVNULL)
+        with open(out) as a, open(ref) as b:
+            if a.read() != b.read():
+                print("FAIL: served output differs from the command line for %r" % flags)
+                return 1
+
+    # Unix socket: two clients at once, then SIGTERM removes the socket.
+    sock_path = os.path.join(scratch, "serve.sock")
+    server = subprocess.Popen([tool, "--serve=" + sock_path], stdout=subprocess.DEVNULL,
+                              stderr=subprocess.DEVNULL)
+    for _ in range(100):
+        if os.path.exists(sock_path):
+            break
+        time.sleep(0.05)
+
+    clients = [socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) for _ in range(2)]
+    for c, client in enumerate(clients):
+        client.connect(sock_path)
+        client.sendall(frame(7 + c, requests[1 + c][2]))
+    for c, client in enumerate(clients):
+        reply = read_replies(read_exact(client.recv), 1)
+        if list(reply) != [7 + c] or not reply[7 + c].startswith("ok 1 "):
+            print("FAIL: socket reply %r" % reply)
+            return 1
+        client.close()
+
+    # Still connected at SIGTERM: a request already sent is answered, an idle
+    # client does not hold the server up.
+    idle = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    idle.connect(sock_path)
+    late = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    late.connect(sock_path)
+    late.sendall(frame(9, requests[3][2]))
+    time.sleep(0.1)
+
+    server.send_signal(signal.SIGTERM)
+    reply = read_replies(read_exact(late.recv), 1)
+    if list(reply) != [9] or not reply[9].startswith("ok 1 "):
+        print("FAIL: request sent before SIGTERM got %r" % reply)
+        return 1
+    if server.wait(timeout=10) != 0 or os.path.exists(sock_path) or idle.recv(1) != b"":
+        print("FAIL: socket server did not stop cleanly")
+        return 1
+    idle.close()
+    late.close()
+
+    print("PASS: %d served conversions match the command line" % (len(requests) + 3))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())